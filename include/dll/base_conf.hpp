@@ -16,6 +16,8 @@
 #include "lr_driver_type.hpp"
 #include "sparsity_method.hpp"
 #include "bias_mode.hpp"
+#include "storage_type.hpp"
+#include "metrics_policy.hpp"
 
 namespace dll {
 
@@ -56,6 +58,7 @@ struct copy_id;
 struct elastic_id;
 struct batch_size_id;
 struct big_batch_size_id;
+struct fantasy_particles_id;
 struct visible_id;
 struct hidden_id;
 struct pooling_id;
@@ -69,6 +72,7 @@ struct sparsity_id;
 struct bias_id;
 struct momentum_id;
 struct parallel_mode_id;
+struct hogwild_id;
 struct serial_id;
 struct verbose_id;
 struct shuffle_id;
@@ -79,6 +83,14 @@ struct weight_type_id;
 struct free_energy_id;
 struct memory_id;
 struct batch_mode_id;
+struct pipeline_id;
+struct pipeline_producers_id;
+struct activation_cache_id;
+struct activation_storage_id;
+struct weight_storage_id;
+struct fft_conv_id;
+struct metrics_id;
+struct metrics_period_id;
 struct dbn_only_id;
 struct nop_id;
 
@@ -88,6 +100,54 @@ struct batch_size : value_conf_elt<batch_size_id, std::size_t, B> {};
 template <std::size_t B>
 struct big_batch_size : value_conf_elt<big_batch_size_id, std::size_t, B> {};
 
+/*!
+ * \brief Number of persistent chains (fantasy particles) of PCD, one per
+ * sample of the batch by default
+ */
+template <std::size_t P>
+struct fantasy_particles : value_conf_elt<fantasy_particles_id, std::size_t, P> {};
+
+/*!
+ * \brief Pipeline the propagation of the big batches through the lower
+ * layers with the training of the current layer, in batch mode, using a ring
+ * of D buffers.
+ */
+template <std::size_t D>
+struct pipeline : value_conf_elt<pipeline_id, std::size_t, D> {};
+
+/*!
+ * \brief Number of threads propagating the big batches in pipelined mode
+ */
+template <std::size_t P>
+struct pipeline_producers : value_conf_elt<pipeline_producers_id, std::size_t, P> {};
+
+/*!
+ * \brief Select the storage of the activations propagated between the
+ * pretrained layers
+ */
+template <storage_type S>
+struct activation_storage : value_conf_elt<activation_storage_id, storage_type, S> {};
+
+/*!
+ * \brief Store the weights used by the batch Gibbs steps as float16 or
+ * bfloat16. The weights of the RBM are kept in the weight type and updated
+ * by the trainer, which then refreshes its low-precision copy.
+ */
+template <storage_type S>
+struct weight_storage : value_conf_elt<weight_storage_id, storage_type, S> {};
+
+/*!
+ * \brief Select the batches on which the training metrics are computed
+ */
+template <metrics_policy P>
+struct metrics : value_conf_elt<metrics_id, metrics_policy, P> {};
+
+/*!
+ * \brief The period N of the PERIODIC and SAMPLED metrics policies
+ */
+template <std::size_t N>
+struct metrics_period : value_conf_elt<metrics_period_id, std::size_t, N> {};
+
 template <unit_type VT>
 struct visible : value_conf_elt<visible_id, unit_type, VT> {};
 
@@ -138,6 +198,13 @@ struct watcher : template_type_conf_elt<watcher_id, T> {};
 
 struct momentum : basic_conf_elt<momentum_id> {};
 struct parallel_mode : basic_conf_elt<parallel_mode_id> {};
+
+/*!
+ * \brief Train the RBM asynchronously: each thread trains on its own batches
+ * and updates the shared weights without any lock (Hogwild).
+ */
+struct hogwild : basic_conf_elt<hogwild_id> {};
+
 struct serial : basic_conf_elt<serial_id> {};
 struct verbose : basic_conf_elt<verbose_id> {};
 struct svm_concatenate : basic_conf_elt<svm_concatenate_id> {};
@@ -149,6 +216,18 @@ struct dbn_only : basic_conf_elt<dbn_only_id> {};
 struct nop : basic_conf_elt<nop_id> {};
 struct batch_mode : basic_conf_elt<batch_mode_id> {};
 
+/*!
+ * \brief Compute the convolutions of the CRBMs in the frequency domain, with
+ * the spectra of the weights cached between the weight updates.
+ */
+struct fft_conv : basic_conf_elt<fft_conv_id> {};
+
+/*!
+ * \brief In batch mode, store the inputs of each pretrained layer in a scratch
+ * file instead of propagating them again at each epoch.
+ */
+struct activation_cache : basic_conf_elt<activation_cache_id> {};
+
 struct memory_impl : basic_conf_elt<memory_id> {};
 using memory[[deprecated("use batch_mode instead")]] = memory_impl;
 
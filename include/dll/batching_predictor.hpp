@@ -0,0 +1,282 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file batching_predictor.hpp
+ * \brief Predictor grouping concurrent requests into batches.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Statistics of a batching predictor
+ */
+struct batching_statistics {
+    std::size_t requests = 0;   ///< The number of completed requests
+    std::size_t batches  = 0;   ///< The number of batches that have been propagated
+    double average_batch = 0.0; ///< The average number of requests per batch
+    double p50           = 0.0; ///< The median latency, in microseconds
+    double p99           = 0.0; ///< The 99th percentile of the latency, in microseconds
+    double throughput    = 0.0; ///< The number of requests per second since the start of the predictor
+};
+
+/*!
+ * \brief Predictor grouping the concurrent requests of several threads into
+ * batches propagated at once through the network.
+ *
+ * A batch is formed as soon as max_batch requests are waiting or when the
+ * oldest waiting request has waited for max_wait. The batches are
+ * propagated by a pool of worker threads with the batch kernels of the
+ * layers (dbn::predict_batch). Each request is completed through a future,
+ * which holds the exception thrown by the propagation of its batch, if any.
+ *
+ * The network must not be modified while the predictor is running.
+ *
+ * \tparam DBN The type of network
+ * \tparam Sample The type of sample
+ * \tparam B The number of samples propagated at once by the batch kernels
+ */
+template <typename DBN, typename Sample, std::size_t B = DBN::batch_size>
+struct batching_predictor {
+    using dbn_t      = DBN;                            ///< The type of network
+    using sample_t   = Sample;                         ///< The type of sample
+    using clock      = std::chrono::steady_clock;      ///< The clock used for the deadlines and latencies
+    using time_point = std::chrono::time_point<clock>; ///< A point in time
+    using duration   = std::chrono::microseconds;      ///< The resolution of the waiting times
+
+    static constexpr const std::size_t latency_window = 1 << 16; ///< The number of latencies kept for the percentiles
+
+    /*!
+     * \brief Start a new predictor
+     * \param dbn The network, must outlive the predictor
+     * \param max_batch The maximum number of requests in a batch
+     * \param max_wait The maximum time a request waits for a batch to be formed
+     * \param workers The number of worker threads
+     */
+    batching_predictor(const dbn_t& dbn, std::size_t max_batch = B, duration max_wait = duration(1000), std::size_t workers = 1)
+            : dbn(dbn), max_batch(max_batch), max_wait(max_wait), start(clock::now()) {
+        cpp_assert(max_batch > 0, "The batches must contain at least one request");
+        cpp_assert(workers > 0, "The predictor needs at least one worker");
+
+        latencies.reserve(latency_window);
+
+        for (std::size_t i = 0; i < workers; ++i) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    batching_predictor(const batching_predictor& rhs) = delete;
+    batching_predictor& operator=(const batching_predictor& rhs) = delete;
+
+    /*!
+     * \brief Complete all the waiting requests and stop the workers
+     */
+    ~batching_predictor() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stopping = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Queue a prediction request
+     * \param sample The sample to classify
+     * \return A future holding the predicted label
+     */
+    std::future<std::size_t> predict(sample_t sample) {
+        std::future<std::size_t> future;
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            cpp_assert(!stopping, "The predictor is stopping");
+
+            queue.emplace_back(std::move(sample));
+            future = queue.back().promise.get_future();
+        }
+
+        condition.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Returns the statistics of the predictor
+     */
+    batching_statistics statistics() const {
+        batching_statistics stats;
+
+        std::vector<double> sorted;
+
+        {
+            std::lock_guard<std::mutex> l(stats_lock);
+
+            stats.requests = requests;
+            stats.batches  = batches;
+            sorted         = latencies;
+        }
+
+        if (stats.batches) {
+            stats.average_batch = stats.requests / double(stats.batches);
+        }
+
+        if (!sorted.empty()) {
+            std::sort(sorted.begin(), sorted.end());
+
+            stats.p50 = sorted[(sorted.size() - 1) / 2];
+            stats.p99 = sorted[((sorted.size() - 1) * 99) / 100];
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(clock::now() - start).count();
+
+        if (elapsed > 0.0) {
+            stats.throughput = stats.requests / elapsed;
+        }
+
+        return stats;
+    }
+
+private:
+    struct request {
+        explicit request(sample_t sample)
+                : sample(std::move(sample)), queued(clock::now()) {}
+
+        sample_t sample;                   ///< The sample to classify
+        std::promise<std::size_t> promise; ///< The promise of the label
+        time_point queued;                 ///< The time the request was queued
+    };
+
+    void work() {
+        std::vector<request> batch;
+        std::vector<sample_t> samples;
+        std::vector<std::size_t> labels;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [this] { return stopping || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                //Wait for the batch to be full or for the deadline of the oldest request
+
+                auto deadline = queue.front().queued + max_wait;
+
+                condition.wait_until(l, deadline, [this] { return stopping || queue.empty() || queue.size() >= max_batch; });
+
+                if (queue.empty()) {
+                    continue;
+                }
+
+                auto n = std::min(queue.size(), max_batch);
+
+                for (std::size_t i = 0; i < n; ++i) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+
+            //Let another worker form the next batch
+            condition.notify_one();
+
+            samples.clear();
+            for (auto& r : batch) {
+                samples.push_back(std::move(r.sample));
+            }
+
+            labels.resize(samples.size());
+
+            try {
+                dbn.template predict_batch<B>(samples.begin(), samples.end(), labels.begin());
+            } catch (...) {
+                //The failure is forwarded to each request of the batch
+
+                auto error = std::current_exception();
+
+                for (auto& r : batch) {
+                    r.promise.set_exception(error);
+                }
+
+                batch.clear();
+                continue;
+            }
+
+            auto done = clock::now();
+
+            //The statistics are updated before the requests are completed so
+            //that they account for every completed request
+
+            {
+                std::lock_guard<std::mutex> l(stats_lock);
+
+                requests += batch.size();
+                ++batches;
+
+                for (auto& r : batch) {
+                    auto latency = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(done - r.queued).count();
+
+                    if (latencies.size() < latency_window) {
+                        latencies.push_back(latency);
+                    } else {
+                        latencies[next_latency] = latency;
+                    }
+
+                    next_latency = (next_latency + 1) % latency_window;
+                }
+            }
+
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                batch[i].promise.set_value(labels[i]);
+            }
+
+            batch.clear();
+        }
+    }
+
+    const dbn_t& dbn;            ///< The network
+    const std::size_t max_batch; ///< The maximum number of requests per batch
+    const duration max_wait;     ///< The maximum waiting time of a request
+
+    std::mutex lock;                   ///< The lock protecting the queue
+    std::condition_variable condition; ///< The condition signaling new requests
+    std::deque<request> queue;         ///< The waiting requests
+    bool stopping = false;             ///< Indicates if the predictor is stopping
+
+    mutable std::mutex stats_lock; ///< The lock protecting the statistics
+    std::size_t requests     = 0;  ///< The number of completed requests
+    std::size_t batches      = 0;  ///< The number of propagated batches
+    std::size_t next_latency = 0;  ///< The next position in the latency window
+    std::vector<double> latencies; ///< The latencies of the last requests, in microseconds
+    time_point start;              ///< The start of the predictor
+
+    std::vector<std::thread> threads; ///< The worker threads
+};
+
+} //end of dll namespace
@@ -24,6 +24,10 @@
 #include "etl/etl.hpp"
 
 #include "util/batch.hpp"
+#include "util/compact.hpp"
+#include "util/low_precision.hpp"
+#include "util/sparse.hpp"
+#include "util/random.hpp"
 #include "util/timers.hpp"
 #include "decay_type.hpp"
 #include "layer_traits.hpp"
@@ -123,7 +127,7 @@ void update_normal(RBM& rbm, Trainer& t) {
     });
 
     //TODO the batch is not necessary full!
-    const auto n_samples = double(etl::dim<0>(t.w_grad_b));
+    const auto n_samples = double(etl::dim<0>(t.v1));
     auto eps             = rbm.learning_rate / n_samples;
 
     //Apply momentum and learning rate
@@ -147,6 +151,11 @@ void update_normal(RBM& rbm, Trainer& t) {
 
     //Check for NaN
     nan_check_deep_3(rbm.w, rbm.b, rbm.c);
+
+    //Refresh the low-precision weights from the updated weights
+    cpp::static_if<layer_traits<rbm_t>::is_mixed_precision()>([&](auto f) {
+        f(t).w_low = rbm.w;
+    });
 }
 
 template <typename RBM, typename Trainer>
@@ -238,23 +247,27 @@ void update_convolutional(RBM& rbm, Trainer& t) {
         f(rbm.c) += eps * t.c_grad;
     });
 
+    //The cached flipped weights are not valid anymore
+    rbm.weights_changed();
+
     //Check for NaN
     nan_check_deep(rbm.w);
     nan_check_deep(rbm.b);
     nan_check_deep(rbm.c);
 }
 
-#ifndef ETL_BLAS_MODE
-
+/*!
+ * \brief Accumulate the gradients of a batch with scalar loops
+ */
 template <typename Trainer>
-void batch_compute_gradients(Trainer& t) {
+void batch_compute_gradients_std(Trainer& t) {
     dll::auto_timer timer("cd:batch_compute_gradients:std");
 
-    const auto B = etl::dim<0>(t.w_grad_b);
+    const auto B = etl::dim<0>(t.vf);
 
     for (std::size_t b = 0; b < B; b++) {
-        for (std::size_t i = 0; i < etl::dim<1>(t.w_grad_b); i++) {
-            for (std::size_t j = 0; j < etl::dim<2>(t.w_grad_b); j++) {
+        for (std::size_t i = 0; i < etl::dim<1>(t.vf); i++) {
+            for (std::size_t j = 0; j < etl::dim<1>(t.h1_a); j++) {
                 t.w_grad(i, j) += t.vf(b, i) * t.h1_a(b, j) - t.v2_a(b, i) * t.h2_a(b, j);
             }
         }
@@ -273,6 +286,70 @@ void batch_compute_gradients(Trainer& t) {
     }
 }
 
+/*!
+ * \brief Accumulate the gradients of a batch with two matrix-matrix
+ * multiplications, using the vectorized and blocked kernels of ETL.
+ *
+ * The positive and negative statistics of the batch are vf^T * h1_a and
+ * v2_a^T * h2_a.
+ */
+template <typename Trainer>
+void batch_compute_gradients_gemm(Trainer& t) {
+    dll::auto_timer timer("cd:batch_compute_gradients:gemm");
+
+    t.w_grad += etl::transpose(t.vf) * t.h1_a - etl::transpose(t.v2_a) * t.h2_a;
+    t.b_grad += etl::sum_l(t.h1_a - t.h2_a);
+    t.c_grad += etl::sum_l(t.vf - t.v2_a);
+}
+
+/*!
+ * \brief Accumulate the gradients of a batch whose negative statistics come
+ * from a different number of chains (PCD fantasy particles).
+ *
+ * The negative statistics are rescaled to the size of the batch.
+ */
+template <typename Trainer>
+void batch_compute_gradients_particles(Trainer& t) {
+    dll::auto_timer timer("cd:batch_compute_gradients:particles");
+
+    using weight = typename Trainer::weight;
+
+    const weight ratio = weight(etl::dim<0>(t.vf)) / weight(etl::dim<0>(t.v2_a));
+
+    t.w_grad += etl::transpose(t.vf) * t.h1_a - ratio * (etl::transpose(t.v2_a) * t.h2_a);
+    t.b_grad += etl::sum_l(t.h1_a) - ratio * etl::sum_l(t.h2_a);
+    t.c_grad += etl::sum_l(t.vf) - ratio * etl::sum_l(t.v2_a);
+}
+
+/*!
+ * \brief Accumulate the gradients of a batch of sparse samples.
+ *
+ * The positive statistics vf^T * h1_a are accumulated from the non-zero
+ * values of the CSR batch. The negative statistics are dense, and rescaled
+ * to the size of the batch with PCD fantasy particles.
+ */
+template <typename Trainer>
+void batch_compute_gradients_sparse(Trainer& t) {
+    dll::auto_timer timer("cd:batch_compute_gradients:sparse");
+
+    using weight = typename Trainer::weight;
+
+    const weight ratio = weight(etl::dim<0>(t.vf)) / weight(etl::dim<0>(t.v2_a));
+
+    t.w_grad -= ratio * (etl::transpose(t.v2_a) * t.h2_a);
+    sparse_outer_accumulate(t.w_grad, t.vf_sparse, t.h1_a);
+
+    t.b_grad += etl::sum_l(t.h1_a) - ratio * etl::sum_l(t.h2_a);
+    t.c_grad += etl::sum_l(t.vf) - ratio * etl::sum_l(t.v2_a);
+}
+
+#ifndef ETL_BLAS_MODE
+
+template <typename Trainer>
+void batch_compute_gradients(Trainer& t) {
+    batch_compute_gradients_gemm(t);
+}
+
 template <typename Trainer>
 void compute_gradients_one(Trainer& t) {
     dll::auto_timer timer("cd:compute_gradients_one:std");
@@ -291,11 +368,14 @@ void compute_gradients_one(Trainer& t) {
 
 #else
 
+/*!
+ * \brief Accumulate the gradients of a batch with BLAS rank-1 updates
+ */
 template <typename Trainer>
-void batch_compute_gradients(Trainer& t) {
+void batch_compute_gradients_blas(Trainer& t) {
     dll::auto_timer timer("cd:batch_compute_gradients:blas");
 
-    const auto B = etl::dim<0>(t.w_grad_b);
+    const auto B = etl::dim<0>(t.vf);
 
     for (std::size_t b = 0; b < B; b++) {
         blas_ger(
@@ -324,6 +404,11 @@ void batch_compute_gradients(Trainer& t) {
     }
 }
 
+template <typename Trainer>
+void batch_compute_gradients(Trainer& t) {
+    batch_compute_gradients_blas(t);
+}
+
 template <typename Trainer>
 void compute_gradients_one(Trainer& t) {
     dll::auto_timer timer("cd:compute_gradients_one:blas");
@@ -355,6 +440,78 @@ void compute_gradients_one(Trainer& t) {
 
 #endif
 
+/* Gradient accumulation */
+
+/*!
+ * \brief Returns the number of gradient accumulators of the trainer of the
+ * given RBM, one per thread of its pool.
+ */
+template <typename RBM>
+std::size_t gradient_accumulators(const RBM& rbm) {
+    return layer_traits<RBM>::is_serial() ? 1 : std::max(std::min(std::size_t(etl::threads), get_batch_size(rbm)), std::size_t(1));
+}
+
+/*!
+ * \brief Returns the first sample of the chunk c when n samples are split in
+ * the given number of chunks
+ */
+inline std::size_t chunk_start(std::size_t c, std::size_t n, std::size_t chunks) {
+    return (c * n) / chunks;
+}
+
+/*!
+ * \brief Sum the first chunks accumulators into the first one, by pairs, in
+ * parallel
+ */
+template <typename Pool, typename Accumulators>
+void reduce_accumulators(Pool& pool, Accumulators& acc, std::size_t chunks) {
+    dll::auto_timer timer("cd:reduce_accumulators");
+
+    for (std::size_t stride = 1; stride < chunks; stride *= 2) {
+        const std::size_t pairs = (chunks + 2 * stride - 1) / (2 * stride);
+
+        maybe_parallel_foreach_n(pool, 0, pairs, [&](std::size_t p) {
+            const std::size_t c = p * 2 * stride;
+
+            if (c + stride < chunks) {
+                acc(c) += acc(c + stride);
+            }
+        });
+    }
+}
+
+/*!
+ * \brief Start the persistent chains from the hidden activations of the
+ * first batch, reusing its samples cyclically if there are more chains than
+ * samples
+ */
+template <typename Trainer>
+void init_particles(Trainer& t) {
+    const std::size_t B = etl::dim<0>(t.h1_a);
+
+    for (std::size_t p = 0; p < etl::dim<0>(t.p_h_a); ++p) {
+        t.p_h_a(p) = t.h1_a(p % B);
+        t.p_h_s(p) = t.h1_s(p % B);
+    }
+}
+
+/*!
+ * \brief Returns the mean squared difference between the expected samples
+ * and the visible units of the chains they are paired with
+ */
+template <typename Trainer>
+double batch_reconstruction_error(const Trainer& t) {
+    const std::size_t n = std::min(etl::dim<0>(t.vf), etl::dim<0>(t.v2_a));
+
+    double error = 0.0;
+
+    for (std::size_t b = 0; b < n; ++b) {
+        error += etl::sum((t.vf(b) - t.v2_a(b)) >> (t.vf(b) - t.v2_a(b)));
+    }
+
+    return error / (n * etl::dim<1>(t.vf));
+}
+
 /* The training procedures */
 
 template <bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer, cpp_enable_if(layer_traits<RBM>::is_parallel_mode())>
@@ -363,60 +520,107 @@ void compute_gradients_normal(const dll::batch<T>& input_batch, const dll::batch
 
     auto n = input_batch.size();
 
+    //The batch is split in one chunk per accumulator, each chunk accumulates
+    //the gradients of its samples in its own accumulator
+    const std::size_t chunks = std::min(n, gradient_accumulators(rbm));
+
+    //Each chunk samples from its own stream, the results do not depend on
+    //the order in which the threads execute the chunks
+    const auto streams = dll::rng().next64();
+
     // clang-format off
-    maybe_parallel_foreach_pair_i(t.pool, input_batch.begin(), input_batch.end(), expected_batch.begin(), expected_batch.end(),
-            [&](const auto& input, const auto& expected, std::size_t i)
+    maybe_parallel_foreach_n(t.pool, 0, chunks, [&](std::size_t c)
     {
-        //Copy input/expected for computations
-        t.v1(i) = input;
-        t.vf(i) = expected;
+        random_stream stream(streams, c);
+        random_scope scope(stream);
 
-        //First step
-        rbm.template activate_hidden<true, true>(t.h1_a(i), t.h1_s(i), t.v1(i), t.v1(i), t.ht(i));
+        auto input    = std::next(input_batch.begin(), chunk_start(c, n, chunks));
+        auto expected = std::next(expected_batch.begin(), chunk_start(c, n, chunks));
 
-        if(Persistent && t.init){
-            t.p_h_a(i) = t.h1_a(i);
-            t.p_h_s(i) = t.h1_s(i);
+        if(n > 1){
+            //Reset the gradients of the chunk
+            t.w_grad_t(c) = 0;
         }
 
-        //CD-1
-        cpp::static_if<Persistent>([&](auto f){
-            f(rbm).template activate_visible<true, false>(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            f(rbm).template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
-        }).else_([&](auto f){
-            f(rbm).template activate_visible<true, false>(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            f(rbm).template activate_hidden<true, (K > 1)>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
-        });
+        for(std::size_t i = chunk_start(c, n, chunks); i < chunk_start(c + 1, n, chunks); ++i, ++input, ++expected){
+            //Copy input/expected for computations
+            copy_input(t.v1(i), *input);
+            copy_input(t.vf(i), *expected);
 
-        //CD-k
-        for(std::size_t k = 1; k < K; ++k){
-            rbm.template activate_visible<true, false>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
-        }
+            //First step
+            rbm.template activate_hidden<true, true>(t.h1_a(i), t.h1_s(i), t.v1(i), t.v1(i), t.ht(i));
 
-        if(n > 1){
-            //Reset the batch gradients
-            t.w_grad_b(i) = 0;
+            if(Persistent && t.init){
+                t.p_h_a(i) = t.h1_a(i);
+                t.p_h_s(i) = t.h1_s(i);
+            }
 
-            for(std::size_t i2 = 0; i2 < num_visible(rbm); i2++){
-                for(std::size_t j = 0; j < num_hidden(rbm); j++){
-                    t.w_grad_b(i, i2, j) += t.vf(i, i2) * t.h1_a(i,j) - t.v2_a(i, i2) * t.h2_a(i, j);
+            //CD-1
+            cpp::static_if<Persistent>([&](auto f){
+                f(rbm).template activate_visible<true, false>(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
+                f(rbm).template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
+            }).else_([&](auto f){
+                f(rbm).template activate_visible<true, false>(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
+                f(rbm).template activate_hidden<true, (K > 1)>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
+            });
+
+            //CD-k
+            for(std::size_t k = 1; k < K; ++k){
+                rbm.template activate_visible<true, false>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
+                rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
+            }
+
+            if(n > 1){
+                for(std::size_t i2 = 0; i2 < num_visible(rbm); i2++){
+                    for(std::size_t j = 0; j < num_hidden(rbm); j++){
+                        t.w_grad_t(c, i2, j) += t.vf(i, i2) * t.h1_a(i,j) - t.v2_a(i, i2) * t.h2_a(i, j);
+                    }
                 }
+            } else {
+                compute_gradients_one(t);
             }
-        } else {
-            compute_gradients_one(t);
         }
     });
     // clang-format on
 
     if(n > 1){
         //Compute the gradients
-        t.w_grad = sum_l(t.w_grad_b);
+        reduce_accumulators(t.pool, t.w_grad_t, chunks);
+
+        t.w_grad = t.w_grad_t(0);
         t.b_grad = sum_l(t.h1_a - t.h2_a);
         t.c_grad = sum_l(t.vf - t.v2_a);
     }
 }
 
+/*!
+ * \brief Compute the hidden activations of a batch during training, with
+ * the low-precision weights of the trainer in mixed precision
+ */
+template <bool P, bool S, typename RBM, typename Trainer, typename H1, typename H2, typename V, cpp_enable_if(layer_traits<RBM>::is_mixed_precision())>
+void train_activate_hidden(const RBM& rbm, const Trainer& t, H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) {
+    rbm.template batch_activate_hidden<P, S>(h_a, h_s, v_a, v_s, t.w_low);
+}
+
+template <bool P, bool S, typename RBM, typename Trainer, typename H1, typename H2, typename V, cpp_disable_if(layer_traits<RBM>::is_mixed_precision())>
+void train_activate_hidden(const RBM& rbm, const Trainer&, H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) {
+    rbm.template batch_activate_hidden<P, S>(h_a, h_s, v_a, v_s);
+}
+
+/*!
+ * \brief Compute the visible activations of a batch during training, with
+ * the low-precision weights of the trainer in mixed precision
+ */
+template <bool P, bool S, typename RBM, typename Trainer, typename H, typename V, cpp_enable_if(layer_traits<RBM>::is_mixed_precision())>
+void train_activate_visible(const RBM& rbm, const Trainer& t, const H& h_a, const H& h_s, V&& v_a, V&& v_s) {
+    rbm.template batch_activate_visible<P, S>(h_a, h_s, v_a, v_s, t.w_low);
+}
+
+template <bool P, bool S, typename RBM, typename Trainer, typename H, typename V, cpp_disable_if(layer_traits<RBM>::is_mixed_precision())>
+void train_activate_visible(const RBM& rbm, const Trainer&, const H& h_a, const H& h_s, V&& v_a, V&& v_s) {
+    rbm.template batch_activate_visible<P, S>(h_a, h_s, v_a, v_s);
+}
+
 template <bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer, cpp_disable_if(layer_traits<RBM>::is_parallel_mode())>
 void compute_gradients_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, RBM& rbm, Trainer& t) {
     dll::auto_timer timer("cd:gradients:normal:batch");
@@ -427,31 +631,40 @@ void compute_gradients_normal(const dll::batch<T>& input_batch, const dll::batch
     auto eit  = expected_batch.begin();
 
     for (std::size_t i = 0; iit != iend; ++i, ++iit, ++eit) {
-        t.v1(i) = *iit;
-        t.vf(i) = *eit;
+        copy_input(t.v1(i), *iit);
+        copy_input(t.vf(i), *eit);
     }
 
+    //Sparse samples are also gathered in CSR batches for the positive phase
+    constexpr const bool sparse = is_sparse_vector<typename dll::batch<T>::value_type>::value;
+
     //First step
-    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+    cpp::static_if<sparse>([&](auto f) {
+        f(t).v1_sparse.assign(input_batch, etl::dim<0>(t.v1));
+        f(t).vf_sparse.assign(expected_batch, etl::dim<0>(t.vf));
+
+        train_activate_hidden<true, true>(rbm, t, t.h1_a, t.h1_s, f(t).v1_sparse, f(t).v1_sparse);
+    }).else_([&](auto f) {
+        train_activate_hidden<true, true>(rbm, t, t.h1_a, t.h1_s, f(t).v1, f(t).v1);
+    });
 
     if (Persistent && t.init) {
-        t.p_h_a = t.h1_a;
-        t.p_h_s = t.h1_s;
+        init_particles(t);
     }
 
     //CD-1
     cpp::static_if<Persistent>([&](auto f) {
-        f(rbm).template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        f(rbm).template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        train_activate_visible<true, false>(rbm, f(t), t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
+        train_activate_hidden<true, true>(rbm, f(t), t.h2_a, t.h2_s, t.v2_a, t.v2_s);
     }).else_([&](auto f) {
-        f(rbm).template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        f(rbm).template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        train_activate_visible<true, false>(rbm, f(t), t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+        train_activate_hidden<true, (K > 1)>(rbm, f(t), t.h2_a, t.h2_s, t.v2_a, t.v2_s);
     });
 
     //CD-k
     for (std::size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        train_activate_visible<true, false>(rbm, t, t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        train_activate_hidden<true, true>(rbm, t, t.h2_a, t.h2_s, t.v2_a, t.v2_s);
     }
 
     //Compute the gradients
@@ -460,7 +673,13 @@ void compute_gradients_normal(const dll::batch<T>& input_batch, const dll::batch
     t.b_grad = 0;
     t.c_grad = 0;
 
-    batch_compute_gradients(t);
+    if (sparse) {
+        batch_compute_gradients_sparse(t);
+    } else if (etl::dim<0>(t.v2_a) == etl::dim<0>(t.vf)) {
+        batch_compute_gradients(t);
+    } else {
+        batch_compute_gradients_particles(t);
+    }
 }
 
 template <bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer>
@@ -483,12 +702,16 @@ void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expecte
         t.init = false;
     }
 
-    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+    if (context.measure) {
+        context.batch_error = batch_reconstruction_error(t);
+    }
 
     nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
 
     //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    if (context.measure || layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET) {
+        t.q_global_batch = mean(t.h2_a);
+    }
 
     cpp::static_if<layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
         f(t).q_local_batch = mean_l(t.h2_a);
@@ -500,8 +723,9 @@ void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expecte
     t.update(rbm);
 }
 
+//Accumulate the gradients of the sample i in the accumulator c
 template <bool Denoising, typename Trainer, typename RBM>
-void normal_compute_gradients_conv(RBM& /*rbm*/, Trainer& t, std::size_t i) {
+void normal_compute_gradients_conv(RBM& /*rbm*/, Trainer& t, std::size_t c, std::size_t i) {
 #ifndef ETL_CUDNN_MODE
     dll::auto_timer timer("cd:normal_compute_gradients_conv");
 
@@ -513,16 +737,19 @@ void normal_compute_gradients_conv(RBM& /*rbm*/, Trainer& t, std::size_t i) {
 
     for(std::size_t channel = 0; channel < NC; ++channel){
         if(Denoising){
-            conv_2d_valid_multi_flipped(t.vf(i)(channel), t.h1_a(i), t.w_pos(i)(channel));
-            conv_2d_valid_multi_flipped(t.v2_a(i)(channel), t.h2_a(i), t.w_neg(i)(channel));
+            conv_2d_valid_multi_flipped(t.vf(i)(channel), t.h1_a(i), t.w_pos(c)(channel));
+            conv_2d_valid_multi_flipped(t.v2_a(i)(channel), t.h2_a(i), t.w_neg(c)(channel));
         } else {
-            conv_2d_valid_multi_flipped(t.v1(i)(channel), t.h1_a(i), t.w_pos(i)(channel));
-            conv_2d_valid_multi_flipped(t.v2_a(i)(channel), t.h2_a(i), t.w_neg(i)(channel));
+            conv_2d_valid_multi_flipped(t.v1(i)(channel), t.h1_a(i), t.w_pos(c)(channel));
+            conv_2d_valid_multi_flipped(t.v2_a(i)(channel), t.h2_a(i), t.w_neg(c)(channel));
         }
     }
+
+    t.w_grad_t(c) += t.w_pos(c) - t.w_neg(c);
 #else
     std::cerr << "You must use batch mode if you want to use CUDNN" << std::endl;
     cpp_unused(t);
+    cpp_unused(c);
     cpp_unused(i);
 #endif
 }
@@ -531,48 +758,74 @@ template <bool Persistent, bool Denoising, std::size_t N, typename Trainer, type
 void compute_gradients_conv(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, RBM& rbm, Trainer& t) {
     dll::auto_timer timer("cd:gradients:conv:par");
 
+    auto n = input_batch.size();
+
+    //The batch is split in one chunk per accumulator, each chunk accumulates
+    //the gradients of its samples in its own accumulator
+    const std::size_t chunks = std::min(n, gradient_accumulators(rbm));
+
+    //Each chunk samples from its own stream, the results do not depend on
+    //the order in which the threads execute the chunks
+    const auto streams = dll::rng().next64();
+
     // clang-format off
-    maybe_parallel_foreach_pair_i(t.pool, input_batch.begin(), input_batch.end(), expected_batch.begin(), expected_batch.end(),
-            [&](const auto& input, const auto& expected, std::size_t i)
+    maybe_parallel_foreach_n(t.pool, 0, chunks, [&](std::size_t c)
     {
-        //Copy input/expected for computations
-        t.v1(i) = input;
+        random_stream stream(streams, c);
+        random_scope scope(stream);
 
-        if(Denoising){
-            t.vf(i) = expected;
-        }
+        auto input    = std::next(input_batch.begin(), chunk_start(c, n, chunks));
+        auto expected = std::next(expected_batch.begin(), chunk_start(c, n, chunks));
 
-        //First step
-        rbm.template activate_hidden<true, true>(t.h1_a(i), t.h1_s(i), t.v1(i), t.v1(i), t.v_cv(i));
+#ifndef ETL_CUDNN_MODE
+        //Reset the gradients of the chunk
+        t.w_grad_t(c) = 0;
+#endif
 
-        if(Persistent && t.init){
-            t.p_h_a(i) = t.h1_a(i);
-            t.p_h_s(i) = t.h1_s(i);
-        }
+        for(std::size_t i = chunk_start(c, n, chunks); i < chunk_start(c + 1, n, chunks); ++i, ++input, ++expected){
+            //Copy input/expected for computations
+            t.v1(i) = *input;
 
-        //CD-1
-        if(Persistent){
-            rbm.template activate_visible<true, false>(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
-        } else {
-            rbm.template activate_visible<true, false>(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.template activate_hidden<true, (N > 1)>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
-        }
+            if(Denoising){
+                t.vf(i) = *expected;
+            }
 
-        //CD-k
-        for(std::size_t k = 1; k < N; ++k){
-            rbm.template activate_visible<true, false>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
-        }
+            //First step
+            rbm.template activate_hidden<true, true>(t.h1_a(i), t.h1_s(i), t.v1(i), t.v1(i), t.v_cv(i));
+
+            if(Persistent && t.init){
+                t.p_h_a(i) = t.h1_a(i);
+                t.p_h_s(i) = t.h1_s(i);
+            }
+
+            //CD-1
+            if(Persistent){
+                rbm.template activate_visible<true, false>(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
+                rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            } else {
+                rbm.template activate_visible<true, false>(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
+                rbm.template activate_hidden<true, (N > 1)>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            }
+
+            //CD-k
+            for(std::size_t k = 1; k < N; ++k){
+                rbm.template activate_visible<true, false>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
+                rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            }
 
-        //Compute gradients
-        normal_compute_gradients_conv<Denoising>(rbm, t, i);
+            //Compute gradients
+            normal_compute_gradients_conv<Denoising>(rbm, t, c, i);
+        }
     });
     // clang-format on
+
+#ifndef ETL_CUDNN_MODE
+    reduce_accumulators(t.pool, t.w_grad_t, chunks);
+#endif
 }
 
 template <bool Denoising, typename Trainer, typename RBM>
-void batch_compute_gradients_conv(RBM& rbm, Trainer& t) {
+void batch_compute_gradients_conv(RBM& rbm, Trainer& t, std::size_t n) {
     dll::auto_timer timer("cd:batch_compute_gradients_conv");
 
     using namespace etl;
@@ -587,23 +840,20 @@ void batch_compute_gradients_conv(RBM& rbm, Trainer& t) {
     }
 
     cpp_unused(rbm);
+    cpp_unused(n);
 #else
-    using rbm_t = RBM;
+    //The batch is split in one chunk per accumulator
+    const std::size_t chunks = std::min(n, gradient_accumulators(rbm));
 
-    const auto B            = get_batch_size(rbm);
-    constexpr const auto NC = rbm_t::NC;
+    maybe_parallel_foreach_n(t.pool, 0, chunks, [&](std::size_t c) {
+        t.w_grad_t(c) = 0;
 
-    maybe_parallel_foreach_n(t.pool, 0, B, [&](std::size_t batch) {
-        for (std::size_t channel = 0; channel < NC; ++channel) {
-            if (Denoising) {
-                etl::conv_2d_valid_multi_flipped(t.vf(batch)(channel), t.h1_a(batch), t.w_pos(batch)(channel));
-                etl::conv_2d_valid_multi_flipped(t.v2_a(batch)(channel), t.h2_a(batch), t.w_neg(batch)(channel));
-            } else {
-                etl::conv_2d_valid_multi_flipped(t.v1(batch)(channel), t.h1_a(batch), t.w_pos(batch)(channel));
-                etl::conv_2d_valid_multi_flipped(t.v2_a(batch)(channel), t.h2_a(batch), t.w_neg(batch)(channel));
-            }
+        for (std::size_t i = chunk_start(c, n, chunks); i < chunk_start(c + 1, n, chunks); ++i) {
+            normal_compute_gradients_conv<Denoising>(rbm, t, c, i);
         }
     });
+
+    reduce_accumulators(t.pool, t.w_grad_t, chunks);
 #endif
 }
 
@@ -652,7 +902,7 @@ void compute_gradients_conv(const dll::batch<T>& input_batch, const dll::batch<T
     }
 
     //Compute gradients
-    batch_compute_gradients_conv<Denoising>(rbm, t);
+    batch_compute_gradients_conv<Denoising>(rbm, t, input_batch.size());
 }
 
 template <bool Persistent, bool Denoising, std::size_t N, typename Trainer, typename T, typename RBM>
@@ -679,7 +929,7 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
 #ifdef ETL_CUDNN_MODE
     t.w_grad = t.w_pos - t.w_neg;
 #else
-    t.w_grad = sum_l(t.w_pos - t.w_neg);
+    t.w_grad = t.w_grad_t(0);
 #endif
 
     t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
@@ -693,7 +943,9 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
     nan_check_deep(t.c_grad);
 
     //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    if (context.measure || layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET) {
+        t.q_global_batch = mean(t.h2_a);
+    }
 
     cpp::static_if<layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET>([&](auto f) {
         f(t).q_local_batch = mean_l(t.h2_a);
@@ -710,9 +962,11 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
     context.batch_sparsity = t.q_global_batch;
 
     //Accumulate the error
-    cpp::static_if<Denoising>([&](auto f) {
-        f(context).batch_error = mean(etl::scale((t.vf - t.v2_a), (t.vf - t.v2_a)));
-    }).else_([&](auto f) { f(context).batch_error = mean(etl::scale((t.v1 - t.v2_a), (t.v1 - t.v2_a))); });
+    if (context.measure) {
+        cpp::static_if<Denoising>([&](auto f) {
+            f(context).batch_error = mean(etl::scale((t.vf - t.v2_a), (t.vf - t.v2_a)));
+        }).else_([&](auto f) { f(context).batch_error = mean(etl::scale((t.v1 - t.v2_a), (t.v1 - t.v2_a))); });
+    }
 
     //Update the weights and biases based on the gradients
     t.update(rbm);
@@ -737,6 +991,11 @@ struct base_cd_trainer : base_trainer<RBM> {
 
     static constexpr const auto batch_size = layer_traits<rbm_t>::batch_size();
 
+    //The number of chains of the negative phase
+    static constexpr const auto chains = Persistent ? layer_traits<rbm_t>::fantasy_particles() : batch_size;
+
+    static_assert(chains == batch_size || !layer_traits<rbm_t>::is_parallel_mode(), "Fantasy particles are only supported in batch mode");
+
     rbm_t& rbm;
 
     etl::fast_matrix<weight, batch_size, num_visible> v1; //Input
@@ -745,16 +1004,16 @@ struct base_cd_trainer : base_trainer<RBM> {
     etl::fast_matrix<weight, batch_size, num_hidden> h1_a;
     etl::fast_matrix<weight, batch_size, num_hidden> h1_s;
 
-    etl::fast_matrix<weight, batch_size, num_visible> v2_a;
-    etl::fast_matrix<weight, batch_size, num_visible> v2_s;
+    etl::fast_matrix<weight, chains, num_visible> v2_a;
+    etl::fast_matrix<weight, chains, num_visible> v2_s;
 
-    etl::fast_matrix<weight, batch_size, num_hidden> h2_a;
-    etl::fast_matrix<weight, batch_size, num_hidden> h2_s;
+    etl::fast_matrix<weight, chains, num_hidden> h2_a;
+    etl::fast_matrix<weight, chains, num_hidden> h2_s;
 
     etl::fast_matrix<weight, batch_size, num_hidden> ht;
     etl::fast_matrix<weight, batch_size, num_visible> vt;
 
-    etl::fast_matrix<weight, batch_size, num_visible, num_hidden> w_grad_b;
+    etl::dyn_matrix<weight, 3> w_grad_t; //Gradients accumulated by each thread
 
     //Gradients
     etl::fast_matrix<weight, num_visible, num_hidden> w_grad;
@@ -779,23 +1038,38 @@ struct base_cd_trainer : base_trainer<RBM> {
 
     //}}} Sparsity end
 
-    etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a;
-    etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s;
+    etl::fast_matrix<weight, chains, rbm_t::num_hidden> p_h_a;
+    etl::fast_matrix<weight, chains, rbm_t::num_hidden> p_h_s;
 
-    cpp::thread_pool<!layer_traits<rbm_t>::is_serial()> pool;
+    //Sparse samples of the batch
+    csr_batch<weight> v1_sparse;
+    csr_batch<weight> vf_sparse;
+
+    //Weights used by the Gibbs steps in mixed precision
+    low_precision_weights<weight, layer_traits<rbm_t>::weight_storage()> w_low;
+
+    //With Hogwild, each thread has its own trainer and the trainers must not
+    //spawn threads of their own
+    cpp::thread_pool<!layer_traits<rbm_t>::is_serial() && !layer_traits<rbm_t>::is_hogwild()> pool;
 
     template <bool M = layer_traits<rbm_t>::has_momentum(), cpp_disable_if(M)>
     base_cd_trainer(rbm_t& rbm)
-            : rbm(rbm), q_global_t(0.0), q_local_t(0.0), pool(etl::threads) {
+            : rbm(rbm), w_grad_t(accumulators(rbm), std::size_t(num_visible), std::size_t(num_hidden)), q_global_t(0.0), q_local_t(0.0), w_low(rbm.w), pool(etl::threads) {
         static_assert(!layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
     }
 
     template <bool M = layer_traits<rbm_t>::has_momentum(), cpp_enable_if(M)>
     base_cd_trainer(rbm_t& rbm)
-            : rbm(rbm), w_inc(0.0), b_inc(0.0), c_inc(0.0), q_global_t(0.0), q_local_t(0.0), pool(etl::threads) {
+            : rbm(rbm), w_grad_t(accumulators(rbm), std::size_t(num_visible), std::size_t(num_hidden)), w_inc(0.0), b_inc(0.0), c_inc(0.0), q_global_t(0.0), q_local_t(0.0), w_low(rbm.w), pool(etl::threads) {
         static_assert(layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
     }
 
+    //The gradients are only accumulated per thread in parallel mode, the
+    //other modes compute w_grad directly and do not need any accumulator
+    static std::size_t accumulators(const rbm_t& rbm) {
+        return layer_traits<rbm_t>::is_parallel_mode() ? gradient_accumulators(rbm) : 0;
+    }
+
     void update(RBM& rbm) {
         update_normal(rbm, *this);
     }
@@ -840,7 +1114,7 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
     etl::dyn_matrix<weight, 2> ht;
     etl::dyn_matrix<weight, 2> vt;
 
-    etl::dyn_matrix<weight, 3> w_grad_b;
+    etl::dyn_matrix<weight, 3> w_grad_t; //Gradients accumulated by each thread
 
     //Gradients
     etl::dyn_matrix<weight> w_grad;
@@ -868,7 +1142,13 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
     etl::dyn_matrix<weight> p_h_a;
     etl::dyn_matrix<weight> p_h_s;
 
-    cpp::thread_pool<!layer_traits<rbm_t>::is_serial()> pool;
+    //Sparse samples of the batch
+    csr_batch<weight> v1_sparse;
+    csr_batch<weight> vf_sparse;
+
+    //With Hogwild, each thread has its own trainer and the trainers must not
+    //spawn threads of their own
+    cpp::thread_pool<!layer_traits<rbm_t>::is_serial() && !layer_traits<rbm_t>::is_hogwild()> pool;
 
     template <bool M = layer_traits<rbm_t>::has_momentum(), cpp_disable_if(M)>
     base_cd_trainer(rbm_t& rbm)
@@ -877,13 +1157,13 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               vf(get_batch_size(rbm), rbm.num_visible),
               h1_a(get_batch_size(rbm), rbm.num_hidden),
               h1_s(get_batch_size(rbm), rbm.num_hidden),
-              v2_a(get_batch_size(rbm), rbm.num_visible),
-              v2_s(get_batch_size(rbm), rbm.num_visible),
-              h2_a(get_batch_size(rbm), rbm.num_hidden),
-              h2_s(get_batch_size(rbm), rbm.num_hidden),
+              v2_a(chains(rbm), rbm.num_visible),
+              v2_s(chains(rbm), rbm.num_visible),
+              h2_a(chains(rbm), rbm.num_hidden),
+              h2_s(chains(rbm), rbm.num_hidden),
               ht(get_batch_size(rbm), rbm.num_hidden),
               vt(get_batch_size(rbm), rbm.num_visible),
-              w_grad_b(get_batch_size(rbm), rbm.num_visible, rbm.num_hidden),
+              w_grad_t(accumulators(rbm), rbm.num_visible, rbm.num_hidden),
               w_grad(rbm.num_visible, rbm.num_hidden),
               b_grad(rbm.num_hidden),
               c_grad(rbm.num_visible),
@@ -893,8 +1173,10 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               q_global_t(0.0),
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
-              p_h_a(get_batch_size(rbm), rbm.num_hidden),
-              p_h_s(get_batch_size(rbm), rbm.num_hidden), pool(etl::threads) {
+              p_h_a(chains(rbm), rbm.num_hidden),
+              p_h_s(chains(rbm), rbm.num_hidden), pool(etl::threads) {
+        cpp_assert(chains(rbm) == get_batch_size(rbm) || !layer_traits<rbm_t>::is_parallel_mode(), "Fantasy particles are only supported in batch mode");
+
         static_assert(!layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
     }
 
@@ -905,13 +1187,13 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               vf(get_batch_size(rbm), rbm.num_visible),
               h1_a(get_batch_size(rbm), rbm.num_hidden),
               h1_s(get_batch_size(rbm), rbm.num_hidden),
-              v2_a(get_batch_size(rbm), rbm.num_visible),
-              v2_s(get_batch_size(rbm), rbm.num_visible),
-              h2_a(get_batch_size(rbm), rbm.num_hidden),
-              h2_s(get_batch_size(rbm), rbm.num_hidden),
+              v2_a(chains(rbm), rbm.num_visible),
+              v2_s(chains(rbm), rbm.num_visible),
+              h2_a(chains(rbm), rbm.num_hidden),
+              h2_s(chains(rbm), rbm.num_hidden),
               ht(get_batch_size(rbm), rbm.num_hidden),
               vt(get_batch_size(rbm), rbm.num_visible),
-              w_grad_b(get_batch_size(rbm), rbm.num_visible, rbm.num_hidden),
+              w_grad_t(accumulators(rbm), rbm.num_visible, rbm.num_hidden),
               w_grad(rbm.num_visible, rbm.num_hidden),
               b_grad(rbm.num_hidden),
               c_grad(rbm.num_visible),
@@ -921,11 +1203,24 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               q_global_t(0.0),
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
-              p_h_a(get_batch_size(rbm), rbm.num_hidden),
-              p_h_s(get_batch_size(rbm), rbm.num_hidden), pool(etl::threads) {
+              p_h_a(chains(rbm), rbm.num_hidden),
+              p_h_s(chains(rbm), rbm.num_hidden), pool(etl::threads) {
+        cpp_assert(chains(rbm) == get_batch_size(rbm) || !layer_traits<rbm_t>::is_parallel_mode(), "Fantasy particles are only supported in batch mode");
+
         static_assert(layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
     }
 
+    //The gradients are only accumulated per thread in parallel mode, the
+    //other modes compute w_grad directly and do not need any accumulator
+    static std::size_t accumulators(const rbm_t& rbm) {
+        return layer_traits<rbm_t>::is_parallel_mode() ? gradient_accumulators(rbm) : 0;
+    }
+
+    //The number of chains of the negative phase
+    static std::size_t chains(const rbm_t& rbm) {
+        return Persistent ? get_fantasy_particles(rbm) : get_batch_size(rbm);
+    }
+
     void update(RBM& rbm) {
         update_normal(rbm, *this);
     }
@@ -1016,8 +1311,9 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
     etl::fast_matrix<weight, W_DIMS> w_pos;
     etl::fast_matrix<weight, W_DIMS> w_neg;
 #else
-    etl::fast_matrix<weight, batch_size, W_DIMS> w_pos;
-    etl::fast_matrix<weight, batch_size, W_DIMS> w_neg;
+    etl::dyn_matrix<weight, 5> w_pos;    //Positive gradients of the current sample of each thread
+    etl::dyn_matrix<weight, 5> w_neg;    //Negative gradients of the current sample of each thread
+    etl::dyn_matrix<weight, 5> w_grad_t; //Gradients accumulated by each thread
 #endif
 
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> v1;                     //Input
@@ -1041,7 +1337,13 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               q_local_t(0.0),
               w_bias(0.0),
               b_bias(0.0),
-              c_bias(0.0), pool(etl::threads) {
+              c_bias(0.0),
+#ifndef ETL_CUDNN_MODE
+              w_pos(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+              w_neg(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+              w_grad_t(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+#endif
+              pool(etl::threads) {
         static_assert(!layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
     }
 
@@ -1055,7 +1357,13 @@ struct base_cd_trainer<N, RBM, Persistent, Denoising, std::enable_if_t<layer_tra
               q_local_t(0.0),
               w_bias(0.0),
               b_bias(0.0),
-              c_bias(0.0), pool(etl::threads) {
+              c_bias(0.0),
+#ifndef ETL_CUDNN_MODE
+              w_pos(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+              w_neg(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+              w_grad_t(gradient_accumulators(rbm), std::size_t(NC), std::size_t(K), std::size_t(NW1), std::size_t(NW2)),
+#endif
+              pool(etl::threads) {
         static_assert(layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
     }
 
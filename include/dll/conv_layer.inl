@@ -14,6 +14,9 @@
 
 #include "neural_base.hpp"
 #include "util/tmp.hpp"
+#include "util/flip_cache.hpp"
+#include "util/conv_engine.hpp"
+#include "util/winograd.hpp"
 #include "layer_traits.hpp"
 
 namespace dll {
@@ -63,6 +66,12 @@ struct conv_layer final : neural_base<conv_layer<Desc>> {
     std::unique_ptr<w_type> bak_w; //!< Backup Weights
     std::unique_ptr<b_type> bak_b; //!< Backup Hidden biases
 
+    flip_cache<w_type> w_f; //!< Cache of the flipped weights
+
+    winograd_cache<winograd_conv<weight, NW1, NW2>> w_t; //!< Cache of the Winograd transforms of the weights (only for 3x3 and 5x5 kernels)
+
+    mutable im2col_scratch<weight> im2col; //!< The memory of the im2col batch convolutions
+
     //No copying
     conv_layer(const conv_layer& layer) = delete;
     conv_layer& operator=(const conv_layer& layer) = delete;
@@ -117,62 +126,95 @@ struct conv_layer final : neural_base<conv_layer<Desc>> {
     void restore_weights() {
         w = *bak_w;
         b = *bak_b;
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Returns the weights with all kernels flipped (see flip_cache)
+     */
+    const w_type& flipped_w() const {
+        return w_f.get(w);
+    }
+
+    /*!
+     * \brief Invalidate the caches of the weights (see flip_cache)
+     */
+    void weights_changed() {
+        w_f.invalidate();
+        w_t.invalidate();
     }
 
     template <typename V>
     void activate_hidden(output_one_t& output, const V& v) const {
         etl::fast_dyn_matrix<weight, 2, K, NH1, NH2> v_cv; //Temporary convolution
+        activate_hidden(output, v, v_cv);
+    }
 
-        auto w_f = etl::force_temporary(w);
-
-        //flip all the kernels horizontally and vertically
-
-        for (std::size_t channel = 0; channel < NC; ++channel) {
-            for (size_t k = 0; k < K; ++k) {
-                w_f(channel)(k).fflip_inplace();
-            }
-        }
-
-        v_cv(1) = 0;
-
-        for (std::size_t channel = 0; channel < NC; ++channel) {
-            etl::conv_2d_valid_multi(v(channel), w_f(channel), v_cv(0));
-
-            v_cv(1) += v_cv(0);
-        }
+    template <typename V, typename VCV>
+    void activate_hidden(output_one_t& output, const V& v, VCV&& v_cv) const {
+        compute_vcv(v, v_cv);
 
         output = f_activate<activation_function>(etl::rep<NH1, NH2>(b) + v_cv(1));
     }
 
     template <typename H1, typename V>
     void batch_activate_hidden(H1&& output, const V& v) const {
-        etl::fast_dyn_matrix<weight, 2, K, NH1, NH2> v_cv; //Temporary convolution
-
         const auto Batch = etl::dim<0>(v);
 
-        auto w_f = force_temporary(w);
+        etl::dyn_matrix<weight, 4> v_cv(Batch, K, NH1, NH2); //Temporary convolution
 
-        //flip all the kernels horizontally and vertically
+        batch_compute_vcv(v, [&](std::size_t batch, std::size_t k) {
+            return v_cv.memory_start() + (batch * K + k) * NH1 * NH2;
+        });
 
-        for (std::size_t channel = 0; channel < NC; ++channel) {
-            for (size_t k = 0; k < K; ++k) {
-                w_f(channel)(k).fflip_inplace();
-            }
-        }
+        auto b_rep = etl::force_temporary(etl::rep<NH1, NH2>(b));
 
         for (std::size_t batch = 0; batch < Batch; ++batch) {
-            v_cv(1) = 0;
+            output(batch) = f_activate<activation_function>(b_rep + v_cv(batch));
+        }
+    }
+
+    /*!
+     * \brief Compute the valid convolutions of a sample with the kernels
+     * into v_cv(1), with the Winograd algorithm for 3x3 and 5x5 kernels.
+     */
+    template <typename V, typename VCV, std::size_t W1 = NW1, cpp_enable_if(winograd_conv<weight, W1, NW2>::enabled)>
+    void compute_vcv(const V& v, VCV&& v_cv) const {
+        winograd_conv<weight, W1, NW2>::apply_transformed(v.memory_start(), 1, NC, NV1, NV2, w_t.get(w), K, [&](std::size_t, std::size_t k) {
+            return v_cv(1)(k).memory_start();
+        });
+    }
+
+    template <typename V, typename VCV, std::size_t W1 = NW1, cpp_disable_if(winograd_conv<weight, W1, NW2>::enabled)>
+    void compute_vcv(const V& v, VCV&& v_cv) const {
+        auto& w_flipped = flipped_w();
 
-            for (std::size_t channel = 0; channel < NC; ++channel) {
-                etl::conv_2d_valid_multi(v(batch)(channel), w_f(channel), v_cv(0));
+        v_cv(1) = 0;
 
-                v_cv(1) += v_cv(0);
-            }
+        for (std::size_t channel = 0; channel < NC; ++channel) {
+            etl::conv_2d_valid_multi(v(channel), w_flipped(channel), v_cv(0));
 
-            output(batch) = f_activate<activation_function>(etl::rep<NH1, NH2>(b) + v_cv(1));
+            v_cv(1) += v_cv(0);
         }
     }
 
+    /*!
+     * \brief Compute the valid convolutions of a batch with the kernels, with
+     * the Winograd algorithm for 3x3 and 5x5 kernels, with a single matrix
+     * multiplication otherwise.
+     * \param output The functor returning the memory of each output
+     */
+    template <typename V, typename Output, std::size_t W1 = NW1, cpp_enable_if(winograd_conv<weight, W1, NW2>::enabled)>
+    void batch_compute_vcv(const V& v, Output&& output) const {
+        winograd_conv<weight, W1, NW2>::apply_transformed(v.memory_start(), etl::dim<0>(v), NC, NV1, NV2, w_t.get(w), K, output);
+    }
+
+    template <typename V, typename Output, std::size_t W1 = NW1, cpp_disable_if(winograd_conv<weight, W1, NW2>::enabled)>
+    void batch_compute_vcv(const V& v, Output&& output) const {
+        batch_conv_valid_im2col(im2col, v, w, output);
+    }
+
     template <typename Input>
     output_one_t prepare_one_output() const {
         return {};
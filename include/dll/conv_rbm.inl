@@ -23,6 +23,8 @@
 #include "util/io.hpp"           //Binary load/store functions
 #include "util/timers.hpp"       //auto_timer
 #include "util/checks.hpp"       //nan_check
+#include "util/flip_cache.hpp"   //flip_cache
+#include "util/fft_conv.hpp"     //spectrum_cache
 #include "rbm_tmp.hpp"           // static_if macros
 
 namespace dll {
@@ -77,6 +79,12 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
     std::unique_ptr<b_type> bak_b; //!< backup hidden biases bk
     std::unique_ptr<c_type> bak_c; //!< backup visible single bias c
 
+    flip_cache<w_type> w_f; //!< Cache of the flipped shared weights
+
+    conditional_spectrum_cache_t<layer_traits<this_type>::is_fft_conv(), weight> w_s{NC, K, NV1, NV2, NH1, NH2}; //!< Cache of the spectra of the shared weights (only with fft_conv)
+
+    mutable im2col_scratch<weight> im2col; //!< The memory of the im2col batch convolutions
+
     etl::fast_matrix<weight, NC, NV1, NV2> v1; //visible units
 
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h1_a; //Activation probabilities of reconstructed hidden units
@@ -147,6 +155,51 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         w = *bak_w;
         b = *bak_b;
         c = *bak_c;
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Returns the weights with all kernels flipped (see flip_cache)
+     */
+    const w_type& flipped_w() const {
+        return w_f.get(w);
+    }
+
+    /*!
+     * \brief Invalidate the caches of the weights (see flip_cache)
+     */
+    void weights_changed() {
+        w_f.invalidate();
+        w_s.invalidate();
+    }
+
+    /*!
+     * \brief Returns the weights used by the valid convolutions of a single
+     * sample: their spectra with fft_conv, the flipped weights otherwise.
+     */
+    template <typename L = this_type, cpp_disable_if(layer_traits<L>::is_fft_conv())>
+    const w_type& valid_weights() const {
+        return flipped_w();
+    }
+
+    template <typename L = this_type, cpp_enable_if(layer_traits<L>::is_fft_conv())>
+    const conv_spectra<weight>& valid_weights() const {
+        return w_s.get(w);
+    }
+
+    /*!
+     * \brief Returns the weights used by the full convolutions and by the
+     * batch convolutions: their spectra with fft_conv, the weights otherwise.
+     */
+    template <typename L = this_type, cpp_disable_if(layer_traits<L>::is_fft_conv())>
+    const w_type& conv_weights() const {
+        return w;
+    }
+
+    template <typename L = this_type, cpp_enable_if(layer_traits<L>::is_fft_conv())>
+    const conv_spectra<weight>& conv_weights() const {
+        return w_s.get(w);
     }
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
@@ -157,7 +210,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s) const {
-        etl::fast_dyn_matrix<weight, H_CV_CHANNELS, NV2, NV2> h_cv; //Temporary convolution
+        etl::fast_dyn_matrix<weight, H_CV_CHANNELS, NV1, NV2> h_cv; //Temporary convolution
         activate_visible<P, S>(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), h_cv);
     }
 
@@ -185,11 +238,11 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
 
         //TODO This is not correct since h_a is already maxed here
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(h_a), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(h_a), 0.0));
 
         cpp_unused(v_cv);
 #else
-        base_type::template compute_vcv<this_type>(v_a, v_cv, w);
+        base_type::template compute_vcv<this_type>(v_a, v_cv, valid_weights());
 
         H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = sigmoid(b_rep + v_cv(1)));
         H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + v_cv(1))));
@@ -197,12 +250,12 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + v_cv(1), 0.0), 6.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + v_cv(1), 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + v_cv(1)), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(b_rep + v_cv(1)), 0.0));
 #endif
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
 
         nan_check_deep(h_a);
 
@@ -233,7 +286,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
         cpp_unused(h_cv);
 #else
-        base_type::template compute_hcv<this_type>(h_s, h_cv, w, [&](std::size_t channel) {
+        base_type::template compute_hcv<this_type>(h_s, h_cv, conv_weights(), [&](std::size_t channel) {
             V_PROBS(unit_type::BINARY, f(v_a)(channel) = sigmoid(c(channel) + h_cv(1)));
             V_PROBS(unit_type::GAUSSIAN, f(v_a)(channel) = c(channel) + h_cv(1));
         });
@@ -241,8 +294,8 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = dll::bernoulli(v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -279,28 +332,28 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         H_PROBS(unit_type::RELU6, f(h_a) = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, f(h_a) = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b_rep + h_a), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(b_rep + h_a), 0.0));
 
         cpp_unused(v_cv);
 #else
         auto b_rep = etl::force_temporary(etl::rep<NH1, NH2>(b));
 
-        base_type::template batch_compute_vcv<this_type>(pool, v_a, v_cv, w, [&](std::size_t batch) {
+        base_type::template batch_compute_vcv<this_type>(pool, im2col, v_a, v_cv, conv_weights(), [&](std::size_t batch) {
             H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a)(batch) = sigmoid(b_rep + v_cv(batch)(1)));
             H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a)(batch) = sigmoid((1.0 / (0.1 * 0.1)) >> (b_rep + v_cv(batch)(1))));
             H_PROBS(unit_type::RELU, f(h_a)(batch) = max(b_rep + v_cv(batch)(1), 0.0));
             H_PROBS(unit_type::RELU6, f(h_a)(batch) = min(max(b_rep + v_cv(batch)(1), 0.0), 6.0));
             H_PROBS(unit_type::RELU1, f(h_a)(batch) = min(max(b_rep + v_cv(batch)(1), 0.0), 1.0));
 
-            H_SAMPLE_PROBS(unit_type::RELU, f(h_s)(batch) = max(logistic_noise(b_rep + v_cv(batch)(1)), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU, f(h_s)(batch) = max(dll::logistic_noise(b_rep + v_cv(batch)(1)), 0.0));
         });
 #endif
 
         nan_check_deep(h_a);
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
 
         if (S) {
             nan_check_deep(h_s);
@@ -334,7 +387,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
         cpp_unused(h_cv);
 #else
-        base_type::template batch_compute_hcv<this_type>(pool, h_s, h_cv, w, [&](std::size_t batch, std::size_t channel) {
+        base_type::template batch_compute_hcv<this_type>(pool, h_s, h_cv, conv_weights(), [&](std::size_t batch, std::size_t channel) {
             V_PROBS(unit_type::BINARY, f(v_a)(batch)(channel) = etl::sigmoid(c(channel) + h_cv(batch)(1)));
             V_PROBS(unit_type::GAUSSIAN, f(v_a)(batch)(channel) = c(channel) + h_cv(batch)(1));
         });
@@ -342,8 +395,8 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = dll::bernoulli(v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -364,14 +417,14 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
             //Definition according to Honglak Lee
             //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - c sum_v v
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             return -etl::sum(c >> etl::sum_r(v)) - etl::sum(b >> etl::sum_r(h)) - etl::sum(h >> v_cv(1));
         } else if (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee / Mixed with Gaussian
             //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - sum_v ((v - c) ^ 2 / 2)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             return -sum(etl::pow(v - etl::rep<NV1, NV2>(c), 2) / 2.0) - etl::sum(b >> etl::sum_r(h)) - etl::sum(h >> v_cv(1));
         } else {
@@ -406,7 +459,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         if (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             auto x = etl::rep<NH1, NH2>(b) + v_cv(1);
 
@@ -414,7 +467,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         } else if (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             auto x = etl::rep<NH1, NH2>(b) + v_cv(1);
 
@@ -436,6 +489,47 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         return free_energy_impl(v1);
     }
 
+    /*!
+     * \brief Returns the sum of the free energies of the first n samples of
+     * the given batch. The convolutions of the batch are computed at once.
+     */
+    template <typename V>
+    weight batch_free_energy(const V& v, std::size_t n) const {
+        dll::auto_timer timer("crbm:batch_free_energy");
+
+        static constexpr const auto Batch = layer_traits<this_type>::batch_size();
+
+        cpp_assert(n <= Batch, "Invalid number of samples");
+
+#ifdef ETL_CUDNN_MODE
+        cpp_unused(v);
+        std::cerr << "Free energy is not supported in CUDNN mode" << std::endl;
+        return 0.0;
+#else
+        if (desc::hidden_unit != unit_type::BINARY || (desc::visible_unit != unit_type::BINARY && desc::visible_unit != unit_type::GAUSSIAN)) {
+            return 0.0;
+        }
+
+        etl::fast_dyn_matrix<weight, Batch, V_CV_CHANNELS, K, NH1, NH2> v_cv; //Temporary convolution
+
+        base_type::template batch_compute_vcv<this_type>(pool, im2col, v, v_cv, conv_weights(), [](std::size_t) {});
+
+        auto b_rep = etl::force_temporary(etl::rep<NH1, NH2>(b));
+
+        weight energy = 0.0;
+
+        for (std::size_t batch = 0; batch < n; ++batch) {
+            if (desc::visible_unit == unit_type::BINARY) {
+                energy += -etl::sum(c >> etl::sum_r(v(batch))) - etl::sum(etl::log(1.0 + etl::exp(b_rep + v_cv(batch)(1))));
+            } else {
+                energy += -etl::sum(etl::pow(v(batch) - etl::rep<NV1, NV2>(c), 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(b_rep + v_cv(batch)(1))));
+            }
+        }
+
+        return energy;
+#endif
+    }
+
     //Utilities for DBNs
 
     //TODO These should really all be renamed...
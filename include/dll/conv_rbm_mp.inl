@@ -23,6 +23,8 @@
 #include "util/io.hpp"           //Binary load/store functions
 #include "util/timers.hpp"       //auto_timer
 #include "util/checks.hpp"       //nan_check
+#include "util/flip_cache.hpp"   //flip_cache
+#include "util/fft_conv.hpp"     //spectrum_cache
 #include "rbm_tmp.hpp"           // static_if macros
 
 namespace dll {
@@ -71,6 +73,12 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
     std::unique_ptr<b_type> bak_b; //!< backup hidden biases bk
     std::unique_ptr<c_type> bak_c; //!< backup visible single bias c
 
+    flip_cache<w_type> w_f; //!< Cache of the flipped shared weights
+
+    conditional_spectrum_cache_t<layer_traits<this_type>::is_fft_conv(), weight> w_s{NC, K, NV1, NV2, NH1, NH2}; //!< Cache of the spectra of the shared weights (only with fft_conv)
+
+    mutable im2col_scratch<weight> im2col; //!< The memory of the im2col batch convolutions
+
     etl::fast_matrix<weight, NC, NV1, NV2> v1; //visible units
 
     conditional_fast_matrix_t<!dbn_only, weight, K, NH1, NH2> h1_a; //Activation probabilities of reconstructed hidden units
@@ -139,6 +147,51 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         w = *bak_w;
         b = *bak_b;
         c = *bak_c;
+
+        weights_changed();
+    }
+
+    /*!
+     * \brief Returns the weights with all kernels flipped (see flip_cache)
+     */
+    const w_type& flipped_w() const {
+        return w_f.get(w);
+    }
+
+    /*!
+     * \brief Invalidate the caches of the weights (see flip_cache)
+     */
+    void weights_changed() {
+        w_f.invalidate();
+        w_s.invalidate();
+    }
+
+    /*!
+     * \brief Returns the weights used by the valid convolutions of a single
+     * sample: their spectra with fft_conv, the flipped weights otherwise.
+     */
+    template <typename L = this_type, cpp_disable_if(layer_traits<L>::is_fft_conv())>
+    const w_type& valid_weights() const {
+        return flipped_w();
+    }
+
+    template <typename L = this_type, cpp_enable_if(layer_traits<L>::is_fft_conv())>
+    const conv_spectra<weight>& valid_weights() const {
+        return w_s.get(w);
+    }
+
+    /*!
+     * \brief Returns the weights used by the full convolutions and by the
+     * batch convolutions: their spectra with fft_conv, the weights otherwise.
+     */
+    template <typename L = this_type, cpp_disable_if(layer_traits<L>::is_fft_conv())>
+    const w_type& conv_weights() const {
+        return w;
+    }
+
+    template <typename L = this_type, cpp_enable_if(layer_traits<L>::is_fft_conv())>
+    const conv_spectra<weight>& conv_weights() const {
+        return w_s.get(w);
     }
 
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
@@ -160,7 +213,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         static_assert(hidden_unit == unit_type::BINARY || is_relu(hidden_unit), "Invalid hidden unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        base_type::template compute_vcv<this_type>(v_a, v_cv, w);
+        base_type::template compute_vcv<this_type>(v_a, v_cv, valid_weights());
 
         H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a) = etl::p_max_pool_h<C, C>(etl::rep<NH1, NH2>(b) + v_cv(1)));
         H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a) = etl::p_max_pool_h<C, C>((1.0 / (0.1 * 0.1)) >> (etl::rep<NH1, NH2>(b) + v_cv(1))));
@@ -168,10 +221,10 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         H_PROBS(unit_type::RELU6, f(h_a) = f(h_a) = min(max(etl::rep<NH1, NH2>(b) + v_cv(1), 0.0), 6.0));
         H_PROBS(unit_type::RELU1, f(h_a) = f(h_a) = min(max(etl::rep<NH1, NH2>(b) + v_cv(1), 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(etl::rep<NH1, NH2>(b) + v_cv(1)), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(etl::rep<NH1, NH2>(b) + v_cv(1)), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
 
         nan_check_etl(h_a);
 
@@ -189,13 +242,13 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
         using namespace etl;
 
-        base_type::template compute_hcv<this_type>(h_s, h_cv, w, [&](std::size_t channel) {
+        base_type::template compute_hcv<this_type>(h_s, h_cv, conv_weights(), [&](std::size_t channel) {
             V_PROBS(unit_type::BINARY, f(v_a)(channel) = sigmoid(c(channel) + h_cv(1)));
             V_PROBS(unit_type::GAUSSIAN, f(v_a)(channel) = c(channel) + h_cv(1));
         });
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = dll::bernoulli(v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(v_a));
 
         nan_check_etl(v_a);
 
@@ -213,7 +266,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
         etl::fast_dyn_matrix<weight, 2, K, NH1, NH2> v_cv; //Temporary convolution
 
-        base_type::template compute_vcv<this_type>(v_a, v_cv, w);
+        base_type::template compute_vcv<this_type>(v_a, v_cv, valid_weights());
 
         if (pooling_unit == unit_type::BINARY) {
             p_a = etl::p_max_pool_p<C, C>(etl::rep<NH1, NH2>(b) + v_cv(1));
@@ -223,7 +276,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
         if (S) {
             if (pooling_unit == unit_type::BINARY) {
-                p_s = r_bernoulli(p_a);
+                p_s = dll::r_bernoulli(p_a);
             }
 
             nan_check_etl(p_s);
@@ -244,19 +297,19 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         cpp_assert(etl::dim<0>(v_cv) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        base_type::template batch_compute_vcv<this_type>(pool, v_a, v_cv, w, [&](std::size_t batch) {
+        base_type::template batch_compute_vcv<this_type>(pool, im2col, v_a, v_cv, conv_weights(), [&](std::size_t batch) {
             H_PROBS2(unit_type::BINARY, unit_type::BINARY, f(h_a)(batch) = etl::p_max_pool_h<C, C>(etl::rep<NH1, NH2>(b) + v_cv(batch)(1)));
             H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, f(h_a)(batch) = etl::p_max_pool_h<C, C>((1.0 / (0.1 * 0.1)) >> (etl::rep<NH1, NH2>(b) + v_cv(batch)(1))));
             H_PROBS(unit_type::RELU, f(h_a)(batch) = max(etl::rep<NH1, NH2>(b) + v_cv(batch)(1), 0.0));
             H_PROBS(unit_type::RELU6, f(h_a)(batch) = min(max(etl::rep<NH1, NH2>(b) + v_cv(batch)(1), 0.0), 6.0));
             H_PROBS(unit_type::RELU1, f(h_a)(batch) = min(max(etl::rep<NH1, NH2>(b) + v_cv(batch)(1), 0.0), 1.0));
 
-            H_SAMPLE_PROBS(unit_type::RELU, f(h_s)(batch) = max(logistic_noise(etl::rep<NH1, NH2>(b) + v_cv(batch)(1)), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU, f(h_s)(batch) = max(dll::logistic_noise(etl::rep<NH1, NH2>(b) + v_cv(batch)(1)), 0.0));
         });
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
 
         nan_check_deep(h_a);
 
@@ -280,13 +333,13 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         cpp_assert(etl::dim<0>(h_cv) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        base_type::template batch_compute_hcv<this_type>(pool, h_s, h_cv, w, [&](std::size_t batch, std::size_t channel) {
+        base_type::template batch_compute_hcv<this_type>(pool, h_s, h_cv, conv_weights(), [&](std::size_t batch, std::size_t channel) {
             V_PROBS(unit_type::BINARY, f(v_a)(batch)(channel) = etl::sigmoid(c(channel) + h_cv(batch)(1)));
             V_PROBS(unit_type::GAUSSIAN, f(v_a)(batch)(channel) = c(channel) + h_cv(batch)(1));
         });
 
-        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, f(v_s) = dll::bernoulli(v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(v_a));
 
         nan_check_deep(v_a);
 
@@ -303,14 +356,14 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
             //Definition according to Honglak Lee
             //E(v,h) = - sum_k (hk (Wk*v) + bk hk) - c sum_v v
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             return -etl::sum(c >> etl::sum_r(v)) - etl::sum((h >> v_cv(1)) + (etl::rep<NH1, NH2>(b) >> h));
         } else if (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition according to Honglak Lee / Mixed with Gaussian
             //E(v,h) = - sum_k (hk (Wk*v) + bk hk) - sum_v ((v - c) ^ 2 / 2)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             return -sum(etl::pow(v - etl::rep<NV1, NV2>(c), 2) / 2.0) - etl::sum((h >> v_cv(1)) + (etl::rep<NH1, NH2>(b) >> h));
         } else {
@@ -333,7 +386,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         if (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             auto x = etl::rep<NH1, NH2>(b) + v_cv(1);
 
@@ -341,7 +394,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         } else if (desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY) {
             //Definition computed from E(v,h)
 
-            base_type::template compute_vcv<this_type>(v, v_cv, w);
+            base_type::template compute_vcv<this_type>(v, v_cv, valid_weights());
 
             auto x = etl::rep<NH1, NH2>(b) + v_cv(1);
 
@@ -361,6 +414,47 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         return free_energy_impl(v1);
     }
 
+    /*!
+     * \brief Returns the sum of the free energies of the first n samples of
+     * the given batch. The convolutions of the batch are computed at once.
+     */
+    template <typename V>
+    weight batch_free_energy(const V& v, std::size_t n) const {
+        dll::auto_timer timer("crbm:batch_free_energy");
+
+        static constexpr const auto Batch = layer_traits<this_type>::batch_size();
+
+        cpp_assert(n <= Batch, "Invalid number of samples");
+
+#ifdef ETL_CUDNN_MODE
+        cpp_unused(v);
+        std::cerr << "Free energy is not supported in CUDNN mode" << std::endl;
+        return 0.0;
+#else
+        if (desc::hidden_unit != unit_type::BINARY || (desc::visible_unit != unit_type::BINARY && desc::visible_unit != unit_type::GAUSSIAN)) {
+            return 0.0;
+        }
+
+        etl::fast_dyn_matrix<weight, Batch, 2, K, NH1, NH2> v_cv; //Temporary convolution
+
+        base_type::template batch_compute_vcv<this_type>(pool, im2col, v, v_cv, conv_weights(), [](std::size_t) {});
+
+        auto b_rep = etl::force_temporary(etl::rep<NH1, NH2>(b));
+
+        weight energy = 0.0;
+
+        for (std::size_t batch = 0; batch < n; ++batch) {
+            if (desc::visible_unit == unit_type::BINARY) {
+                energy += -etl::sum(c >> etl::sum_r(v(batch))) - etl::sum(etl::log(1.0 + etl::exp(b_rep + v_cv(batch)(1))));
+            } else {
+                energy += -etl::sum(etl::pow(v(batch) - etl::rep<NV1, NV2>(c), 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(b_rep + v_cv(batch)(1))));
+            }
+        }
+
+        return energy;
+#endif
+    }
+
     //Utilities for DBNs
 
     using input_one_t   = etl::fast_dyn_matrix<weight, NC, NV1, NV2>;
@@ -16,6 +16,11 @@
 
 #pragma once
 
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
 #include "cpp_utils/static_if.hpp"
 
 #include "unit_type.hpp"
@@ -24,8 +29,15 @@
 #include "dbn_common.hpp"
 #include "svm_common.hpp"
 #include "util/flatten.hpp"
+#include "util/compact.hpp"
 #include "util/export.hpp"
+#include "util/feature_store.hpp"
+#include "util/permutation.hpp"
+#include "util/pipeline.hpp"
+#include "util/random.hpp"
 #include "util/timers.hpp"
+#include "frozen_dbn.hpp"
+#include "quantized_dbn.hpp"
 #include "dbn_detail.hpp" //dbn_detail namespace
 
 namespace dll {
@@ -40,8 +52,9 @@ struct dbn final {
 
     using layers_t = typename desc::layers; ///< The layers container type
 
-    static_assert(!(dbn_traits<this_type>::batch_mode() && layers_t::has_shuffle_layer), "batch_mode dbn does not support shuffle in layers");
     static_assert(!dbn_traits<this_type>::shuffle() || dbn_traits<this_type>::batch_mode(), "shufle is only compatible with batch mode, for normal mode, use shuffle in layers");
+    static_assert(!dbn_traits<this_type>::activation_cache() || dbn_traits<this_type>::batch_mode(), "activation_cache is only compatible with batch mode");
+    static_assert(!dbn_traits<this_type>::activation_cache() || !dbn_traits<this_type>::is_multiplex(), "activation_cache is not compatible with multiplex layers");
 
     template <std::size_t N>
     using layer_type = detail::layer_type_t<N, layers_t>; ///< The type of the layer at index Nth
@@ -63,10 +76,66 @@ private:
         using output_t = std::decay_t<decltype(std::declval<layer_type<0>>().template prepare_one_output<input_t>())>;
     };
 
+    template <typename Input, typename Sequence>
+    struct inference_storage;
+
+    template <typename Input, std::size_t... I>
+    struct inference_storage<Input, std::index_sequence<I...>> {
+        using outputs_t = std::tuple<typename types_helper<I, Input>::output_t...>;
+        using scratch_t = std::tuple<typename dbn_detail::inference_scratch<layer_type<I>>::type...>;
+    };
+
 public:
+    /*!
+     * \brief Preallocated storage for the forward pass of one sample of type
+     * Input through the network.
+     *
+     * The output of each layer and the scratch memory of the layers are
+     * allocated once, at construction, and are reused by each call to
+     * predict(context, sample) and activation_probabilities(context, sample).
+     *
+     * A context must not be used by several threads at the same time.
+     */
+    template <typename Input>
+    struct inference_context {
+        using input_t = std::decay_t<Input>; ///< The type of input of the network
+
+        template <std::size_t I>
+        using output_t = typename types_helper<I, input_t>::output_t; ///< The type of output of the Ith layer
+
+        /*!
+         * \brief Allocate all the buffers for the given network
+         */
+        explicit inference_context(const this_type& dbn)
+                : inference_context(dbn, std::make_index_sequence<layers_t::size>()) {}
+
+        /*!
+         * \brief Returns the output of the Ith layer for the last propagated sample
+         */
+        template <std::size_t I>
+        const output_t<I>& output() const {
+            return std::get<I>(outputs);
+        }
+
+    private:
+        template <std::size_t... I>
+        inference_context(const this_type& dbn, std::index_sequence<I...>)
+                : outputs(dbn.template prepare_output<I, input_t>()...) {}
+
+        using storage_t = inference_storage<input_t, std::make_index_sequence<layers_t::size>>;
+
+        typename storage_t::outputs_t outputs; ///< The output of each layer
+        typename storage_t::scratch_t scratch; ///< The scratch memory of each layer
+
+        friend this_type;
+    };
+
     template <std::size_t B>
     using input_batch_t = typename dbn_detail::layer_input_batch<this_type, 0>::template type<B>; ///< The input batch type of the network for a batch size of B
 
+    template <std::size_t B>
+    using output_batch_t = typename dbn_detail::layer_output_batch<this_type, layers_t::size - 1>::template type<B>; ///< The output batch type of the network for a batch size of B
+
     using full_output_t = etl::dyn_vector<weight>; ///< The type of output for concatenated activation probabilities
 
     using for_each_impl_t      = dbn_detail::for_each_impl<this_type, std::make_index_sequence<layers_t::size>>;
@@ -98,6 +167,8 @@ public:
 
     bool batch_mode_run = false;
 
+    std::string activation_cache_directory = "."; ///< The directory of the scratch files of the activation cache
+
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
     svm::model svm_model;    ///< The learned model
@@ -110,6 +181,8 @@ private:
 
     mutable int fake_resource; ///< Simple field to get a reference from for resource management
 
+    std::string activation_cache_file; ///< The scratch file holding the inputs of the next pretrained layer
+
 public:
     /*!
      * Constructs a DBN and initializes all its members.
@@ -120,6 +193,14 @@ public:
         //Nothing else to init
     }
 
+    /*!
+     * \brief Returns the thread pool of the network, shared by the parallel
+     * evaluations to avoid creating threads at each epoch.
+     */
+    cpp::thread_pool<!dbn_traits<this_type>::is_serial()>& get_pool() {
+        return pool;
+    }
+
     //No copying
     dbn(const dbn& dbn) = delete;
     dbn& operator=(const dbn& dbn) = delete;
@@ -301,29 +382,32 @@ public:
      * \param max_epochs The maximum number of epochs for pretraining.
      *
      * \tparam Iterator the type of iterator
+     *
+     * \return true if the pretraining succeeded, false if the activation
+     * cache could not be written or read
      */
     template <typename Iterator>
-    void pretrain(Iterator first, Iterator last, std::size_t max_epochs) {
+    bool pretrain(Iterator first, Iterator last, std::size_t max_epochs) {
         dll::auto_timer timer("dbn:pretrain");
 
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
 
+        bool result = true;
+
         //Pretrain each layer one-by-one
         if (batch_mode()) {
             std::cout << "DBN: Pretraining done in batch mode" << std::endl;
 
-            if (layers_t::has_shuffle_layer) {
-                std::cout << "warning: batch_mode dbn does not support shuffle in layers (will be ignored)";
-            }
-
-            pretrain_layer_batch<0>(first, last, watcher, max_epochs);
+            result = pretrain_layer_batch<0>(first, last, watcher, max_epochs);
         } else {
             pretrain_layer<0>(first, last, watcher, max_epochs, fake_resource);
         }
 
         watcher.pretraining_end(*this);
+
+        return result;
     }
 
     /*!
@@ -331,8 +415,57 @@ public:
      * manner.
      */
     template <typename Samples>
-    void pretrain(const Samples& training_data, std::size_t max_epochs) {
-        pretrain(training_data.begin(), training_data.end(), max_epochs);
+    bool pretrain(const Samples& training_data, std::size_t max_epochs) {
+        return pretrain(training_data.begin(), training_data.end(), max_epochs);
+    }
+
+    /*!
+     * \brief Pretrain the network by training all layers in an unsupervised
+     * manner, choosing how the inputs of each layer are computed from their
+     * size.
+     *
+     * The inputs of a layer are propagated once and kept in memory if they fit
+     * in the budget. Otherwise, they are stored in a scratch file of
+     * activation_cache_directory when the layer is trained for several
+     * epochs, or propagated again by big batches at each epoch. The inputs
+     * are always propagated from the nearest stored inputs (the cache or the
+     * inputs of a lower layer kept in memory) rather than from the samples.
+     * The inputs are shuffled before each epoch if the network or the layer
+     * has the shuffle option.
+     *
+     * \param first Iterator to the first element of the sequence
+     * \param last Iterator to the last element of the sequence
+     * \param max_epochs The maximum number of epochs for pretraining.
+     * \param memory_budget_bytes The maximum size, in bytes, of the inputs of a layer kept in memory
+     *
+     * \return true if the pretraining succeeded, false if the activation
+     * cache could not be written or read
+     */
+    template <typename Iterator>
+    bool pretrain(Iterator first, Iterator last, std::size_t max_epochs, std::size_t memory_budget_bytes) {
+        static_assert(!dbn_traits<this_type>::is_multiplex(), "Pretraining under a memory budget is not compatible with multiplex layers");
+
+        dll::auto_timer timer("dbn:pretrain:budget");
+
+        watcher_t watcher;
+
+        watcher.pretraining_begin(*this, max_epochs);
+
+        auto result = pretrain_layer_budget<0, 0>(first, last, watcher, max_epochs, memory_budget_bytes, fake_resource);
+
+        watcher.pretraining_end(*this);
+
+        return result;
+    }
+
+    /*!
+     * \brief Pretrain the network by training all layers in an unsupervised
+     * manner, choosing how the inputs of each layer are computed from their
+     * size.
+     */
+    template <typename Samples>
+    bool pretrain(const Samples& training_data, std::size_t max_epochs, std::size_t memory_budget_bytes) {
+        return pretrain(training_data.begin(), training_data.end(), max_epochs, memory_budget_bytes);
     }
 
     /*!
@@ -466,6 +599,75 @@ public:
         }
     }
 
+    /*!
+     * \brief Computes the features of a sequence of samples and saves them in
+     * a single binary file, readable with a feature_store.
+     *
+     * The features are computed in parallel, by batches, before being
+     * written. They are the same features as the ones given to the SVM: the
+     * concatenated activations of all the layers if the network is in
+     * svm_concatenate mode, the activations of the last layer otherwise.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param path The path of the output file
+     * \return true if the file has been correctly written, false otherwise
+     */
+    template <typename Iterator>
+    bool export_features(Iterator first, Iterator last, const std::string& path) {
+        static_assert(!dbn_traits<this_type>::is_multiplex(), "Multiplex DBN does not support export_features");
+
+        using sample_t     = etl::value_t<Iterator>;
+        using output_one_t = decltype(prepare_feature_output<sample_t>());
+
+        feature_writer<weight> writer(path, etl::size(prepare_feature_output<sample_t>()));
+
+        //Each block of samples is computed in parallel before being written
+
+        const std::size_t block = 4 * batch_size * std::max(std::size_t(etl::threads), std::size_t(1));
+
+        std::vector<output_one_t> outputs;
+        outputs.reserve(block);
+
+        for (std::size_t i = 0; i < block; ++i) {
+            outputs.push_back(prepare_feature_output<sample_t>());
+        }
+
+        while (first != last) {
+            const std::size_t n       = std::min(block, std::size_t(std::distance(first, last)));
+            const std::size_t batches = (n + batch_size - 1) / batch_size;
+
+            maybe_parallel_foreach_n(pool, 0, batches, [&](std::size_t b) {
+                const std::size_t begin = b * batch_size;
+                const std::size_t end   = std::min(begin + batch_size, n);
+
+                this->export_batch(std::next(first, begin), std::next(first, end), outputs.begin() + begin);
+            });
+
+            for (std::size_t i = 0; i < n; ++i) {
+                writer.write(outputs[i]);
+            }
+
+            std::advance(first, n);
+        }
+
+        writer.close();
+
+        return writer.good();
+    }
+
+    /*!
+     * \brief Computes the features of all the given samples and saves them in
+     * a single binary file, readable with a feature_store.
+     * \param samples The samples
+     * \param path The path of the output file
+     * \return true if the file has been correctly written, false otherwise
+     */
+    template <typename Samples>
+    bool export_features(const Samples& samples, const std::string& path) {
+        return export_features(samples.begin(), samples.end(), path);
+    }
+
     template <typename Input, typename DBN = this_type, cpp_enable_if(dbn_traits<DBN>::concatenate())>
     auto get_final_activation_probabilities(const Input& sample) const {
         return full_activation_probabilities(sample);
@@ -487,6 +689,146 @@ public:
         return predict_label(result);
     }
 
+    /*!
+     * \brief Creates an inference context for samples of type Input
+     */
+    template <typename Input>
+    inference_context<Input> make_inference_context() const {
+        return inference_context<Input>(*this);
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for the
+     * given sample, using only the preallocated buffers of the context.
+     * \param context The inference context
+     * \param sample The sample
+     * \return A reference to the output of the last layer, in the context
+     */
+    template <typename Input, typename Sample>
+    const auto& activation_probabilities(inference_context<Input>& context, const Sample& sample) const {
+        static_assert(!dbn_traits<this_type>::is_multiplex(), "Multiplex DBN does not support inference context");
+
+        inference_impl<0>(context, sample);
+
+        return std::get<layers - 1>(context.outputs);
+    }
+
+    /*!
+     * \brief Predict the label of the given sample, using only the
+     * preallocated buffers of the context.
+     * \param context The inference context
+     * \param sample The sample
+     * \return The predicted label
+     */
+    template <typename Input, typename Sample>
+    size_t predict(inference_context<Input>& context, const Sample& sample) const {
+        return predict_label(activation_probabilities(context, sample));
+    }
+
+    /*!
+     * \brief Returns an inference-only copy of the network, holding only the
+     * weights of the layers.
+     *
+     * The frozen network is not updated when this network is trained again.
+     */
+    frozen_dbn<this_type> freeze() const {
+        return frozen_dbn<this_type>(*this);
+    }
+
+    /*!
+     * \brief Returns an inference-only copy of the network with its weights
+     * quantized to 8-bit integers.
+     * \param first Iterator to the first calibration sample
+     * \param last Iterator to the last calibration sample
+     */
+    template <typename Iterator>
+    quantized_dbn<this_type> quantize(Iterator first, Iterator last) const {
+        return quantized_dbn<this_type>(*this, first, last);
+    }
+
+    /*!
+     * \brief Returns an inference-only copy of the network with its weights
+     * quantized to 8-bit integers.
+     * \param samples The calibration samples
+     */
+    template <typename Samples>
+    quantized_dbn<this_type> quantize(const Samples& samples) const {
+        return quantize(samples.begin(), samples.end());
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for a
+     * sequence of samples, using the batch kernels of the layers.
+     *
+     * The samples are propagated in chunks of B samples at once. Each output
+     * container must already have the correct size (see prepare_one_output).
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output container
+     * \tparam B The number of samples propagated at once
+     */
+    template <std::size_t B = batch_size, typename Iterator, typename OutputIterator>
+    void activation_probabilities_batch(Iterator first, Iterator last, OutputIterator out) const {
+        batch_activation_probabilities_impl<B>(first, last, [&out](auto&& output) {
+            *out = output;
+            ++out;
+        });
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for all
+     * the given samples, using the batch kernels of the layers.
+     * \param samples The samples to propagate
+     * \tparam B The number of samples propagated at once
+     * \return A vector with the activation probabilities of each sample
+     */
+    template <std::size_t B = batch_size, typename Samples>
+    auto activation_probabilities_batch(const Samples& samples) const {
+        using output_one_t = decltype(prepare_one_output<etl::value_t<Samples>>());
+
+        std::vector<output_one_t> outputs;
+        outputs.reserve(samples.size());
+
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            outputs.push_back(prepare_one_output<etl::value_t<Samples>>());
+        }
+
+        activation_probabilities_batch<B>(samples.begin(), samples.end(), outputs.begin());
+
+        return outputs;
+    }
+
+    /*!
+     * \brief Predict the labels of a sequence of samples, using the batch
+     * kernels of the layers.
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output label
+     * \tparam B The number of samples propagated at once
+     */
+    template <std::size_t B = batch_size, typename Iterator, typename OutputIterator>
+    void predict_batch(Iterator first, Iterator last, OutputIterator out) const {
+        batch_activation_probabilities_impl<B>(first, last, [this, &out](auto&& output) {
+            *out = this->predict_label(output);
+            ++out;
+        });
+    }
+
+    /*!
+     * \brief Predict the labels of all the given samples, using the batch
+     * kernels of the layers.
+     * \param samples The samples to classify
+     * \tparam B The number of samples propagated at once
+     * \return A vector with the predicted label of each sample
+     */
+    template <std::size_t B = batch_size, typename Samples>
+    std::vector<std::size_t> predict_batch(const Samples& samples) const {
+        std::vector<std::size_t> labels(samples.size());
+        predict_batch<B>(samples.begin(), samples.end(), labels.begin());
+        return labels;
+    }
+
     /*!
      * \brief Fine tune the network for classifcation.
      * \param training_data A container containing all the samples
@@ -825,6 +1167,36 @@ public:
         return true;
     }
 
+    /*!
+     * \brief Train the SVM on features exported with export_features.
+     * \param features The stored features
+     * \param labels The labels of the features
+     * \param parameters The SVM parameters
+     */
+    template <typename Labels>
+    bool svm_train(const feature_store<weight>& features, const Labels& labels, const svm_parameter& parameters = default_svm_parameters()) {
+        cpp::stop_watch<std::chrono::seconds> watch;
+
+        problem = svm::make_problem(labels.begin(), labels.end(), features.begin(), features.end(), dbn_traits<this_type>::scale());
+
+        //Make libsvm quiet
+        svm::make_quiet();
+
+        //Make sure parameters are not messed up
+        if (!svm::check(problem, parameters)) {
+            return false;
+        }
+
+        //Train the SVM
+        svm_model = svm::train(problem, parameters);
+
+        svm_loaded = true;
+
+        std::cout << "SVM training took " << watch.elapsed() << "s" << std::endl;
+
+        return true;
+    }
+
     template <typename Input>
     double svm_predict(const Input& sample) {
         auto features = get_final_activation_probabilities(sample);
@@ -834,6 +1206,35 @@ public:
 #endif //DLL_SVM_SUPPORT
 
 private:
+    template <typename Input, typename DBN = this_type, cpp_enable_if(dbn_traits<DBN>::concatenate())>
+    full_output_t prepare_feature_output() const {
+        return full_output_t(full_output_size());
+    }
+
+    template <typename Input, typename DBN = this_type, cpp_disable_if(dbn_traits<DBN>::concatenate())>
+    auto prepare_feature_output() const {
+        return prepare_one_output<Input>();
+    }
+
+    template <typename Iterator, typename OutputIterator, typename DBN = this_type, cpp_enable_if(!dbn_traits<DBN>::is_dynamic() && !dbn_traits<DBN>::concatenate())>
+    void export_batch(Iterator first, Iterator last, OutputIterator out) const {
+        activation_probabilities_batch<batch_size>(first, last, out);
+    }
+
+    template <typename Iterator, typename OutputIterator, typename DBN = this_type, cpp_enable_if(dbn_traits<DBN>::is_dynamic() && !dbn_traits<DBN>::concatenate())>
+    void export_batch(Iterator first, Iterator last, OutputIterator out) const {
+        for (; first != last; ++first, ++out) {
+            *out = activation_probabilities(*first);
+        }
+    }
+
+    template <typename Iterator, typename OutputIterator, typename DBN = this_type, cpp_enable_if(dbn_traits<DBN>::concatenate())>
+    void export_batch(Iterator first, Iterator last, OutputIterator out) const {
+        for (; first != last; ++first, ++out) {
+            full_activation_probabilities(*first, *out);
+        }
+    }
+
     static void release(int&) {}
 
     template <typename T>
@@ -870,7 +1271,7 @@ private:
         maybe_parallel_foreach_i(pool, first, last, [&layer, &next_layer, &next_a](auto& v, std::size_t i) {
             auto tmp = layer.template prepare_one_output<input_t>();
 
-            layer.activate_hidden(tmp, v);
+            layer.activate_hidden(tmp, widen_input(v));
             next_layer.activate_hidden(next_a[i], tmp);
         });
 
@@ -879,6 +1280,61 @@ private:
         pretrain_layer<I + 2>(next_a.begin(), next_a.end(), watcher, max_epochs, next_a);
     }
 
+    //The outputs of the layer I are probabilities
+    template <std::size_t I, typename Enable = void>
+    struct probability_output : std::false_type {};
+
+    template <std::size_t I>
+    struct probability_output<I, std::enable_if_t<layer_traits<layer_type<I>>::is_standard_rbm_layer()>>
+            : cpp::bool_constant<layer_type<I>::hidden_unit == unit_type::BINARY || layer_type<I>::hidden_unit == unit_type::SOFTMAX> {};
+
+    //The outputs of the layer I are stored in compact form for the next layer
+    template <std::size_t I, typename Enable = void>
+    struct compact_next : std::false_type {};
+
+    template <std::size_t I>
+    struct compact_next<I, std::enable_if_t<(I + 1 < layers)>>
+            : cpp::bool_constant<
+                  dbn_traits<this_type>::activation_storage() != storage_type::NATIVE
+                  && layer_traits<layer_type<I>>::is_standard_rbm_layer()
+                  && layer_traits<layer_type<I + 1>>::is_standard_rbm_layer()
+                  && (dbn_traits<this_type>::activation_storage() != storage_type::UINT8 || probability_output<I>::value)> {};
+
+    //Compute the outputs of the layer I for the complete dataset
+    template <std::size_t I, typename Iterator, cpp_disable_if(compact_next<I>::value)>
+    auto propagate_next(Iterator first, Iterator last) {
+        decltype(auto) layer = layer_get<I>();
+
+        auto next_a = layer.template prepare_output<etl::value_t<Iterator>>(std::distance(first, last));
+
+        maybe_parallel_foreach_i(pool, first, last, [&layer, &next_a](auto& v, std::size_t i) {
+            layer.activate_hidden(next_a[i], widen_input(v));
+        });
+
+        return next_a;
+    }
+
+    //Compute the outputs of the layer I for the complete dataset, in compact
+    //form, they are widened when the next layer fills its batches
+    template <std::size_t I, typename Iterator, cpp_enable_if(compact_next<I>::value)>
+    auto propagate_next(Iterator first, Iterator last) {
+        decltype(auto) layer = layer_get<I>();
+
+        using input_t = etl::value_t<Iterator>;
+
+        std::vector<compact_vector<weight, dbn_traits<this_type>::activation_storage()>> next_a(std::distance(first, last));
+
+        maybe_parallel_foreach_i(pool, first, last, [&layer, &next_a](auto& v, std::size_t i) {
+            auto tmp = layer.template prepare_one_output<input_t>();
+
+            layer.activate_hidden(tmp, widen_input(v));
+
+            next_a[i].assign(tmp);
+        });
+
+        return next_a;
+    }
+
     template <std::size_t I, typename Iterator, typename Container, cpp_enable_if((I < layers))>
     void pretrain_layer(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs, Container& previous) {
         using layer_t = layer_type<I>;
@@ -900,11 +1356,7 @@ private:
         });
 
         if (train_next<I + 1>::value && !inline_next<I + 1>::value) {
-            auto next_a = layer.template prepare_output<etl::value_t<Iterator>>(std::distance(first, last));
-
-            maybe_parallel_foreach_i(pool, first, last, [&layer, &next_a](auto& v, std::size_t i) {
-                layer.activate_hidden(next_a[i], v);
-            });
+            auto next_a = propagate_next<I>(first, last);
 
             //At this point we don't need the storage of the previous layer
             release(previous);
@@ -981,33 +1433,35 @@ private:
     template <std::size_t I>
     struct batch_layer_ignore<I, std::enable_if_t<(I < layers)>> : cpp::or_u<layer_traits<layer_type<I>>::is_pooling_layer(), layer_traits<layer_type<I>>::is_transform_layer(), layer_traits<layer_type<I>>::is_standard_layer(), !layer_traits<layer_type<I>>::pretrain_last()> {};
 
-    template <bool Bypass, typename Iterator, typename Container, typename T = this_type, cpp_enable_if(Bypass && dbn_traits<T>::shuffle())>
-    auto prepare_it(Iterator it, Iterator end, Container& container){
-        std::copy(it, end, std::back_inserter(container));
-        return std::make_tuple(container.begin(), container.end());
+    //The samples are shuffled before each epoch of the layer I
+    template <std::size_t I>
+    struct batch_shuffle : cpp::bool_constant<dbn_traits<this_type>::shuffle() || layer_traits<layer_type<I>>::has_shuffle()> {};
+
+    //In case of shuffle, the samples are not moved, they are seen through a
+    //permutation of their indices, shuffled at each epoch
+    template <bool Shuffle, typename Iterator, cpp_enable_if(Shuffle)>
+    auto prepare_it(Iterator it, Iterator end, std::vector<std::size_t>& order){
+        return make_permutation(it, end, order);
     }
 
-    template <bool Bypass, typename Iterator, typename Container, typename T = this_type, cpp_disable_if(Bypass && dbn_traits<T>::shuffle())>
-    auto prepare_it(Iterator it, Iterator end, Container& container){
-        cpp_unused(container);
+    template <bool Shuffle, typename Iterator, cpp_disable_if(Shuffle)>
+    auto prepare_it(Iterator it, Iterator end, std::vector<std::size_t>& order){
+        cpp_unused(order);
         return std::make_tuple(it, end);
     }
 
     template <typename Container>
     void shuffle(Container& container){
-        static std::random_device rd;
-        static std::mt19937_64 g(rd());
-
-        std::shuffle(container.begin(), container.end(), g);
+        std::shuffle(container.begin(), container.end(), dll::rng());
     }
 
     //Special handling for the layer 0
     //data is coming from iterators not from input
     template <std::size_t I, typename Iterator, cpp_enable_if((I == 0 && !batch_layer_ignore<I>::value))>
-    void pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
-        std::vector<std::remove_cv_t<typename std::iterator_traits<Iterator>::value_type>> input_copy;
+    bool pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
+        std::vector<std::size_t> order;
 
-        auto iterators = prepare_it<false>(orig_first, orig_last, input_copy);
+        auto iterators = prepare_it<batch_shuffle<I>::value>(orig_first, orig_last, order);
 
         decltype(auto) first = std::get<0>(iterators);
         decltype(auto) last = std::get<1>(iterators);
@@ -1038,8 +1492,8 @@ private:
         for (std::size_t epoch = 0; epoch < max_epochs; ++epoch) {
             std::size_t big_batch = 0;
 
-            // Sort before training
-            shuffle(input_copy);
+            //Shuffle the order of the samples before training
+            shuffle(order);
 
             //Create a new context for this epoch
             rbm_training_context context;
@@ -1077,22 +1531,22 @@ private:
         r_trainer.finalize_training(rbm);
 
         //Train the next layer
-        pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
+        return pretrain_layer_batch<I + 1>(orig_first, orig_last, watcher, max_epochs);
     }
 
     //Special handling for untrained layers
     template <std::size_t I, typename Iterator, cpp_enable_if(batch_layer_ignore<I>::value)>
-    void pretrain_layer_batch(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs) {
+    bool pretrain_layer_batch(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs) {
         //We simply go up one layer on pooling layers
-        pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
+        return pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
     }
 
     //Normal version
-    template <std::size_t I, typename Iterator, cpp_enable_if((I > 0 && I < layers && !dbn_traits<this_type>::is_multiplex() && !batch_layer_ignore<I>::value))>
-    void pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
-        std::vector<typename std::iterator_traits<Iterator>::value_type> input_copy;
+    template <std::size_t I, typename Iterator, cpp_enable_if((I > 0 && I < layers && !dbn_traits<this_type>::is_multiplex() && !dbn_traits<this_type>::activation_cache() && !batch_layer_ignore<I>::value))>
+    bool pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
+        std::vector<std::size_t> order;
 
-        auto iterators = prepare_it<!batch_layer_ignore<0>::value>(orig_first, orig_last, input_copy);
+        auto iterators = prepare_it<batch_shuffle<I>::value>(orig_first, orig_last, order);
 
         decltype(auto) first = std::get<0>(iterators);
         decltype(auto) last = std::get<1>(iterators);
@@ -1121,18 +1575,70 @@ private:
         using input_t = typename types_helper<I - 1, etl::value_t<Iterator>>::input_t;
         auto next_input = layer_get<I - 1>().template prepare_output<input_t>(total_batch_size);
 
+        //In pipelined mode, the next big batches are propagated through the
+        //lower layers while the current one is trained
+
+        constexpr const std::size_t depth     = dbn_traits<this_type>::pipeline_depth();
+        constexpr const std::size_t producers = dbn_traits<this_type>::pipeline_producers();
+
+        std::vector<decltype(next_input)> ring;
+        std::vector<std::size_t> ring_size(depth);
+
+        for (std::size_t d = 0; d < depth; ++d) {
+            ring.push_back(layer_get<I - 1>().template prepare_output<input_t>(total_batch_size));
+        }
+
         //Train for max_epochs epoch
         for (std::size_t epoch = 0; epoch < max_epochs; ++epoch) {
             std::size_t big_batch = 0;
 
-            // Sort before training
-            shuffle(input_copy);
+            //Shuffle the order of the samples before training
+            shuffle(order);
 
             //Create a new context for this epoch
             rbm_training_context context;
 
             r_trainer.init_epoch();
 
+            if (depth > 1) {
+                const std::size_t n       = std::distance(first, last);
+                const std::size_t batches = (n + total_batch_size - 1) / total_batch_size;
+
+                auto produce = [&](std::size_t k, auto& buffer) {
+                    auto batch_first = std::next(first, k * total_batch_size);
+                    auto batch_last  = std::next(first, std::min((k + 1) * total_batch_size, n));
+
+                    ring_size[k % depth] = std::distance(batch_first, batch_last);
+
+                    //With several producers, each one propagates its batch serially
+                    if (producers == 1) {
+                        this->template multi_activation_probabilities<I - 1>(batch_first, batch_last, buffer);
+                    } else {
+                        this->template serial_activation_probabilities<I - 1>(batch_first, batch_last, buffer);
+                    }
+                };
+
+                auto consume = [&](std::size_t k, auto& buffer) {
+                    if (big_batch_size == 1) {
+                        //Train the RBM on this batch
+                        r_trainer.train_batch(buffer.begin(), buffer.end(), buffer.begin(), buffer.end(), trainer, context, rbm);
+                    } else {
+                        //Train the RBM on this big batch
+                        r_trainer.train_sub(buffer.begin(), buffer.begin() + ring_size[k % depth], buffer.begin(), trainer, context, rbm);
+                    }
+
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, k);
+                    }
+                };
+
+                run_pipeline(ring, batches, producers, produce, consume);
+
+                r_trainer.finalize_epoch(epoch, context, rbm);
+
+                continue;
+            }
+
             auto it  = first;
             auto end = last;
 
@@ -1166,7 +1672,294 @@ private:
         r_trainer.finalize_training(rbm);
 
         //train the next layer, if any
-        pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
+        return pretrain_layer_batch<I + 1>(orig_first, orig_last, watcher, max_epochs);
+    }
+
+    //The index of the next layer to pretrain, starting from I
+    template <std::size_t I, typename Enable = void>
+    struct next_trained_layer : std::integral_constant<std::size_t, layers> {};
+
+    template <std::size_t I>
+    struct next_trained_layer<I, std::enable_if_t<(I < layers)>>
+            : std::integral_constant<std::size_t, batch_layer_ignore<I>::value ? next_trained_layer<I + 1>::value : I> {};
+
+    //Create a new scratch file for the inputs of the layer I, with a name
+    //unique across the processes sharing the directory. Returns an empty
+    //name if the file cannot be created
+    std::string activation_cache_name(std::size_t I) const {
+        std::string name = activation_cache_directory + "/dll_activation_cache_" + std::to_string(I) + "_XXXXXX";
+
+        const int fd = mkstemp(&name[0]);
+
+        if (fd < 0) {
+            return {};
+        }
+
+        ::close(fd);
+
+        return name;
+    }
+
+    //The storage of the inputs of the layer I in the activation cache
+    template <std::size_t I>
+    using cache_codec_t = compact_codec<weight, compact_next<I - 1>::value ? dbn_traits<this_type>::activation_storage() : storage_type::NATIVE>;
+
+    template <std::size_t I>
+    using cache_value_t = typename cache_codec_t<I>::storage_t;
+
+    //Remove the current cache after a failure
+    bool activation_cache_failure(const std::string& message) {
+        std::cerr << "dll: " << message << " " << activation_cache_file << std::endl;
+
+        std::remove(activation_cache_file.c_str());
+        activation_cache_file.clear();
+
+        return false;
+    }
+
+    //Write the inputs of the layer I, propagated from the samples, in a new cache
+    template <std::size_t I, typename Iterator>
+    bool write_activation_cache(Iterator first, Iterator last, std::size_t block) {
+        using input_t = typename types_helper<I - 1, etl::value_t<Iterator>>::input_t;
+
+        auto outputs = layer_get<I - 1>().template prepare_output<input_t>(block);
+
+        activation_cache_file = activation_cache_name(I);
+
+        std::vector<cache_value_t<I>> row(etl::size(outputs[0]));
+
+        feature_writer<cache_value_t<I>> writer(activation_cache_file, row.size());
+
+        if (!writer.good()) {
+            return activation_cache_failure("Impossible to create the activation cache");
+        }
+
+        while (first != last) {
+            auto batch_first = first;
+
+            dbn_detail::safe_advance(first, last, block);
+
+            multi_activation_probabilities<I - 1>(batch_first, first, outputs);
+
+            const std::size_t n = std::distance(batch_first, first);
+
+            for (std::size_t i = 0; i < n; ++i) {
+                encode_values<cache_codec_t<I>>(outputs[i], row);
+                writer.write(row);
+            }
+        }
+
+        writer.close();
+
+        if (!writer.good()) {
+            return activation_cache_failure("Impossible to write the activation cache");
+        }
+
+        return true;
+    }
+
+    //Replace the current cache by a cache of n inputs of the layer K, computed
+    //by blocks, in parallel: compute(row, i, output) computes the inputs of
+    //the given row into output, i being the position of the row in the block
+    template <std::size_t K, typename Sample, typename Compute>
+    bool write_activation_rows(std::size_t n, std::size_t block, Compute&& compute) {
+        using next_input_t = typename types_helper<K - 1, Sample>::output_t;
+
+        std::vector<next_input_t> outputs;
+
+        for (std::size_t i = 0; i < block; ++i) {
+            outputs.push_back(layer_get<K - 1>().template prepare_one_output<typename types_helper<K - 1, Sample>::input_t>());
+        }
+
+        auto next_file = activation_cache_name(K);
+
+        bool written;
+
+        {
+            std::vector<cache_value_t<K>> row(etl::size(outputs[0]));
+
+            feature_writer<cache_value_t<K>> writer(next_file, row.size());
+
+            for (std::size_t r = 0; writer.good() && r < n; r += block) {
+                const std::size_t count = std::min(block, n - r);
+
+                maybe_parallel_foreach_n(pool, 0, count, [&](std::size_t i) {
+                    compute(r + i, i, outputs[i]);
+                });
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    encode_values<cache_codec_t<K>>(outputs[i], row);
+                    writer.write(row);
+                }
+            }
+
+            writer.close();
+
+            written = writer.good();
+        }
+
+        if (!activation_cache_file.empty()) {
+            std::remove(activation_cache_file.c_str());
+        }
+
+        activation_cache_file = next_file;
+
+        if (!written) {
+            return activation_cache_failure("Impossible to write the activation cache");
+        }
+
+        return true;
+    }
+
+    //Write the inputs of the layer I, propagated from the inputs of the layer
+    //J kept in memory, in a new cache
+    template <std::size_t I, std::size_t J, typename Sample, typename Previous>
+    bool write_activation_cache_from(const Previous& previous, std::size_t block) {
+        return write_activation_rows<I, Sample>(previous.size(), block, [&](std::size_t row, std::size_t /*i*/, auto& output) {
+            output = this->template activation_probabilities_impl<true, J, I - 1>(previous[row]);
+        });
+    }
+
+    //Replace the cache of the inputs of the layer I by a cache of the inputs
+    //of the layer K
+    template <std::size_t I, std::size_t K, typename Sample, cpp_enable_if((K < layers))>
+    bool update_activation_cache(const feature_store<cache_value_t<I>>& cache, std::size_t block) {
+        using input_t = typename types_helper<I - 1, Sample>::output_t;
+
+        std::vector<input_t> inputs;
+
+        for (std::size_t i = 0; i < block; ++i) {
+            inputs.push_back(layer_get<I - 1>().template prepare_one_output<typename types_helper<I - 1, Sample>::input_t>());
+        }
+
+        return write_activation_rows<K, Sample>(cache.size(), block, [&](std::size_t row, std::size_t i, auto& output) {
+            decode_values<cache_codec_t<I>>(cache[row], inputs[i]);
+            output = this->template activation_probabilities_impl<true, I, K - 1>(inputs[i]);
+        });
+    }
+
+    //There is no layer left to pretrain, the cache can be removed
+    template <std::size_t I, std::size_t K, typename Sample, cpp_enable_if((K == layers))>
+    bool update_activation_cache(const feature_store<cache_value_t<I>>& /*cache*/, std::size_t /*block*/) {
+        std::remove(activation_cache_file.c_str());
+        activation_cache_file.clear();
+
+        return true;
+    }
+
+    //Initialize order to the identity permutation of n inputs if the inputs
+    //of the layer I are shuffled, leave it empty otherwise
+    template <std::size_t I>
+    void prepare_order(std::size_t n, std::vector<std::size_t>& order) {
+        if (batch_shuffle<I>::value) {
+            order.resize(n);
+            std::iota(order.begin(), order.end(), std::size_t(0));
+        }
+    }
+
+    //Train the layer I on n inputs, given by big batches: fill(row, count)
+    //returns the range of the inputs [row, row + count). The order of the
+    //inputs, if not empty, is shuffled before each epoch and must be used by
+    //fill to select the inputs.
+    template <std::size_t I, typename Iterator, typename Fill>
+    void pretrain_layer_source(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs, std::size_t n, std::vector<std::size_t>& order, Fill&& fill) {
+        using layer_t = layer_type<I>;
+
+        decltype(auto) rbm = layer_get<I>();
+
+        watcher.template pretrain_layer<layer_t>(*this, I, n);
+
+        using rbm_trainer_t = dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>>;
+
+        //Initialize the RBM trainer
+        rbm_trainer_t r_trainer;
+
+        //Init the RBM and training parameters
+        r_trainer.init_training(rbm, first, last);
+
+        //Get the specific trainer (CD)
+        auto trainer = rbm_trainer_t::get_trainer(rbm);
+
+        auto total_batch_size = big_batch_size * get_batch_size(rbm);
+
+        //Train for max_epochs epoch
+        for (std::size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            std::size_t big_batch = 0;
+
+            //Shuffle the order of the inputs before training
+            shuffle(order);
+
+            //Create a new context for this epoch
+            rbm_training_context context;
+
+            r_trainer.init_epoch();
+
+            for (std::size_t row = 0; row < n; row += total_batch_size) {
+                auto range = fill(row, std::min(total_batch_size, n - row));
+
+                //Train the RBM on this big batch
+                r_trainer.train_sub(std::get<0>(range), std::get<1>(range), std::get<0>(range), trainer, context, rbm);
+
+                if (dbn_traits<this_type>::is_verbose()) {
+                    watcher.pretraining_batch(*this, big_batch);
+                }
+
+                ++big_batch;
+            }
+
+            r_trainer.finalize_epoch(epoch, context, rbm);
+        }
+
+        r_trainer.finalize_training(rbm);
+    }
+
+    //Train the layer I on the inputs stored in the current cache and replace
+    //the cache by the inputs of the next pretrained layer
+    template <std::size_t I, typename Iterator>
+    bool pretrain_layer_cache(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs) {
+        using sample_t = etl::value_t<Iterator>;
+        using input_t  = typename types_helper<I - 1, sample_t>::input_t;
+
+        auto total_batch_size = big_batch_size * get_batch_size(layer_get<I>());
+
+        auto next_input = layer_get<I - 1>().template prepare_output<input_t>(total_batch_size);
+
+        feature_store<cache_value_t<I>> cache(activation_cache_file);
+
+        if (!cache.is_open() || cache.dims() != etl::size(next_input[0])) {
+            return activation_cache_failure("Impossible to read the activation cache");
+        }
+
+        std::vector<std::size_t> order;
+        prepare_order<I>(cache.size(), order);
+
+        pretrain_layer_source<I>(first, last, watcher, max_epochs, cache.size(), order, [&](std::size_t row, std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                decode_values<cache_codec_t<I>>(cache[order.empty() ? row + i : order[row + i]], next_input[i]);
+            }
+
+            return std::make_pair(next_input.begin(), next_input.begin() + count);
+        });
+
+        //Stream the inputs of the next pretrained layer to a new cache
+        return update_activation_cache<I, next_trained_layer<I + 1>::value, sample_t>(cache, total_batch_size);
+    }
+
+    //Cached version: the inputs of the layer are read from a scratch file
+    template <std::size_t I, typename Iterator, cpp_enable_if((I > 0 && I < layers && !dbn_traits<this_type>::is_multiplex() && dbn_traits<this_type>::activation_cache() && !batch_layer_ignore<I>::value))>
+    bool pretrain_layer_batch(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs) {
+        //The first cached layer computes its inputs from the samples, the
+        //next ones are given their inputs by the previous layer
+        if (activation_cache_file.empty() && !write_activation_cache<I>(first, last, big_batch_size * get_batch_size(layer_get<I>()))) {
+            return false;
+        }
+
+        if (!pretrain_layer_cache<I>(first, last, watcher, max_epochs)) {
+            return false;
+        }
+
+        //train the next layer, if any
+        return pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
     }
 
     // TODO THis should not be necessary at all
@@ -1186,10 +1979,10 @@ private:
 
     //Multiplex version
     template <std::size_t I, typename Iterator, cpp_enable_if((I > 0 && I < layers && dbn_traits<this_type>::is_multiplex() && !batch_layer_ignore<I>::value))>
-    void pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
-        std::vector<typename std::iterator_traits<Iterator>::value_type> input_copy;
+    bool pretrain_layer_batch(Iterator orig_first, Iterator orig_last, watcher_t& watcher, std::size_t max_epochs) {
+        std::vector<std::size_t> order;
 
-        auto iterators = prepare_it<!batch_layer_ignore<0>::value>(orig_first, orig_last, input_copy);
+        auto iterators = prepare_it<batch_shuffle<I>::value>(orig_first, orig_last, order);
 
         decltype(auto) first = std::get<0>(iterators);
         decltype(auto) last = std::get<1>(iterators);
@@ -1222,8 +2015,8 @@ private:
         for (std::size_t epoch = 0; epoch < max_epochs; ++epoch) {
             std::size_t big_batch = 0;
 
-            // Sort before training
-            shuffle(input_copy);
+            //Shuffle the order of the samples before training
+            shuffle(order);
 
             //Create a new context for this epoch
             rbm_training_context context;
@@ -1276,12 +2069,176 @@ private:
         r_trainer.finalize_training(rbm);
 
         //train the next layer, if any
-        pretrain_layer_batch<I + 1>(first, last, watcher, max_epochs);
+        return pretrain_layer_batch<I + 1>(orig_first, orig_last, watcher, max_epochs);
     }
 
     //Stop template recursion
     template <std::size_t I, typename Iterator, cpp_enable_if(I == layers)>
-    void pretrain_layer_batch(Iterator, Iterator, watcher_t&, std::size_t) {}
+    bool pretrain_layer_batch(Iterator, Iterator, watcher_t&, std::size_t) {
+        return true;
+    }
+
+    /* Pretrain under a memory budget */
+
+    //Layer 0 is directly trained on the samples
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if((I == 0 && !batch_layer_ignore<I>::value))>
+    bool pretrain_layer_budget(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs, std::size_t budget, Previous& previous) {
+        std::vector<std::size_t> order;
+
+        auto iterators = prepare_it<batch_shuffle<I>::value>(first, last, order);
+
+        auto samples = std::get<0>(iterators);
+
+        pretrain_layer_source<I>(first, last, watcher, max_epochs, std::distance(first, last), order, [&](std::size_t row, std::size_t count) {
+            return std::make_pair(std::next(samples, row), std::next(samples, row + count));
+        });
+
+        return pretrain_layer_budget<I + 1, J>(first, last, watcher, max_epochs, budget, previous);
+    }
+
+    //Special handling for untrained layers
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if(batch_layer_ignore<I>::value)>
+    bool pretrain_layer_budget(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs, std::size_t budget, Previous& previous) {
+        return pretrain_layer_budget<I + 1, J>(first, last, watcher, max_epochs, budget, previous);
+    }
+
+    //Compute the inputs of the layer I from the samples (J == 0)
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, typename Inputs, cpp_enable_if((J == 0))>
+    void propagate_inputs(Iterator first, Iterator last, const Previous& /*previous*/, Inputs& inputs) {
+        multi_activation_probabilities<I - 1>(first, last, inputs);
+    }
+
+    //Compute the inputs of the layer I from the inputs of the layer J, kept in
+    //memory, only the layers J to I - 1 are used
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, typename Inputs, cpp_enable_if((J > 0))>
+    void propagate_inputs(Iterator first, Iterator last, const Previous& previous, Inputs& inputs) {
+        const std::size_t n = std::distance(first, last);
+
+        maybe_parallel_foreach_n(pool, 0, n, [&](std::size_t i) {
+            inputs[i] = this->template activation_probabilities_impl<true, J, I - 1>(previous[i]);
+        });
+    }
+
+    //Compute the inputs of the layer I for the rows [row, row + count) from
+    //the samples (J == 0)
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, typename Inputs, cpp_enable_if((J == 0))>
+    void stream_inputs(Iterator samples, const Previous& /*previous*/, const std::vector<std::size_t>& /*order*/, std::size_t row, std::size_t count, Inputs& inputs) {
+        multi_activation_probabilities<I - 1>(std::next(samples, row), std::next(samples, row + count), inputs);
+    }
+
+    //Compute the inputs of the layer I for the rows [row, row + count) from
+    //the inputs of the layer J, kept in memory
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, typename Inputs, cpp_enable_if((J > 0))>
+    void stream_inputs(Iterator /*samples*/, const Previous& previous, const std::vector<std::size_t>& order, std::size_t row, std::size_t count, Inputs& inputs) {
+        maybe_parallel_foreach_n(pool, 0, count, [&](std::size_t i) {
+            inputs[i] = this->template activation_probabilities_impl<true, J, I - 1>(previous[order.empty() ? row + i : order[row + i]]);
+        });
+    }
+
+    //Write the inputs of the layer I in a new cache from the samples (J == 0)
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if((J == 0))>
+    bool write_budget_cache(Iterator first, Iterator last, const Previous& /*previous*/, std::size_t block) {
+        return write_activation_cache<I>(first, last, block);
+    }
+
+    //Write the inputs of the layer I in a new cache from the inputs of the
+    //layer J, kept in memory
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if((J > 0))>
+    bool write_budget_cache(Iterator /*first*/, Iterator /*last*/, const Previous& previous, std::size_t block) {
+        return write_activation_cache_from<I, J, etl::value_t<Iterator>>(previous, block);
+    }
+
+    //The inputs of the layers are computed from the nearest stored inputs:
+    //the activation cache, if any, or the inputs of the layer J kept in
+    //memory (previous), the samples themselves when J is zero
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if((I > 0 && I < layers && !batch_layer_ignore<I>::value))>
+    bool pretrain_layer_budget(Iterator first, Iterator last, watcher_t& watcher, std::size_t max_epochs, std::size_t budget, Previous& previous) {
+        using sample_t = etl::value_t<Iterator>;
+        using input_t  = typename types_helper<I - 1, sample_t>::input_t;
+
+        const std::size_t n                = std::distance(first, last);
+        const std::size_t total_batch_size = big_batch_size * get_batch_size(layer_get<I>());
+
+        //The size of the inputs of the layer, for the complete dataset
+        const std::size_t bytes = n * etl::size(prepare_output<I - 1, sample_t>()) * sizeof(weight);
+
+        auto mode = dbn_detail::select_pretraining_mode(bytes, budget, max_epochs, !activation_cache_file.empty());
+
+        std::cout << "DBN: Layer " << I << " pretrained " << dbn_detail::to_string(mode) << " (" << bytes << " bytes of inputs)" << std::endl;
+
+        std::vector<std::size_t> order;
+
+        if (mode == dbn_detail::pretraining_mode::MEMORY) {
+            auto inputs = layer_get<I - 1>().template prepare_output<input_t>(n);
+
+            if (activation_cache_file.empty()) {
+                propagate_inputs<I, J>(first, last, previous, inputs);
+            } else {
+                //The previous layer has already cached the inputs
+                {
+                    feature_store<cache_value_t<I>> cache(activation_cache_file);
+
+                    if (!cache.is_open() || cache.size() != n) {
+                        return activation_cache_failure("Impossible to read the activation cache");
+                    }
+
+                    for (std::size_t i = 0; i < n; ++i) {
+                        decode_values<cache_codec_t<I>>(cache[i], inputs[i]);
+                    }
+                }
+
+                std::remove(activation_cache_file.c_str());
+                activation_cache_file.clear();
+            }
+
+            //At this point, the inputs of the previous layers are not needed
+            release(previous);
+
+            auto iterators = prepare_it<batch_shuffle<I>::value>(inputs.begin(), inputs.end(), order);
+
+            auto input_first = std::get<0>(iterators);
+
+            pretrain_layer_source<I>(first, last, watcher, max_epochs, n, order, [&](std::size_t row, std::size_t count) {
+                return std::make_pair(std::next(input_first, row), std::next(input_first, row + count));
+            });
+
+            return pretrain_layer_budget<I + 1, I>(first, last, watcher, max_epochs, budget, inputs);
+        } else if (mode == dbn_detail::pretraining_mode::CACHED) {
+            if (activation_cache_file.empty() && !write_budget_cache<I, J>(first, last, previous, total_batch_size)) {
+                return false;
+            }
+
+            release(previous);
+
+            if (!pretrain_layer_cache<I>(first, last, watcher, max_epochs)) {
+                return false;
+            }
+
+            //The inputs of the next layer are in the cache
+            return pretrain_layer_budget<I + 1, 0>(first, last, watcher, max_epochs, budget, fake_resource);
+        } else {
+            auto next_input = layer_get<I - 1>().template prepare_output<input_t>(total_batch_size);
+
+            auto iterators = prepare_it<batch_shuffle<I>::value>(first, last, order);
+
+            auto samples = std::get<0>(iterators);
+
+            pretrain_layer_source<I>(first, last, watcher, max_epochs, n, order, [&](std::size_t row, std::size_t count) {
+                this->template stream_inputs<I, J>(samples, previous, order, row, count, next_input);
+
+                return std::make_pair(next_input.begin(), next_input.begin() + count);
+            });
+
+            //The inputs of the layer J are still the nearest stored inputs
+            return pretrain_layer_budget<I + 1, J>(first, last, watcher, max_epochs, budget, previous);
+        }
+    }
+
+    //Stop template recursion
+    template <std::size_t I, std::size_t J, typename Iterator, typename Previous, cpp_enable_if(I == layers)>
+    bool pretrain_layer_budget(Iterator, Iterator, watcher_t&, std::size_t, std::size_t, Previous&) {
+        return true;
+    }
 
     /* Train with labels */
 
@@ -1389,6 +2346,69 @@ private:
 
     /* Activation Probabilities */
 
+    template <std::size_t I, typename Context, typename Input, cpp_enable_if((I < layers))>
+    void inference_impl(Context& context, const Input& input) const {
+        auto& output = std::get<I>(context.outputs);
+
+        dbn_detail::inference_scratch<layer_type<I>>::activate(layer_get<I>(), output, input, std::get<I>(context.scratch));
+
+        inference_impl<I + 1>(context, output);
+    }
+
+    template <std::size_t I, typename Context, typename Input, cpp_enable_if((I == layers))>
+    void inference_impl(Context&, const Input&) const {}
+
+    template <std::size_t I, std::size_t B, typename Input, typename Output, cpp_enable_if((I == layers - 1))>
+    void batch_activation_probabilities_chain(const Input& input, Output& output) const {
+        layer_get<I>().batch_activate_hidden(output, input);
+    }
+
+    template <std::size_t I, std::size_t B, typename Input, typename Output, cpp_enable_if((I < layers - 1))>
+    void batch_activation_probabilities_chain(const Input& input, Output& output) const {
+        typename dbn_detail::layer_output_batch<this_type, I>::template type<B> next;
+
+        layer_get<I>().batch_activate_hidden(next, input);
+
+        batch_activation_probabilities_chain<I + 1, B>(next, output);
+    }
+
+    template <std::size_t B, typename Iterator, typename Functor>
+    void batch_activation_probabilities_impl(Iterator first, Iterator last, Functor&& functor) const {
+        static_assert(B > 0, "The batch size must be at least 1");
+        static_assert(!dbn_traits<this_type>::is_multiplex(), "Multiplex DBN does not support batch activation probabilities");
+        static_assert(!dbn_traits<this_type>::is_dynamic(), "Dynamic DBN does not support batch activation probabilities");
+
+        dll::auto_timer timer("dbn:batch_activation_probabilities");
+
+        input_batch_t<B> input;
+        output_batch_t<B> output;
+
+        input = weight(0);
+
+        while (first != last) {
+            //Fill the input batch
+            std::size_t n = 0;
+            while (first != last && n < B) {
+                input(n++) = *first++;
+            }
+
+            //The end of a partial batch contains stale samples, whose outputs are ignored
+            batch_activation_probabilities_chain<0, B>(input, output);
+
+            for (std::size_t i = 0; i < n; ++i) {
+                functor(output(i));
+            }
+        }
+    }
+
+    template <std::size_t I, typename Iterator, typename Output>
+    void serial_activation_probabilities(Iterator first, Iterator last, Output& output) const {
+        std::size_t i = 0;
+        for (; first != last; ++first) {
+            output[i++] = activation_probabilities_sub<I>(*first);
+        }
+    }
+
     template <std::size_t I, typename Iterator, typename Output>
     void multi_activation_probabilities(Iterator first, Iterator last, Output& output) {
         //Collect an entire batch
@@ -77,6 +77,75 @@ struct layer_input_batch<DBN, I, std::enable_if_t<layer_traits<typename DBN::tem
     using type = typename layer_input_batch<DBN, I + 1>::template type<B>;
 };
 
+template <typename DBN, std::size_t I, typename Enable = void>
+struct layer_output_batch;
+
+template <typename DBN, std::size_t I>
+struct layer_output_batch<DBN, I, std::enable_if_t<!layer_traits<typename DBN::template layer_type<I>>::has_same_type()>> {
+    template <std::size_t B>
+    using type = typename DBN::template layer_type<I>::template output_batch_t<B>;
+};
+
+//A layer keeping the same type outputs what it receives (the output of the previous layer)
+template <typename DBN, std::size_t I>
+struct layer_output_batch<DBN, I, std::enable_if_t<(I > 0) && layer_traits<typename DBN::template layer_type<I>>::has_same_type()>> {
+    template <std::size_t B>
+    using type = typename layer_output_batch<DBN, I - 1>::template type<B>;
+};
+
+//The first layer keeps the same type as the input of the network
+template <typename DBN, std::size_t I>
+struct layer_output_batch<DBN, I, std::enable_if_t<(I == 0) && layer_traits<typename DBN::template layer_type<I>>::has_same_type()>> {
+    template <std::size_t B>
+    using type = typename layer_input_batch<DBN, 0>::template type<B>;
+};
+
+/*!
+ * \brief Scratch memory used by a layer to compute the activations of one
+ * sample, kept in an inference context between calls.
+ *
+ * By default, a layer does not use any scratch memory.
+ */
+template <typename Layer, typename Enable = void>
+struct inference_scratch {
+    struct type {};
+
+    template <typename Output, typename Input>
+    static void activate(const Layer& layer, Output& output, const Input& input, type& /*scratch*/) {
+        layer.activate_hidden(output, input);
+    }
+};
+
+template <typename Layer>
+struct inference_scratch<Layer, std::enable_if_t<layer_traits<Layer>::is_standard_rbm_layer() && !layer_traits<Layer>::is_dynamic()>> {
+    using type = etl::fast_dyn_matrix<typename Layer::weight, Layer::num_hidden>;
+
+    template <typename Output, typename Input>
+    static void activate(const Layer& layer, Output& output, const Input& input, type& t) {
+        layer.activate_hidden(output, input, t);
+    }
+};
+
+template <typename Layer>
+struct inference_scratch<Layer, std::enable_if_t<layer_traits<Layer>::is_dense_layer()>> {
+    using type = etl::fast_dyn_matrix<typename Layer::weight, Layer::num_hidden>;
+
+    template <typename Output, typename Input>
+    static void activate(const Layer& layer, Output& output, const Input& input, type& t) {
+        layer.activate_hidden(output, input, t);
+    }
+};
+
+template <typename Layer>
+struct inference_scratch<Layer, std::enable_if_t<layer_traits<Layer>::is_convolutional_layer()>> {
+    using type = etl::fast_dyn_matrix<typename Layer::weight, 2, Layer::K, Layer::NH1, Layer::NH2>;
+
+    template <typename Output, typename Input>
+    static void activate(const Layer& layer, Output& output, const Input& input, type& v_cv) {
+        layer.activate_hidden(output, input, v_cv);
+    }
+};
+
 template <typename D, typename T>
 struct for_each_impl;
 
@@ -124,6 +193,49 @@ struct for_each_impl<D, std::index_sequence<I...>> {
     }
 };
 
+/*!
+ * \brief The way the inputs of a layer are computed during pretraining
+ */
+enum class pretraining_mode {
+    MEMORY,  ///< The inputs are propagated once and kept in memory
+    CACHED,  ///< The inputs are propagated once and stored in a scratch file
+    STREAMED ///< The inputs are propagated again by big batches at each epoch
+};
+
+inline const char* to_string(pretraining_mode mode) {
+    switch (mode) {
+        case pretraining_mode::MEMORY:
+            return "in memory";
+        case pretraining_mode::CACHED:
+            return "from the activation cache";
+        case pretraining_mode::STREAMED:
+            return "streamed";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief Select the pretraining mode of a layer
+ * \param bytes The size of the inputs of the layer
+ * \param budget The memory budget
+ * \param max_epochs The number of epochs of pretraining
+ * \param cached Indicates if the inputs of the layer are already cached
+ */
+inline pretraining_mode select_pretraining_mode(std::size_t bytes, std::size_t budget, std::size_t max_epochs, bool cached) {
+    if (bytes <= budget) {
+        return pretraining_mode::MEMORY;
+    }
+
+    //Reading the inputs back is cheaper than propagating them again, unless
+    //they are only used once
+    if (cached || max_epochs > 1) {
+        return pretraining_mode::CACHED;
+    }
+
+    return pretraining_mode::STREAMED;
+}
+
 } //end of namespace dbn_detail
 
 } //end of namespace dll
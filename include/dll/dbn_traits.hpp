@@ -58,6 +58,37 @@ struct dbn_traits {
         return desc::parameters::template contains<dll::shuffle>();
     }
 
+    /*!
+     * \brief Indicates if the inputs of the pretrained layers are cached on
+     * disk in batch mode.
+     */
+    static constexpr bool activation_cache() noexcept {
+        return desc::parameters::template contains<dll::activation_cache>();
+    }
+
+    /*!
+     * \brief Returns the storage of the activations propagated between the
+     * pretrained layers.
+     */
+    static constexpr storage_type activation_storage() noexcept {
+        return detail::get_value_l<dll::activation_storage<storage_type::NATIVE>, typename desc::parameters>::value;
+    }
+
+    /*!
+     * \brief Returns the number of buffers of the pretraining pipeline, 0 if
+     * the pretraining is not pipelined.
+     */
+    static constexpr std::size_t pipeline_depth() noexcept {
+        return detail::get_value_l<dll::pipeline<0>, typename desc::parameters>::value;
+    }
+
+    /*!
+     * \brief Returns the number of producer threads of the pretraining pipeline
+     */
+    static constexpr std::size_t pipeline_producers() noexcept {
+        return detail::get_value_l<dll::pipeline_producers<1>, typename desc::parameters>::value;
+    }
+
     static constexpr bool concatenate() noexcept {
         return desc::parameters::template contains<svm_concatenate>();
     }
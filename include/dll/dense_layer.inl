@@ -120,6 +120,26 @@ struct dense_layer final : neural_base<dense_layer<Desc>> {
         output = f_activate<activation_function>(b + etl::reshape<num_visible>(v) * w);
     }
 
+    /*!
+     * \brief Compute the activations of the given input, using t as
+     * temporary storage for the pre-activations.
+     */
+    template <typename V, typename T, cpp_enable_if(etl::decay_traits<V>::dimensions() == 1)>
+    void activate_hidden(output_one_t& output, const V& v, T&& t) const {
+        t = v * w;
+        output = f_activate<activation_function>(b + t);
+    }
+
+    /*!
+     * \brief Compute the activations of the given input, using t as
+     * temporary storage for the pre-activations.
+     */
+    template <typename V, typename T, cpp_enable_if(etl::decay_traits<V>::dimensions() != 1)>
+    void activate_hidden(output_one_t& output, const V& v, T&& t) const {
+        t = etl::reshape<num_visible>(v) * w;
+        output = f_activate<activation_function>(b + t);
+    }
+
     template <typename H, typename V, cpp_enable_if(etl::decay_traits<V>::dimensions() == 2)>
     void batch_activate_hidden(H&& output, const V& v) const {
         const auto Batch = etl::dim<0>(v);
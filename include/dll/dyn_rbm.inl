@@ -60,7 +60,8 @@ struct dyn_rbm final : public standard_rbm<dyn_rbm<Desc>, Desc> {
     size_t num_visible;
     size_t num_hidden;
 
-    size_t batch_size = 25;
+    size_t batch_size        = 25;
+    size_t fantasy_particles = 0; ///< The number of persistent chains of PCD (0 for one per sample of the batch)
 
     //No copying
     dyn_rbm(const dyn_rbm& rbm) = delete;
@@ -49,10 +49,14 @@ struct dyn_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid<cpp::type_list<momentum_id, visible_id, hidden_id, weight_decay_id, parallel_mode_id, serial_id, verbose_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id>,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, hogwild_id,
+                                        metrics_id, metrics_period_id>,
                          Parameters...>::value,
         "Invalid parameters type");
 
+    static_assert(!(parameters::template contains<hogwild>() && parameters::template contains<parallel_mode>()),
+                  "Hogwild and parallel mode cannot be used together");
+
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
                   "Sparsity only works with binary hidden units");
 };
@@ -0,0 +1,597 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file frozen_dbn.hpp
+ * \brief Inference-only version of a trained DBN.
+ */
+
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/tmp.hpp"
+
+#include "function.hpp"
+#include "unit_type.hpp"
+#include "layer_traits.hpp"
+
+namespace dll {
+
+namespace frozen_detail {
+
+/*!
+ * \brief The activation function applied by a frozen layer
+ */
+enum class activation {
+    IDENTITY,
+    SIGMOID,
+    TANH,
+    RELU,
+    RELU1,
+    RELU6,
+    SOFTMAX
+};
+
+constexpr activation from_function(function f) {
+    return f == function::SIGMOID ? activation::SIGMOID
+         : f == function::TANH ? activation::TANH
+         : f == function::RELU ? activation::RELU
+         : f == function::SOFTMAX ? activation::SOFTMAX
+         : activation::IDENTITY;
+}
+
+constexpr activation from_unit(unit_type u) {
+    return u == unit_type::BINARY ? activation::SIGMOID
+         : u == unit_type::RELU ? activation::RELU
+         : u == unit_type::RELU1 ? activation::RELU1
+         : u == unit_type::RELU6 ? activation::RELU6
+         : u == unit_type::SOFTMAX ? activation::SOFTMAX
+         : activation::IDENTITY;
+}
+
+constexpr std::size_t sum_of(std::initializer_list<std::size_t> values) {
+    std::size_t sum = 0;
+    for (auto v : values) {
+        sum += v;
+    }
+    return sum;
+}
+
+constexpr std::size_t max_of(std::initializer_list<std::size_t> values) {
+    std::size_t max = 0;
+    for (auto v : values) {
+        max = v > max ? v : max;
+    }
+    return max;
+}
+
+constexpr const std::size_t alignment = 64; ///< The alignment, in bytes, of each block of memory
+
+/*!
+ * \brief Returns the number of elements of type W to reserve for n elements
+ * so that the next block stays aligned.
+ */
+template <typename W>
+constexpr std::size_t aligned_size(std::size_t n) {
+    return ((n * sizeof(W) + alignment - 1) / alignment) * (alignment / sizeof(W));
+}
+
+/*!
+ * \brief A heap buffer whose first element is aligned on a cache line
+ */
+template <typename W>
+struct aligned_buffer {
+    aligned_buffer() = default;
+
+    explicit aligned_buffer(std::size_t n)
+            : storage(new W[n + alignment / sizeof(W)]) {
+        void* ptr         = storage.get();
+        std::size_t space = (n + alignment / sizeof(W)) * sizeof(W);
+        memory            = static_cast<W*>(std::align(alignment, n * sizeof(W), ptr, space));
+    }
+
+    W* get() const {
+        return memory;
+    }
+
+private:
+    std::unique_ptr<W[]> storage; ///< The allocated memory
+    W* memory = nullptr;          ///< The aligned start of the memory
+};
+
+/*!
+ * \brief Apply the activation function in place on n contiguous values
+ */
+template <activation A, typename W>
+void activate(W* values, std::size_t n) {
+    if (A == activation::SIGMOID) {
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = W(1) / (W(1) + std::exp(-values[i]));
+        }
+    } else if (A == activation::TANH) {
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = std::tanh(values[i]);
+        }
+    } else if (A == activation::RELU) {
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = std::max(values[i], W(0));
+        }
+    } else if (A == activation::RELU1) {
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = std::min(std::max(values[i], W(0)), W(1));
+        }
+    } else if (A == activation::RELU6) {
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = std::min(std::max(values[i], W(0)), W(6));
+        }
+    } else if (A == activation::SOFTMAX) {
+        auto max = *std::max_element(values, values + n);
+
+        W sum(0);
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = std::exp(values[i] - max);
+            sum += values[i];
+        }
+
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] /= sum;
+        }
+    }
+}
+
+constexpr const std::size_t gemm_rows    = 4;   ///< The number of samples computed together
+constexpr const std::size_t gemm_block_k = 128; ///< The number of rows of the weights in a block
+constexpr const std::size_t gemm_block_n = 64;  ///< The number of columns of the weights in a block
+
+/*!
+ * \brief Accumulate M rows of a multiplied by w into c, for the columns
+ * [j, j + jn) and the rows [k, k + kn) of w. The partial results are kept in a local block so that the inner loop
+ * can be vectorized.
+ */
+template <std::size_t M, typename W>
+void gemm_block(const W* a, const W* w, W* c, std::size_t nv, std::size_t nh, std::size_t k, std::size_t kn, std::size_t j, std::size_t jn) {
+    W acc[M][gemm_block_n];
+
+    for (std::size_t r = 0; r < M; ++r) {
+        std::copy(c + r * nh + j, c + r * nh + j + jn, acc[r]);
+    }
+
+    for (std::size_t i = k; i < k + kn; ++i) {
+        const W* w_i = w + i * nh + j;
+
+        for (std::size_t r = 0; r < M; ++r) {
+            const W x = a[r * nv + i];
+
+            for (std::size_t jj = 0; jj < jn; ++jj) {
+                acc[r][jj] += x * w_i[jj];
+            }
+        }
+    }
+
+    for (std::size_t r = 0; r < M; ++r) {
+        std::copy(acc[r], acc[r] + jn, c + r * nh + j);
+    }
+}
+
+/*!
+ * \brief Blocked c += a * w, with a (n x nv), w (nv x nh) and c (n x nh),
+ * all row-major.
+ *
+ * The weights are processed by tiles of gemm_block_k x gemm_block_n, each
+ * tile being used for all the samples while it is in cache, gemm_rows
+ * samples at a time.
+ */
+template <typename W>
+void gemm_acc(const W* a, const W* w, W* c, std::size_t n, std::size_t nv, std::size_t nh) {
+    for (std::size_t j = 0; j < nh; j += gemm_block_n) {
+        const std::size_t jn = std::min(gemm_block_n, nh - j);
+
+        for (std::size_t k = 0; k < nv; k += gemm_block_k) {
+            const std::size_t kn = std::min(gemm_block_k, nv - k);
+
+            std::size_t s = 0;
+
+            for (; s + gemm_rows <= n; s += gemm_rows) {
+                gemm_block<gemm_rows>(a + s * nv, w, c + s * nh, nv, nh, k, kn, j, jn);
+            }
+
+            for (; s < n; ++s) {
+                gemm_block<1>(a + s * nv, w, c + s * nh, nv, nh, k, kn, j, jn);
+            }
+        }
+    }
+}
+
+template <typename Layer, typename Enable = void>
+struct layer_activation {
+    static constexpr const activation value = from_function(Layer::activation_function);
+};
+
+template <typename Layer>
+struct layer_activation<Layer, std::enable_if_t<layer_traits<Layer>::is_standard_rbm_layer()>> {
+    static constexpr const activation value = from_unit(Layer::hidden_unit);
+};
+
+/*!
+ * \brief The frozen version of a layer.
+ *
+ * Each frozen layer exposes its number of inputs and outputs per sample, the
+ * number of elements it needs in the packed memory of the network, a
+ * freeze() function copying the weights of the layer into this memory and an
+ * activate() function computing the outputs of n contiguous samples.
+ */
+template <typename Layer, typename W, typename Enable = void>
+struct frozen_layer {
+    static_assert(!std::is_same<Layer, Layer>::value, "This layer cannot be frozen");
+};
+
+/*!
+ * \brief Frozen fully-connected layer (dense layer or RBM)
+ */
+template <typename Layer, typename W>
+struct frozen_layer<Layer, W, std::enable_if_t<is_dense<Layer>::value && !layer_traits<Layer>::is_dynamic()>> {
+    static constexpr const std::size_t NV = Layer::num_visible;
+    static constexpr const std::size_t NH = Layer::num_hidden;
+
+    static constexpr const activation A = layer_activation<Layer>::value;
+
+    static constexpr const std::size_t input_size  = NV;
+    static constexpr const std::size_t output_size = NH;
+    static constexpr const std::size_t parameters  = aligned_size<W>(NV * NH) + aligned_size<W>(NH);
+
+    const W* w = nullptr; ///< The weights (NV x NH), row-major
+    const W* b = nullptr; ///< The hidden biases
+
+    void freeze(const Layer& layer, W* memory) {
+        std::copy(layer.w.begin(), layer.w.end(), memory);
+        std::copy(layer.b.begin(), layer.b.end(), memory + aligned_size<W>(NV * NH));
+
+        w = memory;
+        b = memory + aligned_size<W>(NV * NH);
+    }
+
+    void activate(const W* input, W* output, std::size_t n) const {
+        for (std::size_t s = 0; s < n; ++s) {
+            std::copy(b, b + NH, output + s * NH);
+        }
+
+        gemm_acc(input, w, output, n, NV, NH);
+
+        for (std::size_t s = 0; s < n; ++s) {
+            frozen_detail::activate<A>(output + s * NH, NH);
+        }
+    }
+};
+
+/*!
+ * \brief Frozen convolutional layer
+ */
+template <typename Layer, typename W>
+struct frozen_layer<Layer, W, std::enable_if_t<layer_traits<Layer>::is_convolutional_layer()>> {
+    static constexpr const std::size_t NC  = Layer::NC;
+    static constexpr const std::size_t K   = Layer::K;
+    static constexpr const std::size_t NV1 = Layer::NV1;
+    static constexpr const std::size_t NV2 = Layer::NV2;
+    static constexpr const std::size_t NH1 = Layer::NH1;
+    static constexpr const std::size_t NH2 = Layer::NH2;
+    static constexpr const std::size_t NW1 = Layer::NW1;
+    static constexpr const std::size_t NW2 = Layer::NW2;
+
+    static constexpr const activation A = layer_activation<Layer>::value;
+
+    static constexpr const std::size_t input_size  = NC * NV1 * NV2;
+    static constexpr const std::size_t output_size = K * NH1 * NH2;
+    static constexpr const std::size_t parameters  = aligned_size<W>(NC * K * NW1 * NW2) + aligned_size<W>(K);
+
+    const W* w = nullptr; ///< The kernels (NC x K x NW1 x NW2)
+    const W* b = nullptr; ///< The biases, one per kernel
+
+    void freeze(const Layer& layer, W* memory) {
+        std::copy(layer.w.begin(), layer.w.end(), memory);
+        std::copy(layer.b.begin(), layer.b.end(), memory + aligned_size<W>(NC * K * NW1 * NW2));
+
+        w = memory;
+        b = memory + aligned_size<W>(NC * K * NW1 * NW2);
+    }
+
+    void activate(const W* input, W* output, std::size_t n) const {
+        for (std::size_t s = 0; s < n; ++s) {
+            const W* in = input + s * input_size;
+            W* out      = output + s * output_size;
+
+            for (std::size_t k = 0; k < K; ++k) {
+                std::fill(out + k * NH1 * NH2, out + (k + 1) * NH1 * NH2, b[k]);
+            }
+
+            //A valid convolution with flipped kernels is a correlation with the kernels
+
+            for (std::size_t c = 0; c < NC; ++c) {
+                for (std::size_t k = 0; k < K; ++k) {
+                    for (std::size_t p = 0; p < NW1; ++p) {
+                        for (std::size_t q = 0; q < NW2; ++q) {
+                            const W w_pq = w[((c * K + k) * NW1 + p) * NW2 + q];
+
+                            for (std::size_t i = 0; i < NH1; ++i) {
+                                const W* in_row = in + (c * NV1 + i + p) * NV2 + q;
+                                W* out_row      = out + (k * NH1 + i) * NH2;
+
+                                for (std::size_t j = 0; j < NH2; ++j) {
+                                    out_row[j] += w_pq * in_row[j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            frozen_detail::activate<A>(out, output_size);
+        }
+    }
+};
+
+/*!
+ * \brief Frozen pooling layer
+ */
+template <typename Layer, typename W>
+struct frozen_layer<Layer, W, std::enable_if_t<layer_traits<Layer>::is_pooling_layer()>> {
+    static constexpr const std::size_t I1 = Layer::I1;
+    static constexpr const std::size_t I2 = Layer::I2;
+    static constexpr const std::size_t I3 = Layer::I3;
+    static constexpr const std::size_t C1 = Layer::C1;
+    static constexpr const std::size_t C2 = Layer::C2;
+    static constexpr const std::size_t C3 = Layer::C3;
+    static constexpr const std::size_t O1 = Layer::O1;
+    static constexpr const std::size_t O2 = Layer::O2;
+    static constexpr const std::size_t O3 = Layer::O3;
+
+    static constexpr const bool max_pooling = layer_traits<Layer>::is_max_pooling_layer();
+
+    static constexpr const std::size_t input_size  = I1 * I2 * I3;
+    static constexpr const std::size_t output_size = O1 * O2 * O3;
+    static constexpr const std::size_t parameters  = 0;
+
+    void freeze(const Layer& /*layer*/, W* /*memory*/) {
+        //Nothing to keep
+    }
+
+    void activate(const W* input, W* output, std::size_t n) const {
+        for (std::size_t s = 0; s < n; ++s) {
+            const W* in = input + s * input_size;
+            W* out      = output + s * output_size;
+
+            for (std::size_t i = 0; i < O1; ++i) {
+                for (std::size_t j = 0; j < O2; ++j) {
+                    for (std::size_t k = 0; k < O3; ++k) {
+                        W value = max_pooling ? in[((i * C1) * I2 + j * C2) * I3 + k * C3] : W(0);
+
+                        for (std::size_t ii = 0; ii < C1; ++ii) {
+                            for (std::size_t jj = 0; jj < C2; ++jj) {
+                                for (std::size_t kk = 0; kk < C3; ++kk) {
+                                    auto v = in[((i * C1 + ii) * I2 + j * C2 + jj) * I3 + k * C3 + kk];
+                                    value  = max_pooling ? std::max(value, v) : value + v;
+                                }
+                            }
+                        }
+
+                        out[(i * O2 + j) * O3 + k] = max_pooling ? value : value / W(C1 * C2 * C3);
+                    }
+                }
+            }
+        }
+    }
+};
+
+} //end of namespace frozen_detail
+
+/*!
+ * \brief Inference-only version of a trained DBN.
+ *
+ * Only the weights and biases of the layers are kept, packed in a single
+ * block of memory, each block aligned on a cache line. The training state of
+ * the layers (backups, trainer contexts, CD buffers) is not kept. Each layer
+ * computes its outputs, adds its biases and applies its activation function
+ * in a single pass over the output.
+ *
+ * Dense layers, standard RBMs, convolutional layers and pooling layers are
+ * supported. The network is not modified by training the original DBN, it
+ * must be frozen again to see the new weights.
+ */
+template <typename DBN>
+struct frozen_dbn {
+    using dbn_t  = DBN;                    ///< The type of the original network
+    using weight = typename dbn_t::weight; ///< The type of the weights
+
+    static constexpr const std::size_t layers = dbn_t::layers; ///< The number of layers
+
+    template <std::size_t I>
+    using layer_type = frozen_detail::frozen_layer<typename dbn_t::template layer_type<I>, weight>; ///< The type of the Ith frozen layer
+
+private:
+    template <typename Sequence>
+    struct layers_helper;
+
+    template <std::size_t... I>
+    struct layers_helper<std::index_sequence<I...>> {
+        using type = std::tuple<layer_type<I>...>;
+
+        static constexpr const std::size_t parameters = frozen_detail::sum_of({layer_type<I>::parameters...});
+        static constexpr const std::size_t max_size   = frozen_detail::max_of({layer_type<I>::input_size..., layer_type<I>::output_size...});
+    };
+
+    using helper_t = layers_helper<std::make_index_sequence<layers>>;
+
+public:
+    /*!
+     * \brief Memory used to propagate samples through the network.
+     *
+     * A workspace must not be used by several threads at the same time.
+     */
+    struct workspace {
+        explicit workspace(std::size_t batch)
+                : batch(batch), a(batch * helper_t::max_size), b(batch * helper_t::max_size) {}
+
+        std::size_t batch;                      ///< The maximum number of samples propagated at once
+        frozen_detail::aligned_buffer<weight> a; ///< The first buffer
+        frozen_detail::aligned_buffer<weight> b; ///< The second buffer
+    };
+
+    /*!
+     * \brief Freeze the given network
+     */
+    explicit frozen_dbn(const dbn_t& dbn)
+            : memory(helper_t::parameters) {
+        freeze_layers(dbn, std::make_index_sequence<layers>());
+    }
+
+    frozen_dbn(const frozen_dbn& rhs) = delete;
+    frozen_dbn& operator=(const frozen_dbn& rhs) = delete;
+
+    frozen_dbn(frozen_dbn&& rhs) = default;
+    frozen_dbn& operator=(frozen_dbn&& rhs) = default;
+
+    /*!
+     * \brief Returns the number of inputs of the network
+     */
+    static constexpr std::size_t input_size() noexcept {
+        return layer_type<0>::input_size;
+    }
+
+    /*!
+     * \brief Returns the number of outputs of the network
+     */
+    static constexpr std::size_t output_size() noexcept {
+        return layer_type<layers - 1>::output_size;
+    }
+
+    /*!
+     * \brief Creates a workspace to propagate up to batch samples at once
+     */
+    workspace make_workspace(std::size_t batch = 1) const {
+        return workspace(batch);
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for the
+     * given sample.
+     * \param ws The workspace
+     * \param sample The sample
+     * \return A pointer to the output_size() outputs, in the workspace
+     */
+    template <typename Sample>
+    const weight* activation_probabilities(workspace& ws, const Sample& sample) const {
+        cpp_assert(std::size_t(sample.size()) == input_size(), "Invalid sample size");
+
+        std::copy(sample.begin(), sample.end(), ws.a.get());
+
+        return forward<0>(ws.a.get(), ws.b.get(), ws.a.get(), 1);
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for the
+     * given sample into the given container.
+     * \param ws The workspace
+     * \param sample The sample
+     * \param output The container of size output_size() to fill
+     */
+    template <typename Sample, typename Output>
+    void activation_probabilities(workspace& ws, const Sample& sample, Output& output) const {
+        auto result = activation_probabilities(ws, sample);
+        std::copy(result, result + output_size(), output.begin());
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     */
+    template <typename Sample>
+    std::size_t predict(workspace& ws, const Sample& sample) const {
+        auto result = activation_probabilities(ws, sample);
+        return std::distance(result, std::max_element(result, result + output_size()));
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     */
+    template <typename Sample>
+    std::size_t predict(const Sample& sample) const {
+        auto ws = make_workspace();
+        return predict(ws, sample);
+    }
+
+    /*!
+     * \brief Predict the labels of a sequence of samples, propagated by
+     * batches of the size of the workspace.
+     * \param ws The workspace
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output label
+     */
+    template <typename Iterator, typename OutputIterator>
+    void predict_batch(workspace& ws, Iterator first, Iterator last, OutputIterator out) const {
+        while (first != last) {
+            std::size_t n = 0;
+
+            for (; n < ws.batch && first != last; ++n, ++first) {
+                cpp_assert(std::size_t(first->size()) == input_size(), "Invalid sample size");
+                std::copy(first->begin(), first->end(), ws.a.get() + n * input_size());
+            }
+
+            auto result = forward<0>(ws.a.get(), ws.b.get(), ws.a.get(), n);
+
+            for (std::size_t i = 0; i < n; ++i) {
+                auto sample_result = result + i * output_size();
+                *out = std::distance(sample_result, std::max_element(sample_result, sample_result + output_size()));
+                ++out;
+            }
+        }
+    }
+
+    /*!
+     * \brief Predict the labels of a sequence of samples.
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output label
+     * \param batch The number of samples propagated at once
+     */
+    template <typename Iterator, typename OutputIterator>
+    void predict_batch(Iterator first, Iterator last, OutputIterator out, std::size_t batch = 64) const {
+        auto ws = make_workspace(batch);
+        predict_batch(ws, first, last, out);
+    }
+
+private:
+    template <std::size_t... I>
+    void freeze_layers(const dbn_t& dbn, std::index_sequence<I...>) {
+        weight* current = memory.get();
+
+        int wormhole[] = {(std::get<I>(frozen_layers).freeze(dbn.template layer_get<I>(), current), current += layer_type<I>::parameters, 0)...};
+        cpp_unused(wormhole);
+    }
+
+    //The two buffers are used in turn as input and output of the layers
+
+    template <std::size_t I, cpp_enable_if(I < layers)>
+    const weight* forward(const weight* input, weight* output, weight* next, std::size_t n) const {
+        std::get<I>(frozen_layers).activate(input, output, n);
+        return forward<I + 1>(output, next, output, n);
+    }
+
+    template <std::size_t I, cpp_enable_if(I == layers)>
+    const weight* forward(const weight* input, weight* /*output*/, weight* /*next*/, std::size_t /*n*/) const {
+        return input;
+    }
+
+    frozen_detail::aligned_buffer<weight> memory; ///< The packed weights of all the layers
+    typename helper_t::type frozen_layers;        ///< The frozen layers
+};
+
+} //end of dll namespace
@@ -44,13 +44,15 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(detail::get_value<pipeline<0>, Parameters...>::value != 1, "A pipeline needs at least two buffers");
+    static_assert(detail::get_value<pipeline_producers<1>, Parameters...>::value > 0, "A pipeline needs at least one producer");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid<
             cpp::type_list<
                 trainer_id, watcher_id, momentum_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id,
-                memory_id, batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, lr_driver_id, shuffle_id>,
+                memory_id, batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, lr_driver_id, shuffle_id, pipeline_id, pipeline_producers_id, activation_cache_id, activation_storage_id>,
             Parameters...>::value,
         "Invalid parameters type");
 };
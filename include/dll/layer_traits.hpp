@@ -179,6 +179,15 @@ struct layer_traits {
         return detail::get_value_l<dll::batch_size<1>, typename layer_t::desc::parameters>::value;
     }
 
+    /*!
+     * \brief Returns the number of persistent chains of PCD
+     */
+    static constexpr std::size_t fantasy_particles() {
+        return detail::get_value_l<dll::fantasy_particles<0>, typename layer_t::desc::parameters>::value
+                   ? detail::get_value_l<dll::fantasy_particles<0>, typename layer_t::desc::parameters>::value
+                   : batch_size();
+    }
+
     static constexpr bool has_momentum() {
         return layer_t::desc::parameters::template contains<momentum>();
     }
@@ -191,6 +200,31 @@ struct layer_traits {
         return layer_t::desc::parameters::template contains<serial>();
     }
 
+    static constexpr bool is_hogwild() {
+        return layer_t::desc::parameters::template contains<hogwild>();
+    }
+
+    /*!
+     * \brief Returns the storage of the weights used by the batch Gibbs steps
+     */
+    static constexpr storage_type weight_storage() {
+        return detail::get_value_l<dll::weight_storage<storage_type::NATIVE>, typename layer_t::desc::parameters>::value;
+    }
+
+    /*!
+     * \brief Indicates if the batch Gibbs steps use low-precision weights
+     */
+    static constexpr bool is_mixed_precision() {
+        return weight_storage() != storage_type::NATIVE;
+    }
+
+    /*!
+     * \brief Indicates if the convolutions are computed with FFT
+     */
+    static constexpr bool is_fft_conv() {
+        return layer_t::desc::parameters::template contains<fft_conv>();
+    }
+
     static constexpr bool is_verbose() {
         return layer_t::desc::parameters::template contains<verbose>();
     }
@@ -223,6 +257,21 @@ struct layer_traits {
         return layer_t::desc::parameters::template contains<dll::init_weights>();
     }
 
+    /*!
+     * \brief Returns the policy selecting the batches on which the training
+     * metrics are computed
+     */
+    static constexpr dll::metrics_policy metrics_policy() {
+        return detail::get_value_l<dll::metrics<dll::metrics_policy::ALL>, typename layer_t::desc::parameters>::value;
+    }
+
+    /*!
+     * \brief Returns the period of the metrics policy
+     */
+    static constexpr std::size_t metrics_period() {
+        return detail::get_value_l<dll::metrics_period<1>, typename layer_t::desc::parameters>::value;
+    }
+
     static constexpr bool free_energy() {
         return layer_t::desc::parameters::template contains<dll::free_energy>();
     }
@@ -241,6 +290,16 @@ constexpr std::size_t get_batch_size(const RBM&) {
     return layer_traits<RBM>::batch_size();
 }
 
+template <typename RBM, cpp_enable_if(layer_traits<RBM>::is_dynamic())>
+std::size_t get_fantasy_particles(const RBM& rbm) {
+    return rbm.fantasy_particles ? rbm.fantasy_particles : rbm.batch_size;
+}
+
+template <typename RBM, cpp_disable_if(layer_traits<RBM>::is_dynamic())>
+constexpr std::size_t get_fantasy_particles(const RBM&) {
+    return layer_traits<RBM>::fantasy_particles();
+}
+
 template <typename RBM, cpp_enable_if(layer_traits<RBM>::is_dynamic())>
 std::size_t num_visible(const RBM& rbm) {
     return rbm.num_visible;
@@ -0,0 +1,25 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DLL_METRICS_POLICY_HPP
+#define DLL_METRICS_POLICY_HPP
+
+namespace dll {
+
+/*!
+ * \brief Define on which batches the training metrics (reconstruction error,
+ * sparsity and free energy) are computed
+ */
+enum class metrics_policy {
+    ALL,      ///< Every batch
+    PERIODIC, ///< Every Nth batch of each epoch
+    SAMPLED   ///< Each batch with a probability of 1/N
+};
+
+} //end of dll namespace
+
+#endif
@@ -0,0 +1,416 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file quantized_dbn.hpp
+ * \brief 8-bit quantized inference-only version of a trained DBN.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include <numeric>
+
+#include "frozen_dbn.hpp"
+#include "util/int8.hpp"
+
+namespace dll {
+
+namespace quantized_detail {
+
+/*!
+ * \brief The quantized version of a layer.
+ */
+template <typename Layer, typename W, typename Enable = void>
+struct quantized_layer {
+    static_assert(!std::is_same<Layer, Layer>::value, "Only dense and RBM layers can be quantized");
+};
+
+/*!
+ * \brief Quantized fully-connected layer (dense layer or RBM).
+ *
+ * The weights are quantized to int8 with one scale per column (per hidden
+ * unit) and the inputs are quantized to int8 with a single scale obtained
+ * by calibration. The biases are kept in floating point.
+ */
+template <typename Layer, typename W>
+struct quantized_layer<Layer, W, std::enable_if_t<is_dense<Layer>::value && !layer_traits<Layer>::is_dynamic()>> {
+    static constexpr const std::size_t NV  = Layer::num_visible;
+    static constexpr const std::size_t NH  = Layer::num_hidden;
+    static constexpr const std::size_t NVP = int8::padded_size(NV);
+
+    static constexpr const frozen_detail::activation A = frozen_detail::layer_activation<Layer>::value;
+
+    static constexpr const std::size_t input_size        = NV;
+    static constexpr const std::size_t output_size       = NH;
+    static constexpr const std::size_t padded_input_size = NVP;
+
+    frozen_detail::aligned_buffer<std::int8_t> w; ///< The quantized weights, one padded row per hidden unit
+    std::vector<std::int32_t> w_sums;             ///< The sum of the quantized weights of each hidden unit
+    std::vector<W> w_scales;                      ///< The scale of the weights of each hidden unit
+    std::vector<W> b;                             ///< The hidden biases
+    W input_scale = W(1);                         ///< The scale of the inputs
+
+    /*!
+     * \brief Quantize the weights of the given layer
+     * \param layer The layer to quantize
+     * \param input_max The maximum absolute value of the inputs observed during calibration
+     */
+    void quantize(const Layer& layer, W input_max) {
+        w = frozen_detail::aligned_buffer<std::int8_t>(NH * NVP);
+        w_sums.assign(NH, 0);
+        w_scales.assign(NH, W(1));
+        b.assign(layer.b.begin(), layer.b.end());
+
+        input_scale = input_max > W(0) ? input_max / W(127) : W(1);
+
+        std::vector<W> column(NV);
+
+        for (std::size_t j = 0; j < NH; ++j) {
+            W max(0);
+
+            for (std::size_t i = 0; i < NV; ++i) {
+                column[i] = layer.w(i, j);
+                max       = std::max(max, std::abs(column[i]));
+            }
+
+            w_scales[j] = max > W(0) ? max / W(127) : W(1);
+
+            int8::quantize(column.data(), w.get() + j * NVP, NV, w_scales[j]);
+
+            w_sums[j] = std::accumulate(w.get() + j * NVP, w.get() + (j + 1) * NVP, std::int32_t(0));
+        }
+    }
+
+    /*!
+     * \brief Compute the outputs of n contiguous samples
+     * \param input The inputs
+     * \param output The outputs
+     * \param n The number of samples
+     * \param x_q Memory for the n quantized inputs
+     * \param acc Memory for the n x NH integer accumulators
+     */
+    void activate(const W* input, W* output, std::size_t n, std::int8_t* x_q, std::int32_t* acc) const {
+        for (std::size_t s = 0; s < n; ++s) {
+            int8::quantize(input + s * NV, x_q + s * NVP, NV, input_scale);
+        }
+
+        int8::gemm(x_q, w.get(), w_sums.data(), acc, n, NH, NVP);
+
+        for (std::size_t s = 0; s < n; ++s) {
+            W* out = output + s * NH;
+
+            for (std::size_t j = 0; j < NH; ++j) {
+                out[j] = W(acc[s * NH + j]) * input_scale * w_scales[j] + b[j];
+            }
+
+            frozen_detail::activate<A>(out, NH);
+        }
+    }
+};
+
+} //end of namespace quantized_detail
+
+/*!
+ * \brief Accuracy of a quantized network compared to its floating point
+ * version
+ */
+struct quantization_report {
+    std::size_t samples     = 0; ///< The number of samples evaluated
+    double float_error      = 0; ///< The classification error of the floating point network
+    double quantized_error  = 0; ///< The classification error of the quantized network
+    double agreement        = 0; ///< The ratio of samples with the same predicted label
+    double max_output_error = 0; ///< The maximum absolute difference of the outputs
+
+    void display() const {
+        printf("Quantization report (%lu samples)\n", samples);
+        printf("  float error:      %.5f\n", float_error);
+        printf("  quantized error:  %.5f\n", quantized_error);
+        printf("  agreement:        %.5f\n", agreement);
+        printf("  max output error: %.5f\n", max_output_error);
+    }
+};
+
+/*!
+ * \brief 8-bit quantized inference-only version of a trained DBN.
+ *
+ * The weights of each layer are quantized to int8 with one scale per hidden
+ * unit. The scale of the inputs of each layer is computed on a calibration
+ * set, from the activations of the floating point network. Each layer
+ * quantizes its inputs, computes the integer products with an int8 GEMM and
+ * then applies the scales, the biases and the activation function in a single
+ * pass.
+ *
+ * The int8 kernel uses AVX-512 VNNI or AVX2 if available at compile time and
+ * a scalar implementation otherwise.
+ *
+ * Only dense layers and standard RBMs are supported.
+ */
+template <typename DBN>
+struct quantized_dbn {
+    using dbn_t  = DBN;                    ///< The type of the original network
+    using weight = typename dbn_t::weight; ///< The type of the weights
+
+    static constexpr const std::size_t layers = dbn_t::layers; ///< The number of layers
+
+    template <std::size_t I>
+    using layer_type = quantized_detail::quantized_layer<typename dbn_t::template layer_type<I>, weight>; ///< The type of the Ith quantized layer
+
+private:
+    template <typename Sequence>
+    struct layers_helper;
+
+    template <std::size_t... I>
+    struct layers_helper<std::index_sequence<I...>> {
+        using type = std::tuple<layer_type<I>...>;
+
+        static constexpr const std::size_t max_size       = frozen_detail::max_of({layer_type<I>::input_size..., layer_type<I>::output_size...});
+        static constexpr const std::size_t max_input_size = frozen_detail::max_of({layer_type<I>::padded_input_size...});
+    };
+
+    using helper_t = layers_helper<std::make_index_sequence<layers>>;
+
+public:
+    /*!
+     * \brief Memory used to propagate samples through the network.
+     *
+     * A workspace must not be used by several threads at the same time.
+     */
+    struct workspace {
+        explicit workspace(std::size_t batch)
+                : batch(batch),
+                  a(batch * helper_t::max_size),
+                  b(batch * helper_t::max_size),
+                  x_q(batch * helper_t::max_input_size),
+                  acc(batch * helper_t::max_size) {}
+
+        std::size_t batch;                               ///< The maximum number of samples propagated at once
+        frozen_detail::aligned_buffer<weight> a;         ///< The first buffer
+        frozen_detail::aligned_buffer<weight> b;         ///< The second buffer
+        frozen_detail::aligned_buffer<std::int8_t> x_q;  ///< The quantized inputs of the current layer
+        frozen_detail::aligned_buffer<std::int32_t> acc; ///< The integer accumulators
+    };
+
+    /*!
+     * \brief Quantize the given network, calibrating the scale of the inputs of
+     * each layer on the given samples.
+     * \param dbn The network to quantize
+     * \param first Iterator to the first calibration sample
+     * \param last Iterator to the last calibration sample
+     */
+    template <typename Iterator>
+    quantized_dbn(const dbn_t& dbn, Iterator first, Iterator last) {
+        cpp_assert(first != last, "Quantization needs calibration samples");
+
+        using sample_t = std::decay_t<decltype(*first)>;
+
+        std::vector<weight> input_max(layers, weight(0));
+
+        auto context = dbn.template make_inference_context<sample_t>();
+
+        for (; first != last; ++first) {
+            dbn.activation_probabilities(context, *first);
+
+            input_max[0] = std::max(input_max[0], max_abs(*first));
+            calibrate(context, input_max, std::make_index_sequence<layers - 1>());
+        }
+
+        quantize_layers(dbn, input_max, std::make_index_sequence<layers>());
+    }
+
+    quantized_dbn(const quantized_dbn& rhs) = delete;
+    quantized_dbn& operator=(const quantized_dbn& rhs) = delete;
+
+    quantized_dbn(quantized_dbn&& rhs) = default;
+    quantized_dbn& operator=(quantized_dbn&& rhs) = default;
+
+    /*!
+     * \brief Returns the number of inputs of the network
+     */
+    static constexpr std::size_t input_size() noexcept {
+        return layer_type<0>::input_size;
+    }
+
+    /*!
+     * \brief Returns the number of outputs of the network
+     */
+    static constexpr std::size_t output_size() noexcept {
+        return layer_type<layers - 1>::output_size;
+    }
+
+    /*!
+     * \brief Creates a workspace to propagate up to batch samples at once
+     */
+    workspace make_workspace(std::size_t batch = 1) const {
+        return workspace(batch);
+    }
+
+    /*!
+     * \brief Computes the activation probabilities of the last layer for the
+     * given sample.
+     * \param ws The workspace
+     * \param sample The sample
+     * \return A pointer to the output_size() outputs, in the workspace
+     */
+    template <typename Sample>
+    const weight* activation_probabilities(workspace& ws, const Sample& sample) const {
+        cpp_assert(std::size_t(sample.size()) == input_size(), "Invalid sample size");
+
+        std::copy(sample.begin(), sample.end(), ws.a.get());
+
+        return forward<0>(ws, ws.a.get(), ws.b.get(), ws.a.get(), 1);
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     */
+    template <typename Sample>
+    std::size_t predict(workspace& ws, const Sample& sample) const {
+        auto result = activation_probabilities(ws, sample);
+        return std::distance(result, std::max_element(result, result + output_size()));
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     */
+    template <typename Sample>
+    std::size_t predict(const Sample& sample) const {
+        auto ws = make_workspace();
+        return predict(ws, sample);
+    }
+
+    /*!
+     * \brief Predict the labels of a sequence of samples, propagated by
+     * batches of the size of the workspace.
+     * \param ws The workspace
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output label
+     */
+    template <typename Iterator, typename OutputIterator>
+    void predict_batch(workspace& ws, Iterator first, Iterator last, OutputIterator out) const {
+        while (first != last) {
+            std::size_t n = 0;
+
+            for (; n < ws.batch && first != last; ++n, ++first) {
+                cpp_assert(std::size_t(first->size()) == input_size(), "Invalid sample size");
+                std::copy(first->begin(), first->end(), ws.a.get() + n * input_size());
+            }
+
+            auto result = forward<0>(ws, ws.a.get(), ws.b.get(), ws.a.get(), n);
+
+            for (std::size_t i = 0; i < n; ++i) {
+                auto sample_result = result + i * output_size();
+                *out = std::distance(sample_result, std::max_element(sample_result, sample_result + output_size()));
+                ++out;
+            }
+        }
+    }
+
+    /*!
+     * \brief Predict the labels of a sequence of samples.
+     * \param first Iterator to the first sample
+     * \param last Iterator to the last sample
+     * \param out Iterator to the first output label
+     * \param batch The number of samples propagated at once
+     */
+    template <typename Iterator, typename OutputIterator>
+    void predict_batch(Iterator first, Iterator last, OutputIterator out, std::size_t batch = 64) const {
+        auto ws = make_workspace(batch);
+        predict_batch(ws, first, last, out);
+    }
+
+private:
+    template <typename Sample>
+    static weight max_abs(const Sample& sample) {
+        weight max(0);
+        for (auto v : sample) {
+            max = std::max(max, weight(std::abs(v)));
+        }
+        return max;
+    }
+
+    template <typename Context, std::size_t... I>
+    static void calibrate(const Context& context, std::vector<weight>& input_max, std::index_sequence<I...>) {
+        int wormhole[] = {0, (input_max[I + 1] = std::max(input_max[I + 1], max_abs(context.template output<I>())), 0)...};
+        cpp_unused(wormhole);
+    }
+
+    template <std::size_t... I>
+    void quantize_layers(const dbn_t& dbn, const std::vector<weight>& input_max, std::index_sequence<I...>) {
+        int wormhole[] = {(std::get<I>(quantized_layers).quantize(dbn.template layer_get<I>(), input_max[I]), 0)...};
+        cpp_unused(wormhole);
+    }
+
+    //The two buffers are used in turn as input and output of the layers
+
+    template <std::size_t I, cpp_enable_if(I < layers)>
+    const weight* forward(workspace& ws, const weight* input, weight* output, weight* next, std::size_t n) const {
+        std::get<I>(quantized_layers).activate(input, output, n, ws.x_q.get(), ws.acc.get());
+        return forward<I + 1>(ws, output, next, output, n);
+    }
+
+    template <std::size_t I, cpp_enable_if(I == layers)>
+    const weight* forward(workspace& /*ws*/, const weight* input, weight* /*output*/, weight* /*next*/, std::size_t /*n*/) const {
+        return input;
+    }
+
+    typename helper_t::type quantized_layers; ///< The quantized layers
+};
+
+/*!
+ * \brief Compare the classification accuracy of a quantized network with the
+ * accuracy of its floating point version.
+ * \param dbn The floating point network
+ * \param quantized The quantized network
+ * \param samples The samples
+ * \param labels The labels of the samples
+ * \return The accuracy report
+ */
+template <typename DBN, typename Samples, typename Labels>
+quantization_report evaluate_quantization(const DBN& dbn, const quantized_dbn<DBN>& quantized, const Samples& samples, const Labels& labels) {
+    quantization_report report;
+
+    auto ws      = quantized.make_workspace();
+    auto context = dbn.template make_inference_context<etl::value_t<Samples>>();
+
+    std::size_t float_errors     = 0;
+    std::size_t quantized_errors = 0;
+    std::size_t same             = 0;
+
+    auto label_it = labels.begin();
+
+    for (auto& sample : samples) {
+        auto& expected = dbn.activation_probabilities(context, sample);
+        auto result    = quantized.activation_probabilities(ws, sample);
+
+        for (std::size_t j = 0; j < quantized.output_size(); ++j) {
+            report.max_output_error = std::max(report.max_output_error, double(std::abs(expected[j] - result[j])));
+        }
+
+        std::size_t float_label     = dbn.predict_label(expected);
+        std::size_t quantized_label = std::distance(result, std::max_element(result, result + quantized.output_size()));
+
+        float_errors += float_label != std::size_t(*label_it);
+        quantized_errors += quantized_label != std::size_t(*label_it);
+        same += float_label == quantized_label;
+
+        ++label_it;
+        ++report.samples;
+    }
+
+    if (report.samples) {
+        report.float_error     = float_errors / double(report.samples);
+        report.quantized_error = quantized_errors / double(report.samples);
+        report.agreement       = same / double(report.samples);
+    }
+
+    return report;
+}
+
+} //end of dll namespace
@@ -160,6 +160,24 @@ struct rbm final : public standard_rbm<rbm<Desc>, Desc> {
         base_type::template batch_std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w);
     }
 
+    /*!
+     * \brief Compute the hidden activations of a batch with the given
+     * weights, for instance a low-precision copy of w
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename W>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const W& weights) const {
+        base_type::template batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, weights);
+    }
+
+    /*!
+     * \brief Compute the visible activations of a batch with the given
+     * weights, for instance a low-precision copy of w
+     */
+    template <bool P = true, bool S = true, typename H, typename V, typename W>
+    void batch_activate_visible(const H& h_a, const H& h_s, V&& v_a, V&& v_s, const W& weights) const {
+        base_type::template batch_std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, weights);
+    }
+
     template <typename Sample, typename Output>
     void activation_probabilities(const Sample& item_data, Output& result) const {
         etl::fast_dyn_vector<weight, num_visible> item(item_data);
@@ -188,6 +206,16 @@ struct rbm final : public standard_rbm<rbm<Desc>, Desc> {
         activate_hidden(h_a, etl::reshape<num_visible>(v_a));
     }
 
+    template <typename H, typename V, typename T, cpp_enable_if(etl::decay_traits<V>::dimensions() == 1)>
+    void activate_hidden(H&& h_a, const V& v_a, T&& t) const {
+        base_type::template std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, b, w, std::forward<T>(t));
+    }
+
+    template <typename H, typename V, typename T, cpp_enable_if(etl::decay_traits<V>::dimensions() != 1)>
+    void activate_hidden(H&& h_a, const V& v_a, T&& t) const {
+        activate_hidden(h_a, etl::reshape<num_visible>(v_a), std::forward<T>(t));
+    }
+
     template <typename H, typename V, cpp_enable_if(etl::decay_traits<V>::dimensions() == 2)>
     void batch_activate_hidden(H&& h_a, const V& v_a) const {
         base_type::template batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, b, w);
@@ -11,6 +11,8 @@
 #include <iosfwd>
 #include <fstream>
 
+#include "cpp_utils/static_if.hpp"
+
 #include "neural_base.hpp"
 #include "util/io.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
@@ -49,6 +51,8 @@ struct rbm_base : neural_base<Parent> {
     weight pbias        = 0.002;
     weight pbias_lambda = 5;
 
+    std::size_t hogwild_threads = 0; ///< The number of threads of Hogwild training (0 for etl::threads)
+
     //No copying
 
     rbm_base(const rbm_base& rbm) = delete;
@@ -130,6 +134,11 @@ private:
         binary_load_all(is, rbm.w);
         binary_load_all(is, rbm.b);
         binary_load_all(is, rbm.c);
+
+        //The cached flipped weights are not valid anymore
+        cpp::static_if<layer_traits<parent_t>::is_convolutional_rbm_layer()>([&](auto f) {
+            f(rbm).weights_changed();
+        });
     }
 
     static void store(const std::string& file, const parent_t& rbm) {
@@ -28,10 +28,11 @@ struct rbm_desc {
 
     using parameters = cpp::type_list<Parameters...>;
 
-    static constexpr const std::size_t BatchSize    = detail::get_value<batch_size<1>, Parameters...>::value;
-    static constexpr const unit_type visible_unit   = detail::get_value<visible<unit_type::BINARY>, Parameters...>::value;
-    static constexpr const unit_type hidden_unit    = detail::get_value<hidden<unit_type::BINARY>, Parameters...>::value;
-    static constexpr const sparsity_method Sparsity = detail::get_value<sparsity<sparsity_method::NONE>, Parameters...>::value;
+    static constexpr const std::size_t BatchSize      = detail::get_value<batch_size<1>, Parameters...>::value;
+    static constexpr const unit_type visible_unit     = detail::get_value<visible<unit_type::BINARY>, Parameters...>::value;
+    static constexpr const unit_type hidden_unit      = detail::get_value<hidden<unit_type::BINARY>, Parameters...>::value;
+    static constexpr const sparsity_method Sparsity   = detail::get_value<sparsity<sparsity_method::NONE>, Parameters...>::value;
+    static constexpr const storage_type WeightStorage = detail::get_value<weight_storage<storage_type::NATIVE>, Parameters...>::value;
 
     /*! The type used to store the weights */
     using weight = typename detail::get_type<weight_type<float>, Parameters...>::value;
@@ -56,10 +57,19 @@ struct rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid<cpp::type_list<momentum_id, parallel_mode_id, serial_id, verbose_id, batch_size_id, visible_id, hidden_id, weight_decay_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, watcher_id, weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id>,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, watcher_id, weight_type_id, shuffle_id, free_energy_id, dbn_only_id,
+                                        fantasy_particles_id, hogwild_id, weight_storage_id, metrics_id, metrics_period_id, nop_id>,
                          Parameters...>::value,
         "Invalid parameters type for rbm_desc");
 
+    static_assert(!(parameters::template contains<hogwild>() && parameters::template contains<parallel_mode>()),
+                  "Hogwild and parallel mode cannot be used together");
+
+    static_assert(WeightStorage != storage_type::UINT8, "The weights can only be stored as float16 or bfloat16");
+
+    static_assert(WeightStorage == storage_type::NATIVE || !parameters::template contains<parallel_mode>(),
+                  "Low-precision weights are only supported in batch mode");
+
     static_assert(BatchSize > 0, "Batch size must be at least 1");
 
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
@@ -8,11 +8,14 @@
 #ifndef DLL_STANDARD_CONV_RBM_HPP
 #define DLL_STANDARD_CONV_RBM_HPP
 
-#include "base_conf.hpp"    //The configuration helpers
-#include "rbm_base.hpp"     //The base class
-#include "layer_traits.hpp" //layer_traits
-#include "util/checks.hpp"  //nan_check
-#include "util/timers.hpp"  //auto_timer
+#include "base_conf.hpp"         //The configuration helpers
+#include "rbm_base.hpp"          //The base class
+#include "layer_traits.hpp"      //layer_traits
+#include "util/checks.hpp"       //nan_check
+#include "util/timers.hpp"       //auto_timer
+#include "util/sampling.hpp"     //Sampling of the units
+#include "util/conv_engine.hpp"  //im2col convolutions
+#include "util/fft_conv.hpp"     //FFT convolutions
 
 namespace dll {
 
@@ -85,27 +88,17 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
     }
 
 protected:
-    template <typename W>
-    static void deep_fflip(W&& w_f) {
-        //flip all the kernels horizontally and vertically
-
-        for (std::size_t channel = 0; channel < etl::dim<0>(w_f); ++channel) {
-            for (size_t k = 0; k < etl::dim<1>(w_f); ++k) {
-                w_f(channel)(k).fflip_inplace();
-            }
-        }
-    }
-
+    /*!
+     * \brief Compute the valid convolution of the visible units with the
+     * kernels.
+     * \param w_f The already flipped weights (see flipped_w())
+     */
     template <typename L, typename V1, typename VCV, typename W>
-    static void compute_vcv(const V1& v_a, VCV&& v_cv, W&& w) {
+    static void compute_vcv(const V1& v_a, VCV&& v_cv, W&& w_f) {
         dll::auto_timer timer("crbm:compute_vcv");
 
         static constexpr const auto NC = L::NC;
 
-        auto w_f = etl::force_temporary(w);
-
-        deep_fflip(w_f);
-
         v_cv(1) = 0;
 
         for (std::size_t channel = 0; channel < NC; ++channel) {
@@ -136,6 +129,36 @@ protected:
         }
     }
 
+    /*!
+     * \brief Compute the valid convolution of the visible units with the
+     * kernels, in the frequency domain.
+     * \param w_s The spectra of the weights (see fft_conv)
+     */
+    template <typename L, typename V1, typename VCV, typename T>
+    static void compute_vcv(const V1& v_a, VCV&& v_cv, const conv_spectra<T>& w_s) {
+        dll::auto_timer timer("crbm:compute_vcv:fft");
+
+        const auto* v_f = w_s.transform(v_a.memory_start(), L::NC, L::NV1, L::NV2);
+
+        w_s.valid(v_f, [&](std::size_t k) { return v_cv(1)(k).memory_start(); });
+
+        nan_check_deep(v_cv);
+    }
+
+    template <typename L, typename H2, typename HCV, typename T, typename Functor>
+    static void compute_hcv(const H2& h_s, HCV&& h_cv, const conv_spectra<T>& w_s, Functor activate) {
+        dll::auto_timer timer("crbm:compute_hcv:fft");
+
+        //The hidden units are transformed once for all the channels
+        const auto* h_f = w_s.transform(h_s.memory_start(), L::K, L::NH1, L::NH2);
+
+        for (std::size_t channel = 0; channel < L::NC; ++channel) {
+            w_s.full(h_f, channel, h_cv(1).memory_start());
+
+            activate(channel);
+        }
+    }
+
 #ifdef ETL_MKL_MODE
 
     template <typename F1, typename F2>
@@ -221,22 +244,56 @@ protected:
 
 #endif
 
-    template <typename L, typename TP, typename V1, typename VCV, typename W, typename Functor>
-    static void batch_compute_vcv(TP& pool, const V1& v_a, VCV&& v_cv, W&& w, Functor activate) {
+    template <typename L, typename TP, typename T, typename V1, typename VCV, typename W, typename Functor>
+    static void batch_compute_vcv(TP& pool, im2col_scratch<T>& scratch, const V1& v_a, VCV&& v_cv, W&& w, Functor activate) {
         dll::auto_timer timer("crbm:batch_compute_vcv");
 
         static constexpr const auto Batch = layer_traits<L>::batch_size();
 
-        static constexpr const auto NC = L::NC;
+        static constexpr const auto K     = L::K;
+        static constexpr const auto image = L::NH1 * L::NH2;
+
+        //One chunk of the batch per thread, each in a single matrix multiplication
+        const std::size_t chunks = layer_traits<L>::is_serial() ? 1 : std::min(std::size_t(Batch), std::size_t(etl::threads));
+
+        batch_conv_valid_im2col(pool, chunks, scratch, v_a, w, [&](std::size_t batch, std::size_t k) {
+            return v_cv.memory_start() + ((batch * etl::dim<1>(v_cv) + 1) * K + k) * image;
+        });
+
+        maybe_parallel_foreach_n(pool, 0, Batch, [&](std::size_t batch) {
+            activate(batch);
+        });
+    }
+
+    template <typename L, typename TP, typename H2, typename HCV, typename T, typename Functor>
+    static void batch_compute_hcv(TP& pool, const H2& h_s, HCV&& h_cv, const conv_spectra<T>& w_s, Functor activate) {
+        dll::auto_timer timer("crbm:batch_compute_hcv:fft");
+
+        static constexpr const auto Batch = layer_traits<L>::batch_size();
 
         maybe_parallel_foreach_n(pool, 0, Batch, [&](std::size_t batch) {
-            etl::conv_2d_valid_multi_flipped(v_a(batch)(0), w(0), v_cv(batch)(1));
+            //The hidden units of the sample are transformed once for all the channels
+            const auto* h_f = w_s.transform(h_s(batch).memory_start(), L::K, L::NH1, L::NH2);
 
-            for (std::size_t channel = 1; channel < NC; ++channel) {
-                etl::conv_2d_valid_multi_flipped(v_a(batch)(channel), w(channel), v_cv(batch)(0));
+            for (std::size_t channel = 0; channel < L::NC; ++channel) {
+                w_s.full(h_f, channel, h_cv(batch)(1).memory_start());
 
-                v_cv(batch)(1) += v_cv(batch)(0);
+                activate(batch, channel);
             }
+        });
+    }
+
+    template <typename L, typename TP, typename V1, typename VCV, typename T, typename Functor>
+    static void batch_compute_vcv(TP& pool, im2col_scratch<T>& /*scratch*/, const V1& v_a, VCV&& v_cv, const conv_spectra<T>& w_s, Functor activate) {
+        dll::auto_timer timer("crbm:batch_compute_vcv:fft");
+
+        static constexpr const auto Batch = layer_traits<L>::batch_size();
+
+        maybe_parallel_foreach_n(pool, 0, Batch, [&](std::size_t batch) {
+            //The visible units of the sample are transformed once for all the kernels
+            const auto* v_f = w_s.transform(v_a(batch).memory_start(), L::NC, L::NV1, L::NV2);
+
+            w_s.valid(v_f, [&](std::size_t k) { return v_cv(batch)(1)(k).memory_start(); });
 
             activate(batch);
         });
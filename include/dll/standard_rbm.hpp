@@ -20,12 +20,15 @@
 
 #include "etl/etl.hpp"
 
-#include "util/io.hpp"     //Input/Output
-#include "util/checks.hpp" //NaN checks
-#include "util/timers.hpp" //auto_timer
-#include "rbm_base.hpp"    //The base class
-#include "base_conf.hpp"   //Descriptor configuration
-#include "rbm_tmp.hpp"     // static_if macros
+#include "util/io.hpp"            //Input/Output
+#include "util/checks.hpp"        //NaN checks
+#include "util/timers.hpp"        //auto_timer
+#include "util/sampling.hpp"      //Sampling of the units
+#include "util/low_precision.hpp" //Low-precision weights
+#include "util/sparse.hpp"        //Sparse inputs
+#include "rbm_base.hpp"           //The base class
+#include "base_conf.hpp"          //Descriptor configuration
+#include "rbm_tmp.hpp"            // static_if macros
 
 namespace dll {
 
@@ -92,6 +95,15 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         return free_energy(rbm, rbm.v1);
     }
 
+    /*!
+     * \brief Returns the sum of the free energies of the first n samples of
+     * the given batch
+     */
+    template <typename V>
+    weight batch_free_energy(const V& v, std::size_t n) const {
+        return batch_free_energy(as_derived(), v, n);
+    }
+
     //Various functions
 
     template <typename Iterator>
@@ -292,32 +304,63 @@ protected:
         return free_energy(rbm, ev);
     }
 
+    //The free energies of a batch are computed from a single matrix-matrix
+    //multiplication for all the samples
+
+    template <typename V>
+    static weight batch_free_energy(const parent_t& rbm, const V& v, std::size_t n) {
+        dll::auto_timer timer("rbm:std:batch_free_energy");
+
+        cpp_assert(n <= etl::dim<0>(v), "Invalid number of samples");
+
+        if (hidden_unit != unit_type::BINARY || (visible_unit != unit_type::BINARY && visible_unit != unit_type::GAUSSIAN)) {
+            return 0.0;
+        }
+
+        auto x = etl::force_temporary(v * rbm.w);
+
+        weight energy = 0.0;
+
+        for (std::size_t b = 0; b < n; ++b) {
+            if (visible_unit == unit_type::BINARY) {
+                energy += -etl::dot(rbm.c, v(b)) - etl::sum(etl::log(1.0 + etl::exp(rbm.b + x(b))));
+            } else {
+                energy += etl::sum(etl::pow(v(b) - rbm.c, 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(rbm.b + x(b))));
+            }
+        }
+
+        return energy;
+    }
+
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W, typename T>
     static void std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w, T&& t) {
         dll::auto_timer timer("rbm:std:activate_hidden");
 
         using namespace etl;
 
+        //Compute the pre-activation only once
+        t = v_a * w;
+
         //Compute activation probabilities
-        H_PROBS(unit_type::BINARY, f(h_a) = sigmoid(b + (t = v_a * w)));
-        H_PROBS(unit_type::RELU, f(h_a) = max(b + (t = v_a * w), 0.0));
-        H_PROBS(unit_type::RELU6, f(h_a) = min(max(b + (t = v_a * w), 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, f(h_a) = min(max(b + (t = v_a * w), 0.0), 1.0));
-        H_PROBS(unit_type::SOFTMAX, f(h_a) = stable_softmax(b + (t = v_a * w)));
+        H_PROBS(unit_type::BINARY, f(h_a) = sigmoid(b + t));
+        H_PROBS(unit_type::RELU, f(h_a) = max(b + t, 0.0));
+        H_PROBS(unit_type::RELU6, f(h_a) = min(max(b + t, 0.0), 6.0));
+        H_PROBS(unit_type::RELU1, f(h_a) = min(max(b + t, 0.0), 1.0));
+        H_PROBS(unit_type::SOFTMAX, f(h_a) = stable_softmax(b + t));
 
         //Sample values from input
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(b + (t = v_a * w)), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(b + t), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
         H_SAMPLE_PROBS(unit_type::SOFTMAX, f(h_s) = one_if_max(h_a));
 
         //Sample values from probs
-        H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = bernoulli(sigmoid(b + (t = v_a * w))));
-        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(logistic_noise(b + (t = v_a * w)), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = ranged_noise(min(max(b + (t = v_a * w), 0.0), 6.0), 6.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = ranged_noise(min(max(b + (t = v_a * w), 0.0), 6.0), 1.0));
-        H_SAMPLE_INPUT(unit_type::SOFTMAX, f(h_s) = one_if_max(stable_softmax(b + (t = v_a * w))));
+        H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = dll::bernoulli(sigmoid(b + t)));
+        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(dll::logistic_noise(b + t), 0.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = dll::ranged_noise(min(max(b + t, 0.0), 6.0), 6.0));
+        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = dll::ranged_noise(min(max(b + t, 0.0), 6.0), 1.0));
+        H_SAMPLE_INPUT(unit_type::SOFTMAX, f(h_s) = one_if_max(stable_softmax(b + t)));
 
         if (P) {
             nan_check_deep(h_a);
@@ -334,13 +377,16 @@ protected:
 
         using namespace etl;
 
-        V_PROBS(unit_type::BINARY, f(v_a) = sigmoid(c + (t = w * h_s)));
-        V_PROBS(unit_type::GAUSSIAN, f(v_a) = c + (t = w * h_s));
-        V_PROBS(unit_type::RELU, f(v_a) = max(c + (t = w * h_s), 0.0));
+        //Compute the pre-activation only once
+        t = w * h_s;
 
-        V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = bernoulli(sigmoid(c + (t = w * h_s))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = normal_noise(c + (t = w * h_s)));
-        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = logistic_noise(max(c + (t = w * h_s), 0.0)));
+        V_PROBS(unit_type::BINARY, f(v_a) = sigmoid(c + t));
+        V_PROBS(unit_type::GAUSSIAN, f(v_a) = c + t);
+        V_PROBS(unit_type::RELU, f(v_a) = max(c + t, 0.0));
+
+        V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = dll::bernoulli(sigmoid(c + t)));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(c + t));
+        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = dll::logistic_noise(max(c + t, 0.0)));
 
         if (P) {
             nan_check_deep(v_a);
@@ -351,6 +397,15 @@ protected:
         }
     }
 
+    /*!
+     * \brief Compute the hidden activations of a batch.
+     *
+     * The pre-activation b + v_a * w is computed only once, directly into the
+     * output (h_a, or h_s if the probabilities are not computed), which is
+     * then transformed in place. ReLU samples are drawn from the
+     * pre-activation before the probabilities are computed. w can also be a
+     * low-precision copy of the weights and v_a a sparse (CSR) batch.
+     */
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     static void batch_std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) {
         dll::auto_timer timer("rbm:std:batch_activate_hidden");
@@ -359,26 +414,36 @@ protected:
 
         const auto Batch = etl::dim<0>(h_a);
 
-        cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
+        cpp_assert(etl::dim<0>(h_s) == Batch && dll::batch_rows(v_a) == Batch, "The number of batch must be consistent");
+
+        //Compute the pre-activation only once, in place
+        cpp::static_if<P>([&](auto f) {
+            dll::hidden_pre_activation(f(h_a), v_a, w);
+            f(h_a) += rep_l(b, Batch);
+        });
+
+        cpp::static_if<!P && S>([&](auto f) {
+            dll::hidden_pre_activation(f(h_s), v_a, w);
+            f(h_s) += rep_l(b, Batch);
+        });
+
+        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(dll::logistic_noise(h_a), 0.0));
 
-        H_PROBS(unit_type::BINARY, f(h_a) = sigmoid(rep_l(b, Batch) + v_a * w));
-        H_PROBS(unit_type::RELU, f(h_a) = max(rep_l(b, Batch) + v_a * w, 0.0));
-        H_PROBS(unit_type::RELU6, f(h_a) = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
-        H_PROBS(unit_type::RELU1, f(h_a) = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
+        H_PROBS(unit_type::BINARY, f(h_a) = sigmoid(h_a));
+        H_PROBS(unit_type::RELU, f(h_a) = max(h_a, 0.0));
+        H_PROBS(unit_type::RELU6, f(h_a) = min(max(h_a, 0.0), 6.0));
+        H_PROBS(unit_type::RELU1, f(h_a) = min(max(h_a, 0.0), 1.0));
 
         H_PROBS_MULTI(unit_type::SOFTMAX)
         ([&](auto f) {
-            auto x = f(etl::force_temporary(rep_l(b, Batch) + v_a * w));
-
             for (std::size_t b = 0; b < Batch; ++b) {
-                f(h_a)(b) = stable_softmax(x(b));
+                f(h_a)(b) = stable_softmax(h_a(b));
             }
         });
 
-        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, f(h_s) = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = ranged_noise(h_a, 6.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = ranged_noise(h_a, 1.0));
+        H_SAMPLE_PROBS(unit_type::BINARY, f(h_s) = dll::bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::RELU6, f(h_s) = dll::ranged_noise(h_a, 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, f(h_s) = dll::ranged_noise(h_a, 1.0));
         H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX)
         ([&](auto f) {
             for (std::size_t b = 0; b < Batch; ++b) {
@@ -386,13 +451,13 @@ protected:
             }
         });
 
-        H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = bernoulli(sigmoid(rep_l(b, Batch) + v_a * w)));
-        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(normal_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = ranged_noise(min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0), 6.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = ranged_noise(min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0), 1.0));
-        H_SAMPLE_INPUT_MULTI(unit_type::RELU1)
+        H_SAMPLE_INPUT(unit_type::BINARY, f(h_s) = dll::bernoulli(sigmoid(h_s)));
+        H_SAMPLE_INPUT(unit_type::RELU, f(h_s) = max(dll::normal_noise(h_s), 0.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, f(h_s) = dll::ranged_noise(min(max(h_s, 0.0), 6.0), 6.0));
+        H_SAMPLE_INPUT(unit_type::RELU1, f(h_s) = dll::ranged_noise(min(max(h_s, 0.0), 1.0), 1.0));
+        H_SAMPLE_INPUT_MULTI(unit_type::SOFTMAX)
         ([&](auto f) {
-            auto x = f(etl::force_temporary(rep_l(b, Batch) + v_a * w));
+            auto x = f(etl::force_temporary(h_s));
 
             for (std::size_t b = 0; b < Batch; ++b) {
                 f(h_s)(b) = one_if_max(stable_softmax(x(b)));
@@ -408,6 +473,13 @@ protected:
         }
     }
 
+    /*!
+     * \brief Compute the visible activations of a batch.
+     *
+     * The pre-activation c + h_s * w^T is computed only once, directly into
+     * the output, which is then transformed in place. w can also be a
+     * low-precision copy of the weights.
+     */
     template <bool P = true, bool S = true, typename H, typename V, typename C, typename W>
     static void batch_std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w) {
         dll::auto_timer timer("rbm:std:batch_activate_visible");
@@ -418,13 +490,23 @@ protected:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        V_PROBS(unit_type::BINARY, f(v_a) = sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_PROBS(unit_type::GAUSSIAN, f(v_a) = rep_l(c, Batch) + transpose(w * transpose(h_s)));
-        V_PROBS(unit_type::RELU, f(v_a) = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
+        //Compute the pre-activation only once, in place
+        cpp::static_if<P>([&](auto f) {
+            dll::visible_pre_activation(f(v_a), h_s, w);
+            f(v_a) += rep_l(c, Batch);
+        });
+
+        cpp::static_if<!P && S>([&](auto f) {
+            dll::visible_pre_activation(f(v_s), h_s, w);
+            f(v_s) += rep_l(c, Batch);
+        });
+
+        V_PROBS(unit_type::BINARY, f(v_a) = sigmoid(v_a));
+        V_PROBS(unit_type::RELU, f(v_a) = max(v_a, 0.0));
 
-        V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = bernoulli(sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
+        V_SAMPLE_INPUT(unit_type::BINARY, f(v_s) = dll::bernoulli(sigmoid(v_s)));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, f(v_s) = dll::normal_noise(v_s));
+        V_SAMPLE_INPUT(unit_type::RELU, f(v_s) = dll::logistic_noise(max(v_s, 0.0)));
 
         if (P) {
             nan_check_deep(v_a);
@@ -0,0 +1,42 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DLL_STORAGE_TYPE_HPP
+#define DLL_STORAGE_TYPE_HPP
+
+namespace dll {
+
+/*!
+ * \brief The storage of the activations propagated between pretrained layers
+ */
+enum class storage_type {
+    NATIVE, ///< The weight type of the layers
+    UINT8,  ///< Probabilities quantized on 8 bits
+    FLOAT16, ///< Half-precision floating point
+    BFLOAT16 ///< Brain floating point (float with a truncated mantissa)
+};
+
+inline std::string to_string(storage_type type) {
+    switch (type) {
+        case storage_type::NATIVE:
+            return "NATIVE";
+        case storage_type::UINT8:
+            return "UINT8";
+        case storage_type::FLOAT16:
+            return "FLOAT16";
+        case storage_type::BFLOAT16:
+            return "BFLOAT16";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+} //end of dll namespace
+
+#endif
@@ -8,7 +8,13 @@
 #ifndef DLL_TEST_HPP
 #define DLL_TEST_HPP
 
+#include <numeric>
+#include <memory>
+
 #include "cpp_utils/stop_watch.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "etl/etl.hpp"
 
 namespace dll {
 
@@ -51,6 +57,46 @@ struct deep_label_predictor {
     }
 };
 
+/*!
+ * \brief Predictor using the batched forward path of the network. To be used
+ * with test_set_parallel.
+ */
+struct batch_predictor {
+    template <typename T, typename Iterator, typename OutputIterator>
+    void operator()(T& dbn, Iterator first, Iterator last, OutputIterator out) {
+        dbn->predict_batch(first, last, out);
+    }
+};
+
+namespace test_detail {
+
+/*!
+ * \brief Returns the number of samples each task of a parallel test should
+ * process.
+ *
+ * There are a few tasks per thread for load balancing, but each of them is
+ * still large enough to benefit from the batch kernels.
+ */
+inline std::size_t chunk_size(std::size_t n) {
+    const std::size_t tasks = 4 * std::max(std::size_t(etl::threads), std::size_t(1));
+    return std::max((n + tasks - 1) / tasks, std::size_t(64));
+}
+
+/*!
+ * \brief Returns the network, given directly or by pointer
+ */
+template <typename DBN>
+DBN& network(DBN& dbn) {
+    return dbn;
+}
+
+template <typename DBN>
+DBN& network(std::unique_ptr<DBN>& dbn) {
+    return *dbn;
+}
+
+} //end of namespace test_detail
+
 template <typename DBN, typename Functor, typename Samples, typename Labels>
 double test_set(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f) {
     return test_set(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f));
@@ -79,6 +125,70 @@ double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIter
     return (images - success) / static_cast<double>(images);
 }
 
+/*!
+ * \brief Compute the classification error of the network on the given set,
+ * in parallel.
+ *
+ * The set is split into chunks that are processed by the given thread pool.
+ * Each chunk is classified at once by the batch functor f(dbn, first, last,
+ * out) (see batch_predictor) and its number of successes is stored in its
+ * own slot, the slots being summed at the end, without any lock.
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator, typename TP>
+double test_set_parallel(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator /*llast*/, Functor&& f, TP& pool) {
+    const std::size_t n = std::distance(first, last);
+
+    if (!n) {
+        return 0.0;
+    }
+
+    const auto chunk  = test_detail::chunk_size(n);
+    const auto chunks = (n + chunk - 1) / chunk;
+
+    std::vector<std::size_t> successes(chunks);
+
+    maybe_parallel_foreach_n(pool, 0, chunks, [&](std::size_t c) {
+        const auto start = c * chunk;
+        const auto end   = std::min(n, start + chunk);
+
+        std::vector<std::size_t> predicted(end - start);
+
+        f(dbn, std::next(first, start), std::next(first, end), predicted.begin());
+
+        auto lit = std::next(lfirst, start);
+
+        std::size_t success = 0;
+
+        for (auto label : predicted) {
+            if (label == *lit) {
+                ++success;
+            }
+
+            ++lit;
+        }
+
+        successes[c] = success;
+    });
+
+    const auto success = std::accumulate(successes.begin(), successes.end(), std::size_t(0));
+
+    return (n - success) / static_cast<double>(n);
+}
+
+/*!
+ * \brief Compute the classification error of the network on the given set,
+ * in parallel, with the thread pool of the network.
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator>
+double test_set_parallel(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast, Functor&& f) {
+    return test_set_parallel(dbn, first, last, lfirst, llast, std::forward<Functor>(f), test_detail::network(dbn).get_pool());
+}
+
+template <typename DBN, typename Functor, typename Samples, typename Labels>
+double test_set_parallel(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f) {
+    return test_set_parallel(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f));
+}
+
 template <typename DBN, typename Samples>
 double test_set_ae(DBN& dbn, const Samples& images) {
     return test_set_ae(dbn, images.begin(), images.end());
@@ -102,6 +212,72 @@ double test_set_ae(DBN& dbn, Iterator first, Iterator last) {
     return std::abs(rate) / images;
 }
 
+/*!
+ * \brief Compute the reconstruction error of the network on the given set, in
+ * parallel.
+ *
+ * The set is split into chunks that are processed by the given thread pool,
+ * each chunk being propagated at once through the batched forward path.
+ */
+template <typename DBN, typename Iterator, typename TP>
+double test_set_ae_parallel(DBN& dbn, Iterator first, Iterator last, TP& pool) {
+    using sample_t = typename std::iterator_traits<Iterator>::value_type;
+
+    const std::size_t n = std::distance(first, last);
+
+    if (!n) {
+        return 0.0;
+    }
+
+    const auto chunk  = test_detail::chunk_size(n);
+    const auto chunks = (n + chunk - 1) / chunk;
+
+    std::vector<double> rates(chunks);
+
+    maybe_parallel_foreach_n(pool, 0, chunks, [&](std::size_t c) {
+        const auto start = c * chunk;
+        const auto end   = std::min(n, start + chunk);
+
+        std::vector<decltype(dbn.template prepare_one_output<sample_t>())> outputs;
+        outputs.reserve(end - start);
+
+        for (std::size_t i = start; i < end; ++i) {
+            outputs.push_back(dbn.template prepare_one_output<sample_t>());
+        }
+
+        auto it = std::next(first, start);
+
+        dbn.activation_probabilities_batch(it, std::next(first, end), outputs.begin());
+
+        double rate = 0.0;
+
+        for (auto& rec_image : outputs) {
+            rate += etl::mean(*it - rec_image);
+            ++it;
+        }
+
+        rates[c] = rate;
+    });
+
+    const auto rate = std::accumulate(rates.begin(), rates.end(), 0.0);
+
+    return std::abs(rate) / n;
+}
+
+/*!
+ * \brief Compute the reconstruction error of the network on the given set, in
+ * parallel, with the thread pool of the network.
+ */
+template <typename DBN, typename Iterator>
+double test_set_ae_parallel(DBN& dbn, Iterator first, Iterator last) {
+    return test_set_ae_parallel(dbn, first, last, test_detail::network(dbn).get_pool());
+}
+
+template <typename DBN, typename Samples>
+double test_set_ae_parallel(DBN& dbn, const Samples& images) {
+    return test_set_ae_parallel(dbn, images.begin(), images.end());
+}
+
 } //end of dll namespace
 
 #endif
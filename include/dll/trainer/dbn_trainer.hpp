@@ -59,8 +59,7 @@ struct dbn_trainer {
     template <typename Iterator, typename LIterator>
     typename dbn_t::weight train(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast, std::size_t max_epochs) const {
         auto error_function = [&dbn, first, last, lfirst, llast]() {
-            return test_set(dbn, first, last, lfirst, llast,
-                            [](dbn_t& dbn, auto& image) { return dbn.predict(image); });
+            return dbn_trainer::test_error(dbn, first, last, lfirst, llast);
         };
 
         auto label_transformer = [](auto first, auto last) {
@@ -73,7 +72,7 @@ struct dbn_trainer {
     template <typename Iterator>
     typename dbn_t::weight train_ae(DBN& dbn, Iterator first, Iterator last, std::size_t max_epochs) const {
         auto error_function = [&dbn, first, last]() {
-            return test_set_ae(dbn, first, last);
+            return dbn_trainer::test_error_ae(dbn, first, last);
         };
 
         auto label_transformer = [](auto first, auto last) {
@@ -83,6 +82,31 @@ struct dbn_trainer {
         return train_impl(dbn, first, last, first, last, max_epochs, error_function, label_transformer);
     }
 
+    //Multiplex and dynamic networks cannot use the batched forward path
+    static constexpr const bool batch_test = !dbn_traits<dbn_t>::is_multiplex() && !dbn_traits<dbn_t>::is_dynamic();
+
+    template <typename Iterator, typename LIterator, bool Batch = batch_test, cpp_enable_if(Batch)>
+    static double test_error(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast) {
+        return test_set_parallel(dbn, first, last, lfirst, llast,
+                                 [](dbn_t& dbn, auto first, auto last, auto out) { dbn.predict_batch(first, last, out); });
+    }
+
+    template <typename Iterator, typename LIterator, bool Batch = batch_test, cpp_disable_if(Batch)>
+    static double test_error(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast) {
+        return test_set(dbn, first, last, lfirst, llast,
+                        [](dbn_t& dbn, auto& image) { return dbn.predict(image); });
+    }
+
+    template <typename Iterator, bool Batch = batch_test, cpp_enable_if(Batch)>
+    static double test_error_ae(DBN& dbn, Iterator first, Iterator last) {
+        return test_set_ae_parallel(dbn, first, last);
+    }
+
+    template <typename Iterator, bool Batch = batch_test, cpp_disable_if(Batch)>
+    static double test_error_ae(DBN& dbn, Iterator first, Iterator last) {
+        return test_set_ae(dbn, first, last);
+    }
+
     template <typename Iterator, typename LIterator, typename Error, typename LabelTransformer>
     typename dbn_t::weight train_impl(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator llast, std::size_t max_epochs, Error error_function, LabelTransformer label_transformer) const {
         constexpr const auto batch_size     = std::decay_t<DBN>::batch_size;
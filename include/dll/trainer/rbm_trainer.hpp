@@ -9,12 +9,22 @@
 #define DLL_RBM_TRAINER_HPP
 
 #include <memory>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
 
 #include "cpp_utils/algorithm.hpp"
 #include "cpp_utils/static_if.hpp"
 
+#include "etl/etl.hpp"
+
 #include "dll/decay_type.hpp"
 #include "dll/util/batch.hpp"
+#include "dll/util/permutation.hpp"
+#include "dll/util/random.hpp"
 #include "dll/util/timers.hpp"
 #include "dll/layer_traits.hpp"
 
@@ -50,6 +60,8 @@ struct rbm_trainer {
 
     using watcher_t = typename watcher_type<rbm_t, RW>::watcher_t;
 
+    static_assert(layer_traits<rbm_t>::metrics_period() > 0, "The period of the metrics must be at least 1");
+
     mutable watcher_t watcher;
 
     rbm_trainer()
@@ -69,48 +81,34 @@ struct rbm_trainer {
         //NOP
     }
 
-    template <typename IIterator, typename EIterator, cpp_enable_if_cst(layer_traits<rbm_t>::has_shuffle())>
-    static void shuffle(IIterator ifirst, IIterator ilast, EIterator efirst, EIterator elast) {
-        static std::random_device rd;
-        static std::mt19937_64 g(rd());
-
-        if (Denoising) {
-            cpp::parallel_shuffle(ifirst, ilast, efirst, elast, g);
-        } else {
-            std::shuffle(ifirst, ilast, g);
-        }
+    template <typename Order, cpp_enable_if_cst(layer_traits<rbm_t>::has_shuffle())>
+    static void shuffle(Order& order) {
+        std::shuffle(order.begin(), order.end(), dll::rng());
     }
 
-    template <typename IIterator, typename EIterator, cpp_disable_if_cst(layer_traits<rbm_t>::has_shuffle())>
-    static void shuffle(IIterator, IIterator, EIterator, EIterator) {}
-
-    template <typename IIterator, typename EIterator, typename IVector, typename EVector, cpp_enable_if_cst(layer_traits<rbm_t>::has_shuffle())>
-    static auto prepare_it(IIterator ifirst, IIterator ilast, EIterator efirst, EIterator elast, IVector& ivec, EVector& evec) {
-        std::copy(ifirst, ilast, std::back_inserter(ivec));
+    template <typename Order, cpp_disable_if_cst(layer_traits<rbm_t>::has_shuffle())>
+    static void shuffle(Order&) {}
 
-        auto input_first = ivec.begin();
-        auto input_last  = ivec.end();
+    //In case of shuffle, the samples are not moved, the inputs and the
+    //expected values are seen through the same permutation of their indices
 
-        if (Denoising) {
-            std::copy(efirst, elast, std::back_inserter(evec));
+    template <typename IIterator, typename EIterator, cpp_enable_if_cst(layer_traits<rbm_t>::has_shuffle())>
+    static auto prepare_it(IIterator ifirst, IIterator ilast, EIterator efirst, EIterator /*elast*/, std::vector<std::size_t>& order) {
+        auto inputs = make_permutation(ifirst, ilast, order);
 
-            auto expected_first = evec.begin();
-            auto expected_last = evec.end();
-            return std::make_tuple(input_first, input_last, expected_first, expected_last);
-        } else {
-            return std::make_tuple(input_first, input_last, input_first, input_last);
-        }
+        return std::make_tuple(std::get<0>(inputs), std::get<1>(inputs),
+                               permutation_iterator<EIterator>(efirst, order.cbegin()), permutation_iterator<EIterator>(efirst, order.cend()));
     }
 
-    template <typename IIterator, typename EIterator, typename IVector, typename EVector, cpp_disable_if_cst(layer_traits<rbm_t>::has_shuffle())>
-    static auto prepare_it(IIterator ifirst, IIterator ilast, EIterator efirst, EIterator elast, IVector&, EVector&) {
+    template <typename IIterator, typename EIterator, cpp_disable_if_cst(layer_traits<rbm_t>::has_shuffle())>
+    static auto prepare_it(IIterator ifirst, IIterator ilast, EIterator efirst, EIterator elast, std::vector<std::size_t>&) {
         return std::make_tuple(ifirst, ilast, efirst, elast);
     }
 
     template <typename rbm_t, typename Iterator>
     using fix_iterator_t = std::conditional_t<
         layer_traits<rbm_t>::has_shuffle(),
-        typename std::vector<typename std::iterator_traits<Iterator>::value_type>::iterator,
+        permutation_iterator<Iterator>,
         Iterator>;
 
     std::size_t batch_size            = 0;
@@ -150,6 +148,8 @@ struct rbm_trainer {
         }
 
         last_error = 0.0;
+
+        hogwild_trainers.clear();
     }
 
     template <typename Iterator>
@@ -174,12 +174,10 @@ struct rbm_trainer {
     typename rbm_t::weight train(RBM& rbm, IIterator ifirst, IIterator ilast, EIterator efirst, EIterator elast, std::size_t max_epochs) {
         dll::auto_timer timer("rbm_trainer:train");
 
-        //In case of shuffle, we don't want to shuffle the input, therefore create a copy and shuffle it
+        //In case of shuffle, only the order of the samples is shuffled
+        std::vector<std::size_t> order;
 
-        std::vector<typename std::iterator_traits<IIterator>::value_type> input_copy;
-        std::vector<typename std::iterator_traits<EIterator>::value_type> expected_copy;
-
-        auto iterators = prepare_it(ifirst, ilast, efirst, elast, input_copy, expected_copy);
+        auto iterators = prepare_it(ifirst, ilast, efirst, elast, order);
 
         decltype(auto) input_first = std::get<0>(iterators);
         decltype(auto) input_last = std::get<1>(iterators);
@@ -201,7 +199,7 @@ struct rbm_trainer {
         //Train for max_epochs epoch
         for (std::size_t epoch = 0; epoch < max_epochs; ++epoch) {
             //Shuffle if necessary
-            shuffle(input_first, input_last, expected_first, expected_last);
+            shuffle(order);
 
             //Create a new context for this epoch
             rbm_training_context context;
@@ -222,12 +220,53 @@ struct rbm_trainer {
     std::size_t batches = 0;
     std::size_t samples = 0;
 
+    std::size_t measured_batches = 0; ///< The number of batches whose metrics have been computed
+    std::size_t measured_samples = 0; ///< The number of samples whose free energy has been computed
+
+    std::vector<trainer_type> hogwild_trainers; ///< The trainers of the additional Hogwild threads
+
     void init_epoch() {
         batches = 0;
         samples = 0;
+
+        measured_batches = 0;
+        measured_samples = 0;
     }
 
-    template <typename IIT, typename EIT>
+    /*!
+     * \brief Indicates if the metrics of the given batch of the epoch must be
+     * computed
+     */
+    static bool measure_batch(std::size_t batch) {
+        constexpr const auto period = layer_traits<rbm_t>::metrics_period();
+
+        switch (layer_traits<rbm_t>::metrics_policy()) {
+            case metrics_policy::ALL:
+                return true;
+            case metrics_policy::PERIODIC:
+                return batch % period == 0;
+            case metrics_policy::SAMPLED:
+                return dll::rng()() % period == 0;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Add the free energy of the first n samples of the last batch of
+     * the given trainer to the context
+     */
+    template <typename Trainer, cpp_enable_if_cst(EnableWatcher && layer_traits<rbm_t>::free_energy())>
+    static void add_free_energy(const rbm_t& rbm, const Trainer& trainer, std::size_t n, rbm_training_context& context) {
+        dll::auto_timer timer("rbm_trainer:free_energy");
+
+        context.free_energy += rbm.batch_free_energy(trainer.v1, n);
+    }
+
+    template <typename Trainer, cpp_disable_if_cst(EnableWatcher && layer_traits<rbm_t>::free_energy())>
+    static void add_free_energy(const rbm_t&, const Trainer&, std::size_t, rbm_training_context&) {}
+
+    template <typename IIT, typename EIT, cpp_disable_if_cst(layer_traits<rbm_t>::is_hogwild())>
     void train_sub(IIT input_first, IIT input_last, EIT expected_first, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
         auto iit = input_first;
         auto eit = expected_first;
@@ -250,33 +289,147 @@ struct rbm_trainer {
         }
     }
 
+    /*!
+     * \brief Train on all the data with Hogwild.
+     *
+     * The batches are distributed dynamically to the threads. Each thread
+     * trains with its own trainer, and therefore its own momentum, and
+     * updates the shared weights without any lock. The watcher is not
+     * notified of the end of each batch.
+     *
+     * If a thread fails, the remaining batches are not trained and the
+     * first exception is rethrown once all the threads are joined.
+     */
+    template <typename IIT, typename EIT, cpp_enable_if_cst(layer_traits<rbm_t>::is_hogwild())>
+    void train_sub(IIT input_first, IIT input_last, EIT expected_first, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
+        dll::auto_timer timer("rbm_trainer:train_sub:hogwild");
+
+        const std::size_t n         = std::distance(input_first, input_last);
+        const std::size_t n_batches = (n + batch_size - 1) / batch_size;
+
+        const std::size_t threads = std::max(std::min(rbm.hogwild_threads ? rbm.hogwild_threads : std::size_t(etl::threads), n_batches), std::size_t(1));
+
+        //The first thread uses the main trainer
+        while (hogwild_trainers.size() + 1 < threads) {
+            hogwild_trainers.push_back(get_trainer(rbm));
+        }
+
+        std::vector<rbm_training_context> contexts(threads);
+        std::atomic<std::size_t> next_batch(0);
+        std::atomic<std::size_t> measured(0);
+        std::atomic<std::size_t> measured_n(0);
+
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        const auto streams = dll::rng().next64();
+
+        auto work = [&](std::size_t t) {
+            random_stream stream(streams, t);
+            random_scope scope(stream);
+
+            auto& local_trainer = t == 0 ? trainer : hogwild_trainers[t - 1];
+            auto& local_context = contexts[t];
+
+            std::size_t b;
+            while ((b = next_batch++) < n_batches) {
+                const std::size_t first = b * batch_size;
+                const std::size_t last  = std::min(first + batch_size, n);
+
+                auto input_batch    = make_batch(std::next(input_first, first), std::next(input_first, last));
+                auto expected_batch = make_batch(std::next(expected_first, first), std::next(expected_first, last));
+
+                local_context.measure = measure_batch(b);
+
+                local_trainer->train_batch(input_batch, expected_batch, local_context);
+
+                if (local_context.measure) {
+                    ++measured;
+                    measured_n += last - first;
+
+                    local_context.reconstruction_error += local_context.batch_error;
+                    local_context.sparsity += local_context.batch_sparsity;
+
+                    add_free_energy(rbm, *local_trainer, last - first, local_context);
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+
+        auto safe_work = [&](std::size_t t) {
+            try {
+                work(t);
+            } catch (...) {
+                std::lock_guard<std::mutex> l(error_lock);
+
+                if (!error) {
+                    error = std::current_exception();
+                }
+
+                //Stop the other threads after their current batch
+                next_batch = n_batches;
+            }
+        };
+
+        for (std::size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(safe_work, t);
+        }
+
+        safe_work(0);
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        for (auto& local_context : contexts) {
+            context.reconstruction_error += local_context.reconstruction_error;
+            context.sparsity += local_context.sparsity;
+            context.free_energy += local_context.free_energy;
+        }
+
+        batches += n_batches;
+        samples += n;
+
+        measured_batches += measured;
+        measured_samples += measured_n;
+    }
+
     template <typename IIT, typename EIT>
     void train_batch(IIT input_first, IIT input_last, EIT expected_first, EIT expected_last, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
+        context.measure = measure_batch(batches);
+
         ++batches;
 
         auto input_batch    = make_batch(input_first, input_last);
         auto expected_batch = make_batch(expected_first, expected_last);
         trainer->train_batch(input_batch, expected_batch, context);
 
-        context.reconstruction_error += context.batch_error;
-        context.sparsity += context.batch_sparsity;
+        //The metrics are only computed, and reported, on the measured batches
+        if (context.measure) {
+            ++measured_batches;
+            measured_samples += input_batch.size();
 
-        cpp::static_if<EnableWatcher && layer_traits<rbm_t>::free_energy()>([&](auto f) {
-            for (auto& v : input_batch) {
-                context.free_energy += f(rbm).free_energy(v);
-            }
-        });
+            context.reconstruction_error += context.batch_error;
+            context.sparsity += context.batch_sparsity;
 
-        if (EnableWatcher && layer_traits<rbm_t>::is_verbose()) {
-            watcher.batch_end(rbm, context, batches, total_batches);
+            add_free_energy(rbm, *trainer, input_batch.size(), context);
+
+            if (EnableWatcher && layer_traits<rbm_t>::is_verbose()) {
+                watcher.batch_end(rbm, context, batches, total_batches);
+            }
         }
     }
 
     void finalize_epoch(std::size_t epoch, rbm_training_context& context, rbm_t& rbm) {
-        //Average all the gathered information
-        context.reconstruction_error /= batches;
-        context.sparsity /= batches;
-        context.free_energy /= samples;
+        //Average all the gathered information over the measured batches
+        context.reconstruction_error /= std::max(measured_batches, std::size_t(1));
+        context.sparsity /= std::max(measured_batches, std::size_t(1));
+        context.free_energy /= std::max(measured_samples, std::size_t(1));
 
         //After some time increase the momentum
         if (layer_traits<rbm_t>::has_momentum() && epoch == rbm.final_momentum_epoch) {
@@ -24,6 +24,8 @@ struct rbm_training_context {
 
     double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
     double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
+
+    bool measure = true; ///< Indicates if the metrics of the current batch are computed
 };
 
 } //end of dll namespace
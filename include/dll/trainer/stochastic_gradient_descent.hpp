@@ -198,13 +198,7 @@ struct sgd_trainer {
         constexpr const auto NV1 = Layer2::NV1;
         constexpr const auto NV2 = Layer2::NV2;
 
-        auto w_f = force_temporary(r2.w);
-
-        for (size_t c = 0; c < NC; ++c) {
-            for (size_t k = 0; k < K; ++k) {
-                w_f(c)(k).fflip_inplace();
-            }
-        }
+        auto& w_f = r2.flipped_w();
 
         etl::fast_dyn_matrix<weight, NV1, NV2> tmp;
 
@@ -386,6 +380,11 @@ struct sgd_trainer {
             layer.b += (eps / n) * context.b_grad;
         }
 
+        //The cached flipped weights are not valid anymore
+        cpp::static_if<is_conv<L>::value>([&](auto f) {
+            f(layer).weights_changed();
+        });
+
         nan_check_deep(layer.w);
         nan_check_deep(layer.b);
     }
@@ -33,6 +33,18 @@ inline void blas_axpy(std::size_t n1, double alpha, double* a, double* b) {
     cblas_daxpy(n1, alpha, a, 1, b, 1);
 }
 
+/*!
+ * \brief Compute c = alpha * a * b + beta * c, with b transposed if trans_b
+ * is true. All the matrices are row-major with the given leading dimensions.
+ */
+inline void blas_gemm(bool trans_b, std::size_t m, std::size_t n, std::size_t k, float alpha, const float* a, std::size_t lda, const float* b, std::size_t ldb, float beta, float* c, std::size_t ldc) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, trans_b ? CblasTrans : CblasNoTrans, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+inline void blas_gemm(bool trans_b, std::size_t m, std::size_t n, std::size_t k, double alpha, const double* a, std::size_t lda, const double* b, std::size_t ldb, double beta, double* c, std::size_t ldc) {
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, trans_b ? CblasTrans : CblasNoTrans, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
 #endif //ETL_BLAS_MODE
 
 } //end of dll namespace
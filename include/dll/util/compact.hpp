@@ -0,0 +1,341 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file compact.hpp
+ * \brief Low-precision storage of the activations propagated between layers.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "etl/etl.hpp"
+
+#include "storage_type.hpp"
+
+namespace dll {
+
+#ifdef __F16C__
+
+inline std::uint16_t float_to_half(float value) {
+    return _cvtss_sh(value, 0);
+}
+
+inline float half_to_float(std::uint16_t value) {
+    return _cvtsh_ss(value);
+}
+
+#else
+
+/*!
+ * \brief Convert a float to a IEEE half-precision float, rounding to the
+ * nearest even value
+ */
+inline std::uint16_t float_to_half(float value) {
+    std::uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+
+    const std::uint32_t sign = (x >> 16) & 0x8000;
+    const std::uint32_t abs  = x & 0x7FFFFFFF;
+
+    //Infinity and NaN
+    if (abs >= 0x7F800000) {
+        return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0);
+    }
+
+    //Too small to be represented, even as a subnormal
+    if (abs <= 0x33000000) {
+        return sign;
+    }
+
+    //Subnormal half
+    if (abs < 0x38800000) {
+        const std::uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+        const std::uint32_t shift    = 126 - (abs >> 23);
+
+        std::uint32_t half      = mantissa >> shift;
+        const std::uint32_t rem = mantissa & ((1u << shift) - 1);
+        const std::uint32_t mid = 1u << (shift - 1);
+
+        if (rem > mid || (rem == mid && (half & 1))) {
+            ++half;
+        }
+
+        return sign | half;
+    }
+
+    //Too large to be represented, round to infinity
+    if (abs >= 0x47800000) {
+        return sign | 0x7C00;
+    }
+
+    //Normal half, rebias the exponent, the largest values round up to infinity
+    std::uint32_t half      = (abs - 0x38000000) >> 13;
+    const std::uint32_t rem = abs & 0x1FFF;
+
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+        ++half;
+    }
+
+    return sign | half;
+}
+
+/*!
+ * \brief Convert a IEEE half-precision float to a float
+ */
+inline float half_to_float(std::uint16_t value) {
+    const std::uint32_t sign = std::uint32_t(value & 0x8000) << 16;
+    std::uint32_t exponent   = (value >> 10) & 0x1F;
+    std::uint32_t mantissa   = value & 0x3FF;
+
+    std::uint32_t x;
+
+    if (exponent == 0x1F) {
+        x = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent) {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (!mantissa) {
+        x = sign;
+    } else {
+        //Normalize the subnormal half
+        exponent = 113;
+
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+
+        x = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+#endif
+
+/*!
+ * \brief Convert a float to a bfloat16, rounding to the nearest even value
+ */
+inline std::uint16_t float_to_bfloat16(float value) {
+    std::uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+
+    //Keep NaN a (quiet) NaN
+    if ((x & 0x7FFFFFFF) > 0x7F800000) {
+        return (x >> 16) | 0x40;
+    }
+
+    return (x + 0x7FFF + ((x >> 16) & 1)) >> 16;
+}
+
+/*!
+ * \brief Convert a bfloat16 to a float
+ */
+inline float bfloat16_to_float(std::uint16_t value) {
+    const std::uint32_t x = std::uint32_t(value) << 16;
+
+    float result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+/*!
+ * \brief Conversion between the values and their compact representation
+ */
+template <typename W, storage_type S>
+struct compact_codec;
+
+/*!
+ * \brief Values stored with the weight type, without any conversion
+ */
+template <typename W>
+struct compact_codec<W, storage_type::NATIVE> {
+    using storage_t = W;
+
+    static storage_t encode(W value) {
+        return value;
+    }
+
+    static W decode(storage_t value) {
+        return value;
+    }
+};
+
+/*!
+ * \brief Probabilities, clipped to [0, 1] and quantized on 256 levels
+ */
+template <typename W>
+struct compact_codec<W, storage_type::UINT8> {
+    using storage_t = std::uint8_t;
+
+    static storage_t encode(W value) {
+        return static_cast<storage_t>(std::lround(std::min(std::max(value, W(0)), W(1)) * W(255)));
+    }
+
+    static W decode(storage_t value) {
+        return W(value) / W(255);
+    }
+};
+
+/*!
+ * \brief Half-precision floating point values
+ */
+template <typename W>
+struct compact_codec<W, storage_type::FLOAT16> {
+    using storage_t = std::uint16_t;
+
+    static storage_t encode(W value) {
+        return float_to_half(static_cast<float>(value));
+    }
+
+    static W decode(storage_t value) {
+        return W(half_to_float(value));
+    }
+};
+
+/*!
+ * \brief Brain floating point values
+ */
+template <typename W>
+struct compact_codec<W, storage_type::BFLOAT16> {
+    using storage_t = std::uint16_t;
+
+    static storage_t encode(W value) {
+        return float_to_bfloat16(static_cast<float>(value));
+    }
+
+    static W decode(storage_t value) {
+        return W(bfloat16_to_float(value));
+    }
+};
+
+/*!
+ * \brief Encode the given values into output
+ */
+template <typename Codec, typename E, typename Output>
+void encode_values(const E& values, Output&& output) {
+    std::size_t i = 0;
+    for (auto value : values) {
+        output[i++] = Codec::encode(value);
+    }
+}
+
+/*!
+ * \brief Decode the given compact values into output
+ */
+template <typename Codec, typename E, typename Output>
+void decode_values(const E& values, Output&& output) {
+    std::size_t i = 0;
+    for (auto value : values) {
+        output[i++] = Codec::decode(value);
+    }
+}
+
+/*!
+ * \brief A vector of activations stored with a lower precision than the
+ * weight type W. The values are widened back to W when they are read.
+ */
+template <typename W, storage_type S>
+struct compact_vector {
+    static_assert(S != storage_type::NATIVE, "compact_vector needs a compact storage type");
+
+    using value_type = W;                           ///< The type of the values
+    using codec_t    = compact_codec<W, S>;         ///< The conversion of the values
+    using storage_t  = typename codec_t::storage_t; ///< The type of the stored values
+
+    compact_vector() = default;
+
+    /*!
+     * \brief Store the given values
+     */
+    template <typename E>
+    explicit compact_vector(const E& values) {
+        assign(values);
+    }
+
+    /*!
+     * \brief Replace the stored values by the given values
+     */
+    template <typename E>
+    void assign(const E& values) {
+        data.resize(values.size());
+
+        std::size_t i = 0;
+        for (auto value : values) {
+            data[i++] = codec_t::encode(value);
+        }
+    }
+
+    std::size_t size() const {
+        return data.size();
+    }
+
+    W operator[](std::size_t i) const {
+        return codec_t::decode(data[i]);
+    }
+
+    /*!
+     * \brief Write the widened values to the given memory
+     */
+    template <typename T>
+    void widen(T* output) const {
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            output[i] = codec_t::decode(data[i]);
+        }
+    }
+
+private:
+    std::vector<storage_t> data; ///< The compact values
+};
+
+/*!
+ * \brief Copy an input into a (contiguous) batch row
+ */
+template <typename Output, typename Input>
+void copy_input(Output&& output, const Input& input) {
+    output = input;
+}
+
+/*!
+ * \brief Widen a compact input into a (contiguous) batch row
+ */
+template <typename Output, typename W, storage_type S>
+void copy_input(Output&& output, const compact_vector<W, S>& input) {
+    input.widen(output.memory_start());
+}
+
+/*!
+ * \brief Returns an input that can be given to the layers
+ */
+template <typename Input>
+const Input& widen_input(const Input& input) {
+    return input;
+}
+
+/*!
+ * \brief Returns a widened copy of a compact input
+ */
+template <typename W, storage_type S>
+etl::dyn_vector<W> widen_input(const compact_vector<W, S>& input) {
+    etl::dyn_vector<W> output(input.size());
+    input.widen(output.memory_start());
+    return output;
+}
+
+} //end of dll namespace
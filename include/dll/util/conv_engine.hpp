@@ -0,0 +1,241 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file conv_engine.hpp
+ * \brief Minibatch-wide im2col + GEMM convolution engine.
+ *
+ * The valid convolutions of a whole batch, with all its channels, are
+ * lowered into a single im2col matrix of (NC * NW1 * NW2) rows and
+ * (B * NH1 * NH2) columns. They are then computed by a single matrix-matrix
+ * multiplication with the K x (NC * NW1 * NW2) matrix of the kernels, with
+ * the blocked kernels of ETL, or with BLAS when ETL uses it. The batch can
+ * also be split in chunks computed in parallel, each with its own matrices.
+ * The layers keep this memory in an im2col_scratch between the batches.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "etl/etl.hpp"
+
+#include "timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The memory of the im2col convolutions, kept by a layer between the
+ * batches.
+ *
+ * The batch is split in chunks, each with its own lowered matrix and
+ * result, so that the chunks can be computed in parallel. The matrices are
+ * only allocated again when the dimensions of the chunks change. When the
+ * scratch is already used by another thread, the convolutions are computed
+ * with temporary memory instead.
+ */
+template <typename T>
+struct im2col_scratch {
+    /*!
+     * \brief The memory of one chunk of the batch
+     */
+    struct chunk {
+        etl::dyn_matrix<T, 2> columns; ///< The lowered inputs
+        etl::dyn_matrix<T, 2> result;  ///< The convolutions of the chunk
+    };
+
+    etl::dyn_matrix<T, 2> kernels; ///< The gathered kernels, one row per output feature
+    std::vector<chunk> chunks;     ///< The memory of each chunk
+    std::mutex lock;               ///< The lock protecting the scratch
+};
+
+namespace conv_engine_detail {
+
+/*!
+ * \brief Make sure m is a rows x columns matrix, allocating it only if its
+ * dimensions changed
+ */
+template <typename T>
+void ensure(etl::dyn_matrix<T, 2>& m, std::size_t rows, std::size_t columns) {
+    if (etl::dim<0>(m) != rows || etl::dim<1>(m) != columns) {
+        m = etl::dyn_matrix<T, 2>(rows, columns);
+    }
+}
+
+/*!
+ * \brief Compute the convolutions of the samples of the chunk c of the
+ * batch, with the kernels already gathered in the scratch
+ */
+template <typename T, typename V, typename W, typename Output>
+void im2col_chunk(im2col_scratch<T>& scratch, std::size_t c, std::size_t chunks, const V& v, const W& w, Output& output) {
+    const std::size_t B   = etl::dim<0>(v);
+    const std::size_t NC  = etl::dim<1>(v);
+    const std::size_t NV1 = etl::dim<2>(v);
+    const std::size_t NV2 = etl::dim<3>(v);
+    const std::size_t K   = etl::dim<1>(w);
+    const std::size_t NW1 = etl::dim<2>(w);
+    const std::size_t NW2 = etl::dim<3>(w);
+    const std::size_t NH1 = NV1 - NW1 + 1;
+    const std::size_t NH2 = NV2 - NW2 + 1;
+
+    const std::size_t patch = NC * NW1 * NW2; //The size of a lowered patch
+    const std::size_t image = NH1 * NH2;      //The size of an output
+
+    const std::size_t first = (c * B) / chunks;
+    const std::size_t n     = ((c + 1) * B) / chunks - first;
+
+    auto& memory = scratch.chunks[c];
+
+    ensure(memory.columns, patch, n * image);
+    ensure(memory.result, K, n * image);
+
+    const T* in = v.memory_start() + first * NC * NV1 * NV2;
+
+    //Lower the chunk, one row per kernel position, one column per output position
+
+    T* col = memory.columns.memory_start();
+
+    for (std::size_t ch = 0; ch < NC; ++ch) {
+        for (std::size_t p = 0; p < NW1; ++p) {
+            for (std::size_t q = 0; q < NW2; ++q) {
+                T* row = col + ((ch * NW1 + p) * NW2 + q) * n * image;
+
+                for (std::size_t b = 0; b < n; ++b) {
+                    const T* channel = in + (b * NC + ch) * NV1 * NV2;
+
+                    for (std::size_t i = 0; i < NH1; ++i) {
+                        std::copy_n(channel + (i + p) * NV2 + q, NH2, row + b * image + i * NH2);
+                    }
+                }
+            }
+        }
+    }
+
+    //All the convolutions of the chunk at once
+
+    memory.result = scratch.kernels * memory.columns;
+
+    const T* r = memory.result.memory_start();
+
+    for (std::size_t b = 0; b < n; ++b) {
+        for (std::size_t k = 0; k < K; ++k) {
+            std::copy_n(r + k * n * image + b * image, image, output(first + b, k));
+        }
+    }
+}
+
+/*!
+ * \brief Gather the kernels in the scratch, one row per output feature,
+ * and prepare the memory of the given number of chunks
+ */
+template <typename T, typename W>
+void im2col_prepare(im2col_scratch<T>& scratch, const W& w, std::size_t chunks) {
+    const std::size_t NC  = etl::dim<0>(w);
+    const std::size_t K   = etl::dim<1>(w);
+    const std::size_t NW1 = etl::dim<2>(w);
+    const std::size_t NW2 = etl::dim<3>(w);
+
+    ensure(scratch.kernels, K, NC * NW1 * NW2);
+
+    const T* ws = w.memory_start();
+    T* kn       = scratch.kernels.memory_start();
+
+    for (std::size_t k = 0; k < K; ++k) {
+        for (std::size_t c = 0; c < NC; ++c) {
+            std::copy_n(ws + (c * K + k) * NW1 * NW2, NW1 * NW2, kn + (k * NC + c) * NW1 * NW2);
+        }
+    }
+
+    if (scratch.chunks.size() < chunks) {
+        scratch.chunks.resize(chunks);
+    }
+}
+
+} //end of namespace conv_engine_detail
+
+/*!
+ * \brief Compute the valid convolutions of a batch with all the kernels,
+ * summed over the channels, with the memory of the given scratch.
+ *
+ * The result of the sample b and the kernel k is sum_c v(b)(c) * w(c)(k),
+ * with * the valid convolution with the flipped kernel (the kernels are
+ * applied without being flipped). It is written to the NH1 x NH2
+ * contiguous values at output(b, k).
+ *
+ * The batch is split in the given number of chunks, computed in parallel
+ * by the pool.
+ *
+ * \param pool The thread pool computing the chunks
+ * \param chunks The number of chunks of the batch
+ * \param scratch The memory of the convolutions
+ * \param v The inputs (B x NC x NV1 x NV2)
+ * \param w The kernels (NC x K x NW1 x NW2)
+ * \param output The functor returning the memory of each output
+ */
+template <typename Pool, typename T, typename V, typename W, typename Output>
+void batch_conv_valid_im2col(Pool& pool, std::size_t chunks, im2col_scratch<T>& scratch, const V& v, const W& w, Output&& output) {
+    dll::auto_timer timer("conv:batch_valid:im2col");
+
+    cpp_assert(etl::dim<0>(w) == etl::dim<1>(v), "The kernels must have as many channels as the inputs");
+
+    std::unique_lock<std::mutex> l(scratch.lock, std::try_to_lock);
+
+    if (!l.owns_lock()) {
+        im2col_scratch<T> local;
+        batch_conv_valid_im2col(pool, chunks, local, v, w, output);
+        return;
+    }
+
+    chunks = std::max(std::min(chunks, std::size_t(etl::dim<0>(v))), std::size_t(1));
+
+    conv_engine_detail::im2col_prepare(scratch, w, chunks);
+
+    maybe_parallel_foreach_n(pool, 0, chunks, [&](std::size_t c) {
+        conv_engine_detail::im2col_chunk(scratch, c, chunks, v, w, output);
+    });
+}
+
+/*!
+ * \brief Compute the valid convolutions of a batch with all the kernels,
+ * summed over the channels, in a single matrix multiplication with the
+ * memory of the given scratch (see above).
+ */
+template <typename T, typename V, typename W, typename Output>
+void batch_conv_valid_im2col(im2col_scratch<T>& scratch, const V& v, const W& w, Output&& output) {
+    dll::auto_timer timer("conv:batch_valid:im2col");
+
+    cpp_assert(etl::dim<0>(w) == etl::dim<1>(v), "The kernels must have as many channels as the inputs");
+
+    std::unique_lock<std::mutex> l(scratch.lock, std::try_to_lock);
+
+    if (!l.owns_lock()) {
+        im2col_scratch<T> local;
+        batch_conv_valid_im2col(local, v, w, output);
+        return;
+    }
+
+    conv_engine_detail::im2col_prepare(scratch, w, 1);
+    conv_engine_detail::im2col_chunk(scratch, 0, 1, v, w, output);
+}
+
+/*!
+ * \brief Compute the valid convolutions of a batch with all the kernels,
+ * summed over the channels, in a single matrix multiplication with
+ * temporary memory (see above).
+ */
+template <typename V, typename W, typename Output>
+void batch_conv_valid_im2col(const V& v, const W& w, Output&& output) {
+    im2col_scratch<etl::value_t<V>> scratch;
+    batch_conv_valid_im2col(scratch, v, w, output);
+}
+
+} //end of dll namespace
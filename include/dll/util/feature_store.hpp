@@ -0,0 +1,421 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file feature_store.hpp
+ * \brief Binary storage of features, readable through a memory mapping.
+ *
+ * A feature file starts with a header (feature_header) padded to
+ * feature_header_size bytes, followed by count rows of dims values. Each row
+ * starts on a multiple of feature_alignment bytes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+constexpr const std::size_t feature_alignment   = 64;   ///< The alignment, in bytes, of each row
+constexpr const std::size_t feature_header_size = 4096; ///< The space reserved for the header, in bytes
+
+/*!
+ * \brief The type code of the values stored in a feature file
+ */
+template <typename W>
+struct feature_dtype;
+
+template <>
+struct feature_dtype<float> {
+    static constexpr const std::uint32_t value = 1;
+};
+
+template <>
+struct feature_dtype<double> {
+    static constexpr const std::uint32_t value = 2;
+};
+
+template <>
+struct feature_dtype<std::uint8_t> {
+    static constexpr const std::uint32_t value = 3;
+};
+
+template <>
+struct feature_dtype<std::uint16_t> {
+    static constexpr const std::uint32_t value = 4;
+};
+
+/*!
+ * \brief The header of a feature file
+ */
+struct feature_header {
+    char magic[4];            ///< Always "DLLF"
+    std::uint32_t version;    ///< The version of the format
+    std::uint32_t dtype;      ///< The type of the values (see feature_dtype)
+    std::uint32_t alignment;  ///< The alignment of the rows
+    std::uint64_t count;      ///< The number of rows
+    std::uint64_t dims;       ///< The number of values per row
+    std::uint64_t row_stride; ///< The distance, in bytes, between two rows
+    std::uint64_t offset;     ///< The position, in bytes, of the first row
+};
+
+/*!
+ * \brief Returns the distance, in bytes, between two rows of dims values
+ */
+template <typename W>
+constexpr std::size_t feature_row_stride(std::size_t dims) {
+    return ((dims * sizeof(W) + feature_alignment - 1) / feature_alignment) * feature_alignment;
+}
+
+/*!
+ * \brief Indicates if the given header describes rows of W values that all
+ * fit in a file of the given length
+ */
+template <typename W>
+bool valid_feature_header(const feature_header& header, std::size_t length) {
+    if (std::memcmp(header.magic, "DLLF", 4) != 0 || header.version != 1 || header.dtype != feature_dtype<W>::value) {
+        return false;
+    }
+
+    //The rows must be aligned and large enough for their values
+    if (header.alignment != feature_alignment || header.offset % feature_alignment || header.row_stride % feature_alignment
+        || header.dims > std::numeric_limits<std::uint64_t>::max() / sizeof(W) || header.row_stride < header.dims * sizeof(W)) {
+        return false;
+    }
+
+    if (header.offset > length) {
+        return false;
+    }
+
+    //count * row_stride must not overflow nor go past the end of the file
+    return header.row_stride == 0 || header.count <= (length - header.offset) / header.row_stride;
+}
+
+/*!
+ * \brief Sequential writer of a feature file.
+ *
+ * The number of rows is written in the header when the writer is closed.
+ */
+template <typename W>
+struct feature_writer {
+    /*!
+     * \brief Create a new feature file
+     * \param path The path of the file
+     * \param dims The number of values per row
+     */
+    feature_writer(const std::string& path, std::size_t dims)
+            : os(path, std::ofstream::binary), dims(dims), buffer(feature_row_stride<W>(dims), 0) {
+        std::string reserved(feature_header_size, 0);
+        os.write(reserved.data(), reserved.size());
+    }
+
+    feature_writer(const feature_writer& rhs) = delete;
+    feature_writer& operator=(const feature_writer& rhs) = delete;
+
+    ~feature_writer() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the file has been correctly opened and written
+     */
+    bool good() const {
+        return os.good();
+    }
+
+    /*!
+     * \brief Append a row to the file
+     * \param row The row, of dims values
+     */
+    template <typename Row>
+    void write(const Row& row) {
+        std::size_t i = 0;
+
+        //The row is encoded in the buffer, followed by its padding, and written at once
+        for (auto v : row) {
+            cpp_assert(i < dims, "Invalid number of features");
+
+            W value = v;
+            std::memcpy(&buffer[i * sizeof(W)], &value, sizeof(W));
+            ++i;
+        }
+
+        cpp_assert(i == dims, "Invalid number of features");
+
+        os.write(buffer.data(), buffer.size());
+
+        ++count;
+    }
+
+    /*!
+     * \brief Write the header and close the file
+     */
+    void close() {
+        if (!os.is_open()) {
+            return;
+        }
+
+        feature_header header;
+        std::memcpy(header.magic, "DLLF", 4);
+        header.version    = 1;
+        header.dtype      = feature_dtype<W>::value;
+        header.alignment  = feature_alignment;
+        header.count      = count;
+        header.dims       = dims;
+        header.row_stride = feature_row_stride<W>(dims);
+        header.offset     = feature_header_size;
+
+        os.seekp(0);
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.close();
+    }
+
+private:
+    std::ofstream os;      ///< The output stream
+    std::size_t dims;      ///< The number of values per row
+    std::size_t count = 0; ///< The number of rows written
+    std::string buffer;    ///< The encoded row, followed by its padding
+};
+
+/*!
+ * \brief A row of a feature file, pointing directly to the mapped memory
+ */
+template <typename W>
+struct feature_row {
+    using value_type     = W;
+    using const_iterator = const W*;
+    using iterator       = const W*;
+
+    feature_row(const W* data, std::size_t n)
+            : data(data), n(n) {}
+
+    std::size_t size() const {
+        return n;
+    }
+
+    const W& operator[](std::size_t i) const {
+        return data[i];
+    }
+
+    const W* begin() const {
+        return data;
+    }
+
+    const W* end() const {
+        return data + n;
+    }
+
+    const W* memory_start() const {
+        return data;
+    }
+
+private:
+    const W* data; ///< The first value of the row
+    std::size_t n; ///< The number of values
+};
+
+/*!
+ * \brief Read-only access to a feature file through a memory mapping.
+ *
+ * The rows are not parsed nor copied, they point directly into the mapping.
+ */
+template <typename W>
+struct feature_store {
+    using row_t = feature_row<W>; ///< The type of a row
+
+    /*!
+     * \brief Random access iterator over the rows of the store
+     */
+    struct const_iterator {
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = row_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = void;
+        using reference         = row_t;
+
+        const_iterator(const feature_store* store, std::size_t i)
+                : store(store), i(i) {}
+
+        row_t operator*() const {
+            return (*store)[i];
+        }
+
+        row_t operator[](difference_type n) const {
+            return (*store)[i + n];
+        }
+
+        const_iterator& operator++() {
+            ++i;
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto it = *this;
+            ++i;
+            return it;
+        }
+
+        const_iterator& operator--() {
+            --i;
+            return *this;
+        }
+
+        const_iterator operator--(int) {
+            auto it = *this;
+            --i;
+            return it;
+        }
+
+        const_iterator& operator+=(difference_type n) {
+            i += n;
+            return *this;
+        }
+
+        const_iterator& operator-=(difference_type n) {
+            i -= n;
+            return *this;
+        }
+
+        const_iterator operator+(difference_type n) const {
+            return {store, i + n};
+        }
+
+        const_iterator operator-(difference_type n) const {
+            return {store, i - n};
+        }
+
+        difference_type operator-(const const_iterator& rhs) const {
+            return difference_type(i) - difference_type(rhs.i);
+        }
+
+        bool operator==(const const_iterator& rhs) const {
+            return i == rhs.i;
+        }
+
+        bool operator!=(const const_iterator& rhs) const {
+            return i != rhs.i;
+        }
+
+        bool operator<(const const_iterator& rhs) const {
+            return i < rhs.i;
+        }
+
+    private:
+        const feature_store* store; ///< The store
+        std::size_t i;              ///< The index of the row
+    };
+
+    using iterator = const_iterator;
+
+    /*!
+     * \brief Map the given feature file
+     * \param path The path of the file
+     */
+    explicit feature_store(const std::string& path) {
+        auto fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "dll: Impossible to open the feature file " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && std::size_t(st.st_size) >= sizeof(feature_header)) {
+            length = st.st_size;
+
+            auto memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (memory != MAP_FAILED) {
+                mapping = static_cast<const char*>(memory);
+            }
+        }
+
+        ::close(fd);
+
+        if (!mapping) {
+            std::cerr << "dll: Impossible to map the feature file " << path << std::endl;
+            return;
+        }
+
+        std::memcpy(&header, mapping, sizeof(header));
+
+        if (!valid_feature_header<W>(header, length)) {
+            std::cerr << "dll: Invalid feature file " << path << std::endl;
+            unmap();
+        }
+    }
+
+    feature_store(const feature_store& rhs) = delete;
+    feature_store& operator=(const feature_store& rhs) = delete;
+
+    ~feature_store() {
+        unmap();
+    }
+
+    /*!
+     * \brief Indicates if the file has been successfully mapped
+     */
+    bool is_open() const {
+        return mapping != nullptr;
+    }
+
+    /*!
+     * \brief Returns the number of rows
+     */
+    std::size_t size() const {
+        return is_open() ? header.count : 0;
+    }
+
+    /*!
+     * \brief Returns the number of values per row
+     */
+    std::size_t dims() const {
+        return header.dims;
+    }
+
+    /*!
+     * \brief Returns the ith row
+     */
+    row_t operator[](std::size_t i) const {
+        return {reinterpret_cast<const W*>(mapping + header.offset + i * header.row_stride), header.dims};
+    }
+
+    const_iterator begin() const {
+        return {this, 0};
+    }
+
+    const_iterator end() const {
+        return {this, size()};
+    }
+
+private:
+    void unmap() {
+        if (mapping) {
+            munmap(const_cast<char*>(mapping), length);
+            mapping = nullptr;
+        }
+    }
+
+    const char* mapping = nullptr; ///< The mapped file
+    std::size_t length  = 0;       ///< The length of the mapping
+    feature_header header{};       ///< The header of the file
+};
+
+} //end of dll namespace
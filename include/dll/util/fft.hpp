@@ -0,0 +1,383 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fft.hpp
+ * \brief Built-in mixed-radix FFT.
+ *
+ * The complex transforms use a recursive decimation in time, with a
+ * dedicated radix-2 butterfly and a generic butterfly for the other factors.
+ * The 2D real transforms only keep the N1 x (N2 / 2 + 1) non-redundant
+ * values of the spectrum and transform two real rows with each complex FFT.
+ *
+ * The temporary memory of the transforms is kept per thread in an
+ * fft_workspace, the transforms do not allocate once it has grown to the
+ * size of the transforms.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the smallest size, at least n, whose only prime factors are
+ * 2, 3 and 5
+ */
+inline std::size_t fft_size(std::size_t n) {
+    for (std::size_t m = n;; ++m) {
+        std::size_t r = m;
+
+        for (std::size_t p : {2, 3, 5}) {
+            while (r % p == 0) {
+                r /= p;
+            }
+        }
+
+        if (r == 1) {
+            return m;
+        }
+    }
+}
+
+/*!
+ * \brief Temporary memory of the transforms, one per thread.
+ *
+ * Each buffer is used by a single function, the buffers of the functions
+ * calling each other do not overlap.
+ */
+template <typename T>
+struct fft_workspace {
+    using complex = std::complex<T>;
+
+    std::vector<complex> conjugate; ///< The conjugate input of fft_plan::inverse
+    std::vector<complex> row;       ///< A pair of rows of rfft2_plan
+    std::vector<complex> row_f;     ///< The transform of a pair of rows of rfft2_plan
+    std::vector<complex> column;    ///< A column of rfft2_plan
+    std::vector<complex> column_f;  ///< The transform of a column of rfft2_plan
+    std::vector<complex> spectra;   ///< The transformed inputs of conv_spectra
+    std::vector<complex> acc;       ///< The accumulated spectra of conv_spectra
+
+    /*!
+     * \brief Returns the workspace of the current thread
+     */
+    static fft_workspace& local() {
+        static thread_local fft_workspace workspace;
+        return workspace;
+    }
+
+    /*!
+     * \brief Returns the memory of the given buffer, grown to at least n
+     * values
+     */
+    static complex* get(std::vector<complex>& buffer, std::size_t n) {
+        if (buffer.size() < n) {
+            buffer.resize(n);
+        }
+
+        return buffer.data();
+    }
+};
+
+/*!
+ * \brief Complex FFT of a fixed size
+ */
+template <typename T>
+struct fft_plan {
+    using complex = std::complex<T>;
+
+    fft_plan() = default;
+
+    /*!
+     * \brief Prepare the transforms of size n
+     */
+    explicit fft_plan(std::size_t n)
+            : n(n), twiddles(n) {
+        cpp_assert(n > 0, "The FFT needs at least one value");
+
+        for (std::size_t k = 0; k < n; ++k) {
+            twiddles[k] = std::polar(T(1), T(-2.0 * M_PI * double(k) / double(n)));
+        }
+
+        std::size_t r = n;
+        std::size_t p = 2;
+
+        while (r > 1) {
+            while (r % p) {
+                p = p == 2 ? 3 : p + 2;
+            }
+
+            r /= p;
+
+            factors.push_back(p);
+            factors.push_back(r);
+        }
+    }
+
+    std::size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Compute the forward transform of in into out (not in place)
+     */
+    void forward(const complex* in, complex* out) const {
+        if (n == 1) {
+            out[0] = in[0];
+        } else {
+            work(out, in, 1, factors.data());
+        }
+    }
+
+    /*!
+     * \brief Compute the inverse transform, not normalized, of in into out
+     * (not in place)
+     */
+    void inverse(const complex* in, complex* out) const {
+        auto& workspace = fft_workspace<T>::local();
+
+        complex* tmp = fft_workspace<T>::get(workspace.conjugate, n);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            tmp[i] = std::conj(in[i]);
+        }
+
+        forward(tmp, out);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = std::conj(out[i]);
+        }
+    }
+
+private:
+    void work(complex* out, const complex* in, std::size_t stride, const std::size_t* f) const {
+        const std::size_t p = f[0]; //The radix
+        const std::size_t m = f[1]; //The size of the sub transforms
+
+        if (m == 1) {
+            for (std::size_t j = 0; j < p; ++j) {
+                out[j] = in[j * stride];
+            }
+        } else {
+            for (std::size_t j = 0; j < p; ++j) {
+                work(out + j * m, in + j * stride, stride * p, f + 2);
+            }
+        }
+
+        if (p == 2) {
+            butterfly_2(out, stride, m);
+        } else {
+            butterfly(out, stride, m, p);
+        }
+    }
+
+    void butterfly_2(complex* out, std::size_t stride, std::size_t m) const {
+        for (std::size_t k = 0; k < m; ++k) {
+            const complex t = out[k + m] * twiddles[k * stride];
+
+            out[k + m] = out[k] - t;
+            out[k] += t;
+        }
+    }
+
+    void butterfly(complex* out, std::size_t stride, std::size_t m, std::size_t p) const {
+        complex scratch[7];
+        std::vector<complex> large;
+
+        complex* s = scratch;
+
+        if (p > 7) {
+            large.resize(p);
+            s = large.data();
+        }
+
+        for (std::size_t u = 0; u < m; ++u) {
+            for (std::size_t q = 0; q < p; ++q) {
+                s[q] = out[u + q * m];
+            }
+
+            for (std::size_t q1 = 0, k = u; q1 < p; ++q1, k += m) {
+                std::size_t index = 0;
+
+                out[k] = s[0];
+
+                for (std::size_t q = 1; q < p; ++q) {
+                    index += stride * k;
+
+                    if (index >= n) {
+                        index -= n;
+                    }
+
+                    out[k] += s[q] * twiddles[index];
+                }
+            }
+        }
+    }
+
+    std::size_t n = 0;                ///< The size of the transform
+    std::vector<complex> twiddles;    ///< The roots of unity
+    std::vector<std::size_t> factors; ///< The (radix, remaining size) pairs
+};
+
+/*!
+ * \brief 2D FFT of real matrices of a fixed size
+ *
+ * The spectra are stored in row-major order, with N1 rows of N2 / 2 + 1
+ * values.
+ */
+template <typename T>
+struct rfft2_plan {
+    using complex = std::complex<T>;
+
+    /*!
+     * \brief Prepare the transforms of size n1 x n2
+     */
+    rfft2_plan(std::size_t n1, std::size_t n2)
+            : n1(n1), n2(n2), h(n2 / 2 + 1), rows(n2), columns(n1) {}
+
+    /*!
+     * \brief Returns the number of values of a spectrum
+     */
+    std::size_t spectrum_size() const {
+        return n1 * h;
+    }
+
+    /*!
+     * \brief Compute the spectrum of the r1 x r2 real matrix in, padded with
+     * zeroes to n1 x n2.
+     */
+    void forward(const T* in, std::size_t r1, std::size_t r2, complex* out) const {
+        cpp_assert(r1 <= n1 && r2 <= n2, "The matrix is larger than the transform");
+
+        auto& workspace = fft_workspace<T>::local();
+
+        complex* z  = fft_workspace<T>::get(workspace.row, n2);
+        complex* zf = fft_workspace<T>::get(workspace.row_f, n2);
+
+        //Transform the rows two at a time, the padding rows are null
+
+        for (std::size_t i = 0; i < n1; i += 2) {
+            if (i >= r1) {
+                std::fill(out + i * h, out + n1 * h, complex(0));
+                break;
+            }
+
+            const bool pair = i + 1 < r1;
+
+            for (std::size_t j = 0; j < n2; ++j) {
+                T a = j < r2 ? in[i * r2 + j] : T(0);
+                T b = j < r2 && pair ? in[(i + 1) * r2 + j] : T(0);
+                z[j] = complex(a, b);
+            }
+
+            rows.forward(z, zf);
+
+            for (std::size_t k = 0; k < h; ++k) {
+                const complex x = zf[k];
+                const complex y = std::conj(zf[(n2 - k) % n2]);
+
+                out[i * h + k] = T(0.5) * (x + y);
+
+                if (i + 1 < n1) {
+                    out[(i + 1) * h + k] = complex(0, T(-0.5)) * (x - y);
+                }
+            }
+        }
+
+        //Transform the columns
+
+        transform_columns(out, false);
+    }
+
+    /*!
+     * \brief Compute the real matrix of the given spectrum and write its
+     * first r1 x r2 values, multiplied by scale, to out.
+     *
+     * The spectrum is used as temporary storage.
+     */
+    void inverse(complex* spectrum, T* out, std::size_t r1, std::size_t r2, T scale) const {
+        cpp_assert(r1 <= n1 && r2 <= n2, "The matrix is larger than the transform");
+
+        transform_columns(spectrum, true);
+
+        scale /= T(n1 * n2);
+
+        auto& workspace = fft_workspace<T>::local();
+
+        complex* z  = fft_workspace<T>::get(workspace.row, n2);
+        complex* zf = fft_workspace<T>::get(workspace.row_f, n2);
+
+        //Transform the rows two at a time, with their full (hermitian) spectra
+
+        for (std::size_t i = 0; i < r1; i += 2) {
+            const bool pair = i + 1 < r1;
+
+            for (std::size_t k = 0; k < n2; ++k) {
+                const bool direct = k < h;
+                const std::size_t kk = direct ? k : n2 - k;
+
+                complex a = spectrum[i * h + kk];
+                complex b = pair ? spectrum[(i + 1) * h + kk] : complex(0);
+
+                if (!direct) {
+                    a = std::conj(a);
+                    b = std::conj(b);
+                }
+
+                zf[k] = a + complex(0, 1) * b;
+            }
+
+            rows.inverse(zf, z);
+
+            for (std::size_t j = 0; j < r2; ++j) {
+                out[i * r2 + j] = scale * z[j].real();
+
+                if (pair) {
+                    out[(i + 1) * r2 + j] = scale * z[j].imag();
+                }
+            }
+        }
+    }
+
+private:
+    void transform_columns(complex* spectrum, bool inverse) const {
+        auto& workspace = fft_workspace<T>::local();
+
+        complex* c  = fft_workspace<T>::get(workspace.column, n1);
+        complex* cf = fft_workspace<T>::get(workspace.column_f, n1);
+
+        for (std::size_t k = 0; k < h; ++k) {
+            for (std::size_t i = 0; i < n1; ++i) {
+                c[i] = spectrum[i * h + k];
+            }
+
+            if (inverse) {
+                columns.inverse(c, cf);
+            } else {
+                columns.forward(c, cf);
+            }
+
+            for (std::size_t i = 0; i < n1; ++i) {
+                spectrum[i * h + k] = cf[i];
+            }
+        }
+    }
+
+    std::size_t n1;      ///< The number of rows of the transform
+    std::size_t n2;      ///< The number of columns of the transform
+    std::size_t h;       ///< The number of columns of the spectra
+    fft_plan<T> rows;    ///< The transform of the rows
+    fft_plan<T> columns; ///< The transform of the columns
+};
+
+} //end of dll namespace
@@ -0,0 +1,236 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file fft_conv.hpp
+ * \brief FFT convolutions of the convolutional RBMs.
+ *
+ * The kernels are transformed once, at the size of the visible units, after
+ * each modification of the weights. The same spectra are used by the valid
+ * convolutions (with the conjugate of the spectra) and by the full
+ * convolutions. Each input is only transformed once and reused for all the
+ * kernels. The transformed inputs and the accumulated spectra are kept in
+ * the fft_workspace of the current thread.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "fft.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The spectra of the NC x K kernels of a convolutional RBM
+ */
+template <typename T>
+struct conv_spectra {
+    using complex = std::complex<T>;
+
+    std::size_t NC;  ///< The number of channels
+    std::size_t K;   ///< The number of kernels
+    std::size_t NV1; ///< The first dimension of the visible units
+    std::size_t NV2; ///< The second dimension of the visible units
+    std::size_t NH1; ///< The first dimension of the hidden units
+    std::size_t NH2; ///< The second dimension of the hidden units
+
+    rfft2_plan<T> plan;          ///< The transform of the matrices
+    std::vector<complex> values; ///< The spectra of the kernels
+
+    conv_spectra(std::size_t nc, std::size_t k, std::size_t nv1, std::size_t nv2, std::size_t nh1, std::size_t nh2)
+            : NC(nc), K(k), NV1(nv1), NV2(nv2), NH1(nh1), NH2(nh2), plan(fft_size(nv1), fft_size(nv2)) {}
+
+    /*!
+     * \brief Transform the given kernels (NC x K x NW1 x NW2)
+     */
+    template <typename W>
+    void assign(const W& w) {
+        const std::size_t NW1 = NV1 - NH1 + 1;
+        const std::size_t NW2 = NV2 - NH2 + 1;
+
+        cpp_assert(etl::size(w) == NC * K * NW1 * NW2, "Invalid dimensions for the kernels");
+
+        values.resize(NC * K * plan.spectrum_size());
+
+        transform(w.memory_start(), NC * K, NW1, NW2, values.data());
+    }
+
+    /*!
+     * \brief Transform the n r1 x r2 matrices stored at in into out
+     */
+    void transform(const T* in, std::size_t n, std::size_t r1, std::size_t r2, complex* out) const {
+        const std::size_t s = plan.spectrum_size();
+
+        for (std::size_t i = 0; i < n; ++i) {
+            plan.forward(in + i * r1 * r2, r1, r2, out + i * s);
+        }
+    }
+
+    /*!
+     * \brief Transform the n r1 x r2 matrices stored at in into the
+     * workspace of the current thread.
+     *
+     * \return a pointer to the spectra, valid until the next transform of
+     * the current thread
+     */
+    const complex* transform(const T* in, std::size_t n, std::size_t r1, std::size_t r2) const {
+        complex* out = fft_workspace<T>::get(fft_workspace<T>::local().spectra, n * plan.spectrum_size());
+
+        transform(in, n, r1, r2, out);
+
+        return out;
+    }
+
+    /*!
+     * \brief Compute the valid convolutions of the transformed visible units
+     * (NC spectra) with the flipped kernels. The result of the kernel k,
+     * sum_c v(c) * w(c)(k), is written to output(k).
+     */
+    template <typename Output>
+    void valid(const complex* v, Output&& output) const {
+        const std::size_t s = plan.spectrum_size();
+
+        complex* acc = fft_workspace<T>::get(fft_workspace<T>::local().acc, s);
+
+        for (std::size_t k = 0; k < K; ++k) {
+            std::fill(acc, acc + s, complex(0));
+
+            for (std::size_t c = 0; c < NC; ++c) {
+                const complex* vc = v + c * s;
+                const complex* wc = values.data() + (c * K + k) * s;
+
+                for (std::size_t i = 0; i < s; ++i) {
+                    acc[i] += vc[i] * std::conj(wc[i]);
+                }
+            }
+
+            plan.inverse(acc, output(k), NH1, NH2, T(1));
+        }
+    }
+
+    /*!
+     * \brief Compute the full convolution of the transformed hidden units (K
+     * spectra) with the kernels of the given channel, sum_k h(k) * w(c)(k),
+     * and write it to output.
+     */
+    void full(const complex* h, std::size_t c, T* output) const {
+        const std::size_t s = plan.spectrum_size();
+
+        complex* acc = fft_workspace<T>::get(fft_workspace<T>::local().acc, s);
+
+        std::fill(acc, acc + s, complex(0));
+
+        for (std::size_t k = 0; k < K; ++k) {
+            const complex* hk = h + k * s;
+            const complex* wk = values.data() + (c * K + k) * s;
+
+            for (std::size_t i = 0; i < s; ++i) {
+                acc[i] += hk[i] * wk[i];
+            }
+        }
+
+        plan.inverse(acc, output, NV1, NV2, T(1));
+    }
+};
+
+/*!
+ * \brief Cache of the spectra of the weights of a convolutional RBM.
+ *
+ * As the flip_cache, the spectra are only computed again when the weights
+ * have been modified (invalidate()) since the last transform.
+ *
+ * In debug mode, the cache keeps a copy of the weights it has transformed
+ * and asserts on each access that the weights have not been modified
+ * without invalidating the cache.
+ */
+template <typename T>
+struct spectrum_cache {
+    spectrum_cache(std::size_t nc, std::size_t k, std::size_t nv1, std::size_t nv2, std::size_t nh1, std::size_t nh2)
+            : spectra(nc, k, nv1, nv2, nh1, nh2) {}
+
+    //No copying
+    spectrum_cache(const spectrum_cache& cache) = delete;
+    spectrum_cache& operator=(const spectrum_cache& cache) = delete;
+
+    //No moving
+    spectrum_cache(spectrum_cache&& cache) = delete;
+    spectrum_cache& operator=(spectrum_cache&& cache) = delete;
+
+    /*!
+     * \brief Returns the spectra of the given weights
+     * \param w The weights, must be the weights this cache is bound to
+     */
+    template <typename W>
+    const conv_spectra<T>& get(const W& w) const {
+        auto current = version.load(std::memory_order_acquire);
+
+        if (spectra_version.load(std::memory_order_acquire) != current) {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (spectra_version.load(std::memory_order_relaxed) != current) {
+                spectra.assign(w);
+
+#ifndef NDEBUG
+                source.assign(w.memory_start(), w.memory_start() + etl::size(w));
+#endif
+
+                spectra_version.store(current, std::memory_order_release);
+            }
+        }
+
+#ifndef NDEBUG
+        cpp_assert(std::equal(w.memory_start(), w.memory_start() + etl::size(w), source.begin()),
+                   "The weights have been modified without calling weights_changed()");
+#endif
+
+        return spectra;
+    }
+
+    /*!
+     * \brief Indicates that the weights have changed and that the spectra
+     * must be computed again on next access.
+     */
+    void invalidate() {
+        version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    mutable conv_spectra<T> spectra;                     ///< The spectra of the weights
+#ifndef NDEBUG
+    mutable std::vector<T> source;                       ///< The weights that have been transformed
+#endif
+    mutable std::mutex lock;                             ///< The lock protecting the transform
+    mutable std::atomic<std::size_t> spectra_version{0}; ///< The version of the weights that have been transformed
+    std::atomic<std::size_t> version{1};                 ///< The current version of the weights
+};
+
+/*!
+ * \brief Empty placeholder of the spectrum_cache of the layers not using
+ * the FFT convolutions
+ */
+struct no_spectrum_cache {
+    no_spectrum_cache(std::size_t /*nc*/, std::size_t /*k*/, std::size_t /*nv1*/, std::size_t /*nv2*/, std::size_t /*nh1*/, std::size_t /*nh2*/) {}
+
+    void invalidate() {}
+};
+
+/*!
+ * \brief A spectrum_cache when C is true, an empty placeholder otherwise
+ */
+template <bool C, typename T>
+using conditional_spectrum_cache_t = std::conditional_t<C, spectrum_cache<T>, no_spectrum_cache>;
+
+} //end of dll namespace
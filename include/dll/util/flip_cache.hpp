@@ -0,0 +1,116 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file flip_cache.hpp
+ * \brief Versioned cache of the flipped kernels of a convolutional layer.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Flip all the kernels of a 4D weight tensor horizontally and
+ * vertically.
+ */
+template <typename W>
+void deep_fflip(W&& w_f) {
+    for (std::size_t channel = 0; channel < etl::dim<0>(w_f); ++channel) {
+        for (std::size_t k = 0; k < etl::dim<1>(w_f); ++k) {
+            w_f(channel)(k).fflip_inplace();
+        }
+    }
+}
+
+/*!
+ * \brief Cache of the flipped version of the weights of a convolutional
+ * layer.
+ *
+ * The flipped weights are only computed again when the version of the
+ * weights changed since the last flip. The version must be incremented (with
+ * invalidate()) each time the weights are modified. The layers owning a
+ * cache expose this as weights_changed(), which must be called after each
+ * modification of their public weights.
+ *
+ * In debug mode, the cache keeps a copy of the weights it has flipped and
+ * asserts on each access that the weights have not been modified without
+ * invalidating the cache.
+ *
+ * The flipped weights can be safely accessed concurrently from several
+ * threads as long as the weights are not modified at the same time.
+ */
+template <typename W>
+struct flip_cache {
+    flip_cache() = default;
+
+    //No copying
+    flip_cache(const flip_cache& cache) = delete;
+    flip_cache& operator=(const flip_cache& cache) = delete;
+
+    //No moving
+    flip_cache(flip_cache&& cache) = delete;
+    flip_cache& operator=(flip_cache&& cache) = delete;
+
+    /*!
+     * \brief Returns the flipped version of the given weights
+     * \param w The weights, must be the weights this cache is bound to
+     * \return A reference to the flipped weights
+     */
+    const W& get(const W& w) const {
+        auto current = version.load(std::memory_order_acquire);
+
+        if (flipped_version.load(std::memory_order_acquire) != current) {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (flipped_version.load(std::memory_order_relaxed) != current) {
+                flipped = w;
+                deep_fflip(flipped);
+
+#ifndef NDEBUG
+                source = w;
+#endif
+
+                flipped_version.store(current, std::memory_order_release);
+            }
+        }
+
+#ifndef NDEBUG
+        cpp_assert(std::equal(w.memory_start(), w.memory_start() + etl::size(w), source.memory_start()),
+                   "The weights have been modified without calling weights_changed()");
+#endif
+
+        return flipped;
+    }
+
+    /*!
+     * \brief Indicates that the weights have changed and that the flipped
+     * weights must be computed again on next access.
+     */
+    void invalidate() {
+        version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    mutable W flipped;                                   ///< The flipped weights
+#ifndef NDEBUG
+    mutable W source;                                    ///< The weights that have been flipped
+#endif
+    mutable std::mutex lock;                             ///< The lock protecting the flip
+    mutable std::atomic<std::size_t> flipped_version{0}; ///< The version of the weights that have been flipped
+    std::atomic<std::size_t> version{1};                 ///< The current version of the weights
+};
+
+} //end of dll namespace
@@ -0,0 +1,142 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file int8.hpp
+ * \brief Kernels for 8-bit integer inference.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__) || (defined(__AVX512BW__) && defined(__AVX512VNNI__))
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+namespace int8 {
+
+constexpr const std::size_t padding = 64; ///< The vectors are padded to a multiple of this number of elements
+
+/*!
+ * \brief Returns the padded size of a vector of n elements
+ */
+constexpr std::size_t padded_size(std::size_t n) {
+    return ((n + padding - 1) / padding) * padding;
+}
+
+/*!
+ * \brief Quantize n values to signed 8-bit integers with the given scale.
+ *
+ * The elements of the output between n and padded_size(n) are set to zero.
+ */
+template <typename W>
+void quantize(const W* input, std::int8_t* output, std::size_t n, W scale) {
+    const W inv_scale = W(1) / scale;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        auto q    = std::round(input[i] * inv_scale);
+        output[i] = static_cast<std::int8_t>(std::min(std::max(q, W(-127)), W(127)));
+    }
+
+    std::fill(output + n, output + padded_size(n), std::int8_t(0));
+}
+
+#if defined(__AVX512BW__) && defined(__AVX512VNNI__)
+
+/*!
+ * \brief Compute the dot product of two int8 vectors of n elements, n being a
+ * multiple of padding.
+ *
+ * vpdpbusd only multiplies unsigned bytes by signed bytes, a is shifted by 128
+ * to make it unsigned and 128 * sum(b) is removed from the result.
+ */
+inline std::int32_t dot(const std::int8_t* a, const std::int8_t* b, std::int32_t b_sum, std::size_t n) {
+    const __m512i shift = _mm512_set1_epi8(static_cast<char>(0x80));
+
+    __m512i acc = _mm512_setzero_si512();
+
+    for (std::size_t i = 0; i < n; i += 64) {
+        __m512i a_u = _mm512_xor_si512(_mm512_load_si512(reinterpret_cast<const void*>(a + i)), shift);
+        __m512i b_s = _mm512_load_si512(reinterpret_cast<const void*>(b + i));
+
+        acc = _mm512_dpbusd_epi32(acc, a_u, b_s);
+    }
+
+    return _mm512_reduce_add_epi32(acc) - 128 * b_sum;
+}
+
+#elif defined(__AVX2__)
+
+/*!
+ * \brief Compute the dot product of two int8 vectors of n elements, n being a
+ * multiple of padding.
+ *
+ * The bytes are widened to 16-bit before the multiplication in order to avoid
+ * the saturation of vpmaddubsw.
+ */
+inline std::int32_t dot(const std::int8_t* a, const std::int8_t* b, std::int32_t /*b_sum*/, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+
+    for (std::size_t i = 0; i < n; i += 16) {
+        __m256i a_w = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i b_w = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(b + i)));
+
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a_w, b_w));
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum         = _mm_hadd_epi32(sum, sum);
+    sum         = _mm_hadd_epi32(sum, sum);
+
+    return _mm_cvtsi128_si32(sum);
+}
+
+#else
+
+/*!
+ * \brief Compute the dot product of two int8 vectors of n elements, n being a
+ * multiple of padding.
+ */
+inline std::int32_t dot(const std::int8_t* a, const std::int8_t* b, std::int32_t /*b_sum*/, std::size_t n) {
+    std::int32_t acc = 0;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        acc += std::int32_t(a[i]) * std::int32_t(b[i]);
+    }
+
+    return acc;
+}
+
+#endif
+
+/*!
+ * \brief Compute C = A * B^T where A (m x k) contains m quantized inputs and B
+ * (n x k) contains the n quantized columns of the weights.
+ *
+ * k must be a multiple of padding and all the rows must be aligned on 64
+ * bytes. b_sums contains the sum of each row of B.
+ *
+ * Each row of B is used for all the inputs before moving to the next one.
+ */
+inline void gemm(const std::int8_t* a, const std::int8_t* b, const std::int32_t* b_sums, std::int32_t* c, std::size_t m, std::size_t n, std::size_t k) {
+    for (std::size_t j = 0; j < n; ++j) {
+        const std::int8_t* b_j = b + j * k;
+
+        for (std::size_t i = 0; i < m; ++i) {
+            c[i * n + j] = dot(a + i * k, b_j, b_sums[j], k);
+        }
+    }
+}
+
+} //end of namespace int8
+
+} //end of namespace dll
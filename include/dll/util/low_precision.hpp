@@ -0,0 +1,356 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file low_precision.hpp
+ * \brief Low-precision copy of the weights used by the batch Gibbs steps.
+ *
+ * The weights are stored as float16 or bfloat16 and widened by tiles of
+ * rows into a buffer kept with the weights. Each tile is then multiplied
+ * with the whole batch, by BLAS when it is available, the products being
+ * accumulated in the weight type. This halves the memory traffic on the
+ * weights, which dominates the Gibbs steps of the large RBMs.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "compact.hpp"
+#include "blas.hpp"
+
+namespace dll {
+
+namespace low_precision_detail {
+
+constexpr const std::size_t tile_rows    = 64;  ///< The number of rows of the weights widened together
+constexpr const std::size_t tile_columns = 256; ///< The number of output columns accumulated together
+constexpr const std::size_t dot_lanes    = 8;   ///< The number of partial sums of the dot products
+
+/*!
+ * \brief Widen n compact values
+ */
+template <typename W, storage_type S>
+struct widener {
+    using storage_t = typename compact_codec<W, S>::storage_t;
+
+    static void apply(const storage_t* input, W* output, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            output[i] = compact_codec<W, S>::decode(input[i]);
+        }
+    }
+};
+
+/*!
+ * \brief Narrow n values to their compact form
+ */
+template <typename W, storage_type S>
+struct narrower {
+    using storage_t = typename compact_codec<W, S>::storage_t;
+
+    static void apply(const W* input, storage_t* output, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            output[i] = compact_codec<W, S>::encode(input[i]);
+        }
+    }
+};
+
+#ifdef __F16C__
+
+/*!
+ * \brief Widen n half-precision values, eight at a time
+ */
+template <>
+struct widener<float, storage_type::FLOAT16> {
+    static void apply(const std::uint16_t* input, float* output, std::size_t n) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(output + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i))));
+        }
+
+        for (; i < n; ++i) {
+            output[i] = half_to_float(input[i]);
+        }
+    }
+};
+
+/*!
+ * \brief Narrow n floats to half-precision, eight at a time
+ */
+template <>
+struct narrower<float, storage_type::FLOAT16> {
+    static void apply(const float* input, std::uint16_t* output, std::size_t n) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm256_cvtps_ph(_mm256_loadu_ps(input + i), 0));
+        }
+
+        for (; i < n; ++i) {
+            output[i] = float_to_half(input[i]);
+        }
+    }
+};
+
+#endif
+
+/*!
+ * \brief Accumulate c += a * w, with a (batch x kn, leading dimension lda),
+ * w (kn x m) and c (batch x m).
+ *
+ * Without BLAS, the columns of c are accumulated by blocks in a local array
+ * so that the inner loop can be vectorized and each output row is only
+ * read and written once per block. The null inputs, common with binary
+ * units, are skipped.
+ */
+template <typename W>
+void tile_mul_acc(const W* a, std::size_t lda, const W* w, std::size_t kn, W* c, std::size_t batch, std::size_t m) {
+#ifdef ETL_BLAS_MODE
+    blas_gemm(false, batch, m, kn, W(1), a, lda, w, m, W(1), c, m);
+#else
+    W acc[tile_columns];
+
+    for (std::size_t j = 0; j < m; j += tile_columns) {
+        const std::size_t jn = std::min(tile_columns, m - j);
+
+        for (std::size_t b = 0; b < batch; ++b) {
+            const W* a_b = a + b * lda;
+            W* c_b       = c + b * m + j;
+
+            std::copy(c_b, c_b + jn, acc);
+
+            for (std::size_t k = 0; k < kn; ++k) {
+                const W x = a_b[k];
+
+                if (x != W(0)) {
+                    const W* w_k = w + k * m + j;
+
+                    for (std::size_t jj = 0; jj < jn; ++jj) {
+                        acc[jj] += x * w_k[jj];
+                    }
+                }
+            }
+
+            std::copy(acc, acc + jn, c_b);
+        }
+    }
+#endif
+}
+
+/*!
+ * \brief Compute c = a * w^T, with a (batch x m), w (kn x m) and c (batch x
+ * kn, leading dimension ldc).
+ *
+ * Without BLAS, the dot products are computed with dot_lanes independent
+ * partial sums so that they can be vectorized.
+ */
+template <typename W>
+void tile_mul_t(const W* a, const W* w, std::size_t kn, W* c, std::size_t ldc, std::size_t batch, std::size_t m) {
+#ifdef ETL_BLAS_MODE
+    blas_gemm(true, batch, kn, m, W(1), a, m, w, m, W(0), c, ldc);
+#else
+    for (std::size_t b = 0; b < batch; ++b) {
+        const W* a_b = a + b * m;
+
+        for (std::size_t k = 0; k < kn; ++k) {
+            const W* w_k = w + k * m;
+
+            W sums[dot_lanes] = {};
+
+            std::size_t j = 0;
+
+            for (; j + dot_lanes <= m; j += dot_lanes) {
+                for (std::size_t l = 0; l < dot_lanes; ++l) {
+                    sums[l] += a_b[j + l] * w_k[j + l];
+                }
+            }
+
+            W sum(0);
+
+            for (std::size_t l = 0; l < dot_lanes; ++l) {
+                sum += sums[l];
+            }
+
+            for (; j < m; ++j) {
+                sum += a_b[j] * w_k[j];
+            }
+
+            c[b * ldc + k] = sum;
+        }
+    }
+#endif
+}
+
+} //end of namespace low_precision_detail
+
+/*!
+ * \brief A matrix of weights stored with a lower precision than the weight
+ * type W.
+ *
+ * The weights keep the buffer the tiles are widened into, a set of
+ * low-precision weights must therefore not be used by several threads at
+ * the same time.
+ */
+template <typename W, storage_type S>
+struct low_precision_weights {
+    static_assert(S == storage_type::FLOAT16 || S == storage_type::BFLOAT16, "The weights can only be stored as float16 or bfloat16");
+
+    using value_type = W;                           ///< The type of the values
+    using codec_t    = compact_codec<W, S>;         ///< The conversion of the values
+    using storage_t  = typename codec_t::storage_t; ///< The type of the stored values
+
+    /*!
+     * \brief Store the given weights
+     */
+    template <typename M>
+    explicit low_precision_weights(const M& w) {
+        *this = w;
+    }
+
+    /*!
+     * \brief Replace the stored weights by the given weights.
+     *
+     * The memory is only allocated when the dimensions change.
+     */
+    template <typename M>
+    low_precision_weights& operator=(const M& w) {
+        if (n_rows != etl::dim<0>(w) || n_columns != etl::dim<1>(w)) {
+            n_rows    = etl::dim<0>(w);
+            n_columns = etl::dim<1>(w);
+
+            data.resize(n_rows * n_columns);
+            tile.resize(std::min(low_precision_detail::tile_rows, n_rows) * n_columns);
+        }
+
+        low_precision_detail::narrower<W, S>::apply(w.memory_start(), data.data(), data.size());
+
+        return *this;
+    }
+
+    std::size_t rows() const {
+        return n_rows;
+    }
+
+    std::size_t columns() const {
+        return n_columns;
+    }
+
+    /*!
+     * \brief Widen the rows [i, i + n) in the tile buffer, n being at most
+     * low_precision_detail::tile_rows.
+     *
+     * \return a pointer to the widened rows, valid until the next call
+     */
+    const W* widen_rows(std::size_t i, std::size_t n) const {
+        cpp_assert(n * n_columns <= tile.size() && i + n <= n_rows, "Invalid rows to widen");
+
+        low_precision_detail::widener<W, S>::apply(data.data() + i * n_columns, tile.data(), n * n_columns);
+
+        return tile.data();
+    }
+
+private:
+    std::size_t n_rows    = 0;   ///< The number of rows
+    std::size_t n_columns = 0;   ///< The number of columns
+    std::vector<storage_t> data; ///< The compact weights, in row-major order
+    mutable std::vector<W> tile; ///< The widened rows of the current tile
+};
+
+/*!
+ * \brief Empty placeholder when the weights are used directly
+ */
+template <typename W>
+struct low_precision_weights<W, storage_type::NATIVE> {
+    template <typename M>
+    explicit low_precision_weights(const M&) {}
+
+    template <typename M>
+    low_precision_weights& operator=(const M&) {
+        return *this;
+    }
+};
+
+/*!
+ * \brief Compute the hidden pre-activation of a batch, output = input * w
+ */
+template <typename O, typename I, typename W>
+void hidden_pre_activation(O&& output, const I& input, const W& w) {
+    output = input * w;
+}
+
+/*!
+ * \brief Compute the hidden pre-activation of a batch, output = input * w,
+ * with low-precision weights.
+ *
+ * The rows of w are widened by tiles, each tile being multiplied with the
+ * corresponding columns of the input and accumulated into the output.
+ */
+template <typename O, typename I, typename W, storage_type S>
+void hidden_pre_activation(O&& output, const I& input, const low_precision_weights<W, S>& w) {
+    const std::size_t batch = etl::dim<0>(input);
+    const std::size_t n     = w.rows();
+    const std::size_t m     = w.columns();
+
+    cpp_assert(etl::dim<1>(input) == n && etl::dim<0>(output) == batch && etl::dim<1>(output) == m, "Invalid dimensions for the pre-activation");
+
+    output = W(0);
+
+    const auto* in = input.memory_start();
+    auto* out      = output.memory_start();
+
+    for (std::size_t i = 0; i < n; i += low_precision_detail::tile_rows) {
+        const std::size_t kn = std::min(low_precision_detail::tile_rows, n - i);
+
+        low_precision_detail::tile_mul_acc(in + i, n, w.widen_rows(i, kn), kn, out, batch, m);
+    }
+}
+
+/*!
+ * \brief Compute the visible pre-activation of a batch, output = input * w^T
+ */
+template <typename O, typename I, typename W>
+void visible_pre_activation(O&& output, const I& input, const W& w) {
+    output = input * etl::transpose(w);
+}
+
+/*!
+ * \brief Compute the visible pre-activation of a batch, output = input * w^T,
+ * with low-precision weights.
+ *
+ * The rows of w are widened by tiles, each tile computing the corresponding
+ * columns of the output for the whole batch.
+ */
+template <typename O, typename I, typename W, storage_type S>
+void visible_pre_activation(O&& output, const I& input, const low_precision_weights<W, S>& w) {
+    const std::size_t batch = etl::dim<0>(input);
+    const std::size_t n     = w.rows();
+    const std::size_t m     = w.columns();
+
+    cpp_assert(etl::dim<1>(input) == m && etl::dim<0>(output) == batch && etl::dim<1>(output) == n, "Invalid dimensions for the pre-activation");
+
+    const auto* in = input.memory_start();
+    auto* out      = output.memory_start();
+
+    for (std::size_t i = 0; i < n; i += low_precision_detail::tile_rows) {
+        const std::size_t kn = std::min(low_precision_detail::tile_rows, n - i);
+
+        low_precision_detail::tile_mul_t(in, w.widen_rows(i, kn), kn, out + i, n, batch, m);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,128 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file permutation.hpp
+ * \brief Iteration over a sequence in the order of a permutation of its
+ * indices.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <vector>
+#include <numeric>
+#include <iterator>
+
+namespace dll {
+
+/*!
+ * \brief Random access iterator over the elements base[order[0]],
+ * base[order[1]], ...
+ *
+ * Shuffling the order shuffles the sequence seen through the iterators
+ * without moving the elements themselves.
+ */
+template <typename Iterator>
+struct permutation_iterator {
+    using index_iterator = std::vector<std::size_t>::const_iterator; ///< The iterator over the indices
+
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type        = typename std::iterator_traits<Iterator>::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = typename std::iterator_traits<Iterator>::pointer;
+    using reference         = typename std::iterator_traits<Iterator>::reference;
+
+    permutation_iterator(Iterator base, index_iterator index)
+            : base(base), index(index) {}
+
+    reference operator*() const {
+        return *std::next(base, *index);
+    }
+
+    pointer operator->() const {
+        return &**this;
+    }
+
+    reference operator[](difference_type n) const {
+        return *std::next(base, index[n]);
+    }
+
+    permutation_iterator& operator++() {
+        ++index;
+        return *this;
+    }
+
+    permutation_iterator operator++(int) {
+        auto it = *this;
+        ++index;
+        return it;
+    }
+
+    permutation_iterator& operator--() {
+        --index;
+        return *this;
+    }
+
+    permutation_iterator operator--(int) {
+        auto it = *this;
+        --index;
+        return it;
+    }
+
+    permutation_iterator& operator+=(difference_type n) {
+        index += n;
+        return *this;
+    }
+
+    permutation_iterator& operator-=(difference_type n) {
+        index -= n;
+        return *this;
+    }
+
+    permutation_iterator operator+(difference_type n) const {
+        return {base, index + n};
+    }
+
+    permutation_iterator operator-(difference_type n) const {
+        return {base, index - n};
+    }
+
+    difference_type operator-(const permutation_iterator& rhs) const {
+        return index - rhs.index;
+    }
+
+    bool operator==(const permutation_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const permutation_iterator& rhs) const {
+        return index != rhs.index;
+    }
+
+    bool operator<(const permutation_iterator& rhs) const {
+        return index < rhs.index;
+    }
+
+private:
+    Iterator base;        ///< The first element of the sequence
+    index_iterator index; ///< The current position in the order
+};
+
+/*!
+ * \brief Initialize order to the identity permutation of the sequence [first,
+ * last) and returns the pair of permutation iterators over the sequence
+ */
+template <typename Iterator>
+auto make_permutation(Iterator first, Iterator last, std::vector<std::size_t>& order) {
+    order.resize(std::distance(first, last));
+    std::iota(order.begin(), order.end(), std::size_t(0));
+
+    return std::make_tuple(permutation_iterator<Iterator>(first, order.cbegin()), permutation_iterator<Iterator>(first, order.cend()));
+}
+
+} //end of dll namespace
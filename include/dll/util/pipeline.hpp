@@ -0,0 +1,138 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file pipeline.hpp
+ * \brief Producer/consumer pipeline over a bounded ring of buffers.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <exception>
+
+namespace dll {
+
+/*!
+ * \brief Produce n batches on producer threads and consume them, in order,
+ * on the calling thread.
+ *
+ * The batch k is produced into buffers[k % buffers.size()] by produce(k,
+ * buffer) and then consumed by consume(k, buffer). A buffer is only reused
+ * once its previous batch has been consumed, so at most buffers.size()
+ * batches are in flight.
+ *
+ * If produce or consume throws, the pipeline is stopped: the producers do
+ * not start any new batch, the threads are joined and the first exception
+ * is rethrown on the calling thread.
+ *
+ * \param buffers The ring of buffers
+ * \param n The number of batches
+ * \param producers The number of producer threads
+ * \param produce The functor filling a buffer
+ * \param consume The functor consuming a buffer
+ */
+template <typename Buffer, typename Produce, typename Consume>
+void run_pipeline(std::vector<Buffer>& buffers, std::size_t n, std::size_t producers, Produce&& produce, Consume&& consume) {
+    const std::size_t depth = buffers.size();
+    const std::size_t none  = std::numeric_limits<std::size_t>::max();
+
+    std::mutex lock;
+    std::condition_variable condition;
+
+    std::vector<std::size_t> ready(depth, none); //The batch contained in each buffer
+    std::size_t consumed = 0;                    //The number of consumed batches
+    std::size_t next     = 0;                    //The next batch to produce
+    bool stopped         = false;                //Indicates if a functor has failed
+    std::exception_ptr error;                    //The first failure
+
+    //Must be called with the lock held
+    auto fail = [&]() {
+        if (!error) {
+            error = std::current_exception();
+        }
+
+        stopped = true;
+        condition.notify_all();
+    };
+
+    auto producer = [&]() {
+        std::unique_lock<std::mutex> l(lock);
+
+        while (next < n && !stopped) {
+            auto k = next++;
+
+            //Wait for the previous batch of this buffer to be consumed
+            condition.wait(l, [&] { return stopped || consumed + depth > k; });
+
+            if (stopped) {
+                return;
+            }
+
+            l.unlock();
+
+            try {
+                produce(k, buffers[k % depth]);
+            } catch (...) {
+                l.lock();
+                fail();
+                return;
+            }
+
+            l.lock();
+
+            ready[k % depth] = k;
+            condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (std::size_t p = 0; p < producers; ++p) {
+        threads.emplace_back(producer);
+    }
+
+    for (std::size_t k = 0; k < n; ++k) {
+        {
+            std::unique_lock<std::mutex> l(lock);
+            condition.wait(l, [&] { return stopped || ready[k % depth] == k; });
+
+            if (stopped) {
+                break;
+            }
+        }
+
+        try {
+            consume(k, buffers[k % depth]);
+        } catch (...) {
+            std::lock_guard<std::mutex> l(lock);
+            fail();
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            consumed = k + 1;
+        }
+
+        condition.notify_all();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} //end of dll namespace
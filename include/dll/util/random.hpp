@@ -0,0 +1,347 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file random.hpp
+ * \brief Counter-based random number generation.
+ *
+ * The random numbers are generated by Philox4x32-10 (Salmon et al., 2011):
+ * the block n of the stream s of the seed k is philox(counter = {n, s},
+ * key = k). The streams are therefore independent, can be created anywhere
+ * without any shared state and are reproducible from their seed.
+ *
+ * Each thread has its own stream. They are all restarted by dll::seed().
+ * random_scope can override the stream of the current thread, for instance
+ * to give a fixed stream to each chunk of a parallel loop.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+namespace philox {
+
+constexpr const std::uint32_t M0 = 0xD2511F53; ///< The multiplier of the first word
+constexpr const std::uint32_t M1 = 0xCD9E8D57; ///< The multiplier of the third word
+constexpr const std::uint32_t W0 = 0x9E3779B9; ///< The first key increment (golden ratio)
+constexpr const std::uint32_t W1 = 0xBB67AE85; ///< The second key increment (sqrt(3) - 1)
+
+constexpr const std::size_t rounds = 10;        ///< The number of rounds
+constexpr const std::size_t lanes  = 8;         ///< The number of blocks computed at once
+constexpr const std::size_t words  = 4 * lanes; ///< The number of words computed at once
+
+/*!
+ * \brief Compute the Philox4x32-10 block of the given counter and key
+ */
+inline void block(std::uint32_t ctr[4], std::uint32_t k0, std::uint32_t k1) {
+    for (std::size_t r = 0; r < rounds; ++r) {
+        if (r) {
+            k0 += W0;
+            k1 += W1;
+        }
+
+        const std::uint64_t p0 = std::uint64_t(M0) * ctr[0];
+        const std::uint64_t p1 = std::uint64_t(M1) * ctr[2];
+
+        const std::uint32_t c1 = ctr[1];
+        const std::uint32_t c3 = ctr[3];
+
+        ctr[0] = std::uint32_t(p1 >> 32) ^ c1 ^ k0;
+        ctr[1] = std::uint32_t(p1);
+        ctr[2] = std::uint32_t(p0 >> 32) ^ c3 ^ k1;
+        ctr[3] = std::uint32_t(p0);
+    }
+}
+
+#ifdef __AVX2__
+
+/*!
+ * \brief Compute the high and low parts of the products of the eight lanes of
+ * x by m
+ */
+inline void mulhilo(__m256i x, __m256i m, __m256i& hi, __m256i& lo) {
+    const __m256i even = _mm256_mul_epu32(x, m);
+    const __m256i odd  = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+
+    lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/*!
+ * \brief Compute the blocks first to first + lanes of the given stream.
+ *
+ * The words are stored word-major: out[w * lanes + l] is the word w of the
+ * block first + l. first must be a multiple of lanes.
+ */
+inline void blocks(std::uint32_t* out, std::uint64_t first, std::uint64_t stream, std::uint32_t k0, std::uint32_t k1) {
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(std::uint32_t(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i c1 = _mm256_set1_epi32(std::uint32_t(first >> 32));
+    __m256i c2 = _mm256_set1_epi32(std::uint32_t(stream));
+    __m256i c3 = _mm256_set1_epi32(std::uint32_t(stream >> 32));
+
+    const __m256i m0 = _mm256_set1_epi32(M0);
+    const __m256i m1 = _mm256_set1_epi32(M1);
+
+    for (std::size_t r = 0; r < rounds; ++r) {
+        if (r) {
+            k0 += W0;
+            k1 += W1;
+        }
+
+        __m256i hi0, lo0, hi1, lo1;
+        mulhilo(c0, m0, hi0, lo0);
+        mulhilo(c2, m1, hi1, lo1);
+
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(k0));
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(k1));
+        c3 = lo0;
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 0 * lanes), c0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 1 * lanes), c1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * lanes), c2);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 3 * lanes), c3);
+}
+
+#else
+
+/*!
+ * \brief Compute the blocks first to first + lanes of the given stream.
+ *
+ * The words are stored word-major: out[w * lanes + l] is the word w of the
+ * block first + l. first must be a multiple of lanes.
+ */
+inline void blocks(std::uint32_t* out, std::uint64_t first, std::uint64_t stream, std::uint32_t k0, std::uint32_t k1) {
+    for (std::size_t l = 0; l < lanes; ++l) {
+        std::uint32_t ctr[4] = {std::uint32_t(first + l), std::uint32_t((first + l) >> 32), std::uint32_t(stream), std::uint32_t(stream >> 32)};
+
+        block(ctr, k0, k1);
+
+        for (std::size_t w = 0; w < 4; ++w) {
+            out[w * lanes + l] = ctr[w];
+        }
+    }
+}
+
+#endif
+
+} //end of namespace philox
+
+/*!
+ * \brief A stream of random numbers generated by Philox4x32-10.
+ *
+ * The stream is a UniformRandomBitGenerator and can be used with the
+ * standard distributions and algorithms.
+ */
+struct random_stream {
+    using result_type = std::uint32_t; ///< The type of the generated numbers
+
+    /*!
+     * \brief Create the given stream of the given seed
+     */
+    explicit random_stream(std::uint64_t seed = 0, std::uint64_t stream = 0) {
+        reset(seed, stream);
+    }
+
+    /*!
+     * \brief Restart the stream from its first number
+     */
+    void reset(std::uint64_t seed, std::uint64_t stream) {
+        k0       = std::uint32_t(seed);
+        k1       = std::uint32_t(seed >> 32);
+        id       = stream;
+        next     = 0;
+        position = philox::words;
+    }
+
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    static constexpr result_type max() {
+        return 0xFFFFFFFF;
+    }
+
+    /*!
+     * \brief Returns the next 32-bit random number
+     */
+    result_type operator()() {
+        if (position == philox::words) {
+            refill();
+        }
+
+        return buffer[position++];
+    }
+
+    /*!
+     * \brief Returns the next 64-bit random number
+     */
+    std::uint64_t next64() {
+        std::uint64_t high = (*this)();
+        return (high << 32) | (*this)();
+    }
+
+    /*!
+     * \brief Fill out with n numbers uniformly distributed in (0, 1)
+     */
+    template <typename W>
+    void uniform(W* out, std::size_t n) {
+        while (n) {
+            if (position == philox::words) {
+                refill();
+            }
+
+            const std::size_t m = std::min(n, philox::words - position);
+
+            for (std::size_t i = 0; i < m; ++i) {
+                out[i] = to_uniform<W>(buffer[position + i]);
+            }
+
+            position += m;
+            out += m;
+            n -= m;
+        }
+    }
+
+    /*!
+     * \brief Fill out with n numbers following the standard normal
+     * distribution, with the Box-Muller transform
+     */
+    template <typename W>
+    void normal(W* out, std::size_t n) {
+        constexpr const double two_pi = 6.283185307179586;
+
+        uniform(out, n);
+
+        for (std::size_t i = 0; i + 1 < n; i += 2) {
+            const W r     = std::sqrt(W(-2) * std::log(out[i]));
+            const W theta = W(two_pi) * out[i + 1];
+
+            out[i]     = r * std::cos(theta);
+            out[i + 1] = r * std::sin(theta);
+        }
+
+        if (n % 2) {
+            W u;
+            uniform(&u, 1);
+
+            out[n - 1] = std::sqrt(W(-2) * std::log(out[n - 1])) * std::cos(W(two_pi) * u);
+        }
+    }
+
+private:
+    template <typename W>
+    static W to_uniform(std::uint32_t x) {
+        //Only the bits that fit in the mantissa with the half offset are
+        //used, so that the values are exact and neither 0 nor 1 is returned
+        return sizeof(W) < 8 ? (W(x >> 9) + W(0.5)) * W(1.0 / 8388608.0)
+                             : (W(x) + W(0.5)) * W(1.0 / 4294967296.0);
+    }
+
+    void refill() {
+        philox::blocks(buffer, next, id, k0, k1);
+        next += philox::lanes;
+        position = 0;
+    }
+
+    std::uint32_t k0;                    ///< The low part of the key
+    std::uint32_t k1;                    ///< The high part of the key
+    std::uint64_t id;                    ///< The stream
+    std::uint64_t next;                  ///< The next block
+    std::size_t position;                ///< The next word of the buffer
+    std::uint32_t buffer[philox::words]; ///< The generated words
+};
+
+namespace random_detail {
+
+inline std::atomic<std::uint64_t>& seed() {
+    static std::atomic<std::uint64_t> seed{(std::uint64_t(std::random_device()()) << 32) | std::random_device()()};
+    return seed;
+}
+
+inline std::atomic<std::size_t>& generation() {
+    static std::atomic<std::size_t> generation{0};
+    return generation;
+}
+
+inline std::atomic<std::uint64_t>& next_stream() {
+    static std::atomic<std::uint64_t> next_stream{0};
+    return next_stream;
+}
+
+inline random_stream*& current() {
+    thread_local random_stream* current = nullptr;
+    return current;
+}
+
+} //end of namespace random_detail
+
+/*!
+ * \brief Restart the random streams of all the threads from the given seed.
+ *
+ * After this call, the streams are given to the threads in the order of
+ * their first random number: a single-threaded program always gets the same
+ * numbers after the same seed. Without any call, the seed is random.
+ */
+inline void seed(std::uint64_t seed) {
+    random_detail::seed()        = seed;
+    random_detail::next_stream() = 0;
+    ++random_detail::generation();
+}
+
+/*!
+ * \brief Returns the random stream of the current thread
+ */
+inline random_stream& rng() {
+    if (auto* current = random_detail::current()) {
+        return *current;
+    }
+
+    thread_local random_stream stream;
+    thread_local std::size_t generation = std::size_t(-1);
+
+    if (generation != random_detail::generation()) {
+        generation = random_detail::generation();
+        stream.reset(random_detail::seed(), random_detail::next_stream()++);
+    }
+
+    return stream;
+}
+
+/*!
+ * \brief Use the given stream as the stream of the current thread for the
+ * lifetime of the scope
+ */
+struct random_scope {
+    explicit random_scope(random_stream& stream)
+            : previous(random_detail::current()) {
+        random_detail::current() = &stream;
+    }
+
+    random_scope(const random_scope& rhs) = delete;
+    random_scope& operator=(const random_scope& rhs) = delete;
+
+    ~random_scope() {
+        random_detail::current() = previous;
+    }
+
+private:
+    random_stream* previous; ///< The stream of the enclosing scope
+};
+
+} //end of namespace dll
@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sampling.hpp
+ * \brief Sampling of the stochastic units.
+ *
+ * These functions replace the sampling expressions of ETL. They evaluate
+ * their argument and draw the random numbers of the whole result at once
+ * from the stream of the current thread (see dll::rng()).
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "random.hpp"
+
+namespace dll {
+
+namespace sampling_detail {
+
+constexpr const std::size_t chunk = 64; ///< The number of random numbers drawn at once
+
+/*!
+ * \brief Apply x = f(x, r) to each value of x, with r following the standard
+ * normal distribution if Normal is true, the uniform distribution otherwise
+ */
+template <bool Normal, typename X, typename F>
+void apply(X& x, F&& f) {
+    using weight = typename X::value_type;
+
+    auto& stream = rng();
+
+    weight r[chunk];
+
+    auto* values        = x.memory_start();
+    const std::size_t n = etl::size(x);
+
+    for (std::size_t first = 0; first < n; first += chunk) {
+        const std::size_t m = std::min(chunk, n - first);
+
+        if (Normal) {
+            stream.normal(r, m);
+        } else {
+            stream.uniform(r, m);
+        }
+
+        for (std::size_t i = 0; i < m; ++i) {
+            values[first + i] = f(values[first + i], r[i]);
+        }
+    }
+}
+
+} //end of namespace sampling_detail
+
+/*!
+ * \brief Sample binary values, each being 1 with the probability given by e
+ */
+template <typename E>
+auto bernoulli(const E& e) {
+    auto x = etl::force_temporary(e);
+    sampling_detail::apply<false>(x, [](auto v, auto u) { return u < v ? decltype(v)(1) : decltype(v)(0); });
+    return x;
+}
+
+/*!
+ * \brief Sample binary values, each being 0 with the probability given by e
+ */
+template <typename E>
+auto r_bernoulli(const E& e) {
+    auto x = etl::force_temporary(e);
+    sampling_detail::apply<false>(x, [](auto v, auto u) { return u < v ? decltype(v)(0) : decltype(v)(1); });
+    return x;
+}
+
+/*!
+ * \brief Add gaussian noise, of unit variance, to e
+ */
+template <typename E>
+auto normal_noise(const E& e) {
+    auto x = etl::force_temporary(e);
+    sampling_detail::apply<true>(x, [](auto v, auto z) { return v + z; });
+    return x;
+}
+
+/*!
+ * \brief Add gaussian noise to e, with a standard deviation of sigmoid(e)
+ */
+template <typename E>
+auto logistic_noise(const E& e) {
+    auto x = etl::force_temporary(e);
+    sampling_detail::apply<true>(x, [](auto v, auto z) { return v + z / (decltype(v)(1) + std::exp(-v)); });
+    return x;
+}
+
+/*!
+ * \brief Add gaussian noise, of unit variance, to the values of e that are
+ * strictly between 0 and max
+ */
+template <typename E, typename T>
+auto ranged_noise(const E& e, T max) {
+    auto x = etl::force_temporary(e);
+    sampling_detail::apply<true>(x, [max](auto v, auto z) { return v == decltype(v)(0) || v == decltype(v)(max) ? v : v + z; });
+    return x;
+}
+
+} //end of namespace dll
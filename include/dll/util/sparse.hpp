@@ -0,0 +1,294 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sparse.hpp
+ * \brief Sparse visible inputs.
+ *
+ * The samples can be given to the RBMs as sparse_vector. In batch mode, the
+ * CD trainers gather the samples of each batch in a CSR matrix and compute
+ * the positive phase (v * w and v^T * h) on the non-zero values only. The
+ * reconstruction phase stays dense.
+ */
+
+#pragma once
+
+#include <vector>
+#include <type_traits>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "batch.hpp"
+#include "low_precision.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A sparse sample, made of its non-zero values and their indices
+ */
+template <typename W>
+struct sparse_vector {
+    using value_type = W; ///< The type of the values
+
+    sparse_vector() = default;
+
+    /*!
+     * \brief Create an empty sample of dimension n
+     */
+    explicit sparse_vector(std::size_t n)
+            : n(n) {}
+
+    /*!
+     * \brief Add a non-zero value. The indices must be added in increasing
+     * order.
+     */
+    void push_back(std::size_t index, W value) {
+        cpp_assert(index < n && (indices.empty() || indices.back() < index), "Invalid index for the sparse sample");
+
+        indices.push_back(index);
+        values.push_back(value);
+    }
+
+    /*!
+     * \brief Returns the dimension of the sample
+     */
+    std::size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the number of non-zero values
+     */
+    std::size_t non_zeros() const {
+        return values.size();
+    }
+
+    std::size_t n = 0;                ///< The dimension of the sample
+    std::vector<std::size_t> indices; ///< The indices of the non-zero values
+    std::vector<W> values;            ///< The non-zero values
+};
+
+/*!
+ * \brief Create a sparse sample from the non-zero values of the given dense
+ * sample
+ */
+template <typename E>
+sparse_vector<typename E::value_type> make_sparse(const E& dense) {
+    using weight = typename E::value_type;
+
+    sparse_vector<weight> sample(etl::size(dense));
+
+    for (std::size_t i = 0; i < sample.size(); ++i) {
+        if (dense[i] != weight(0)) {
+            sample.push_back(i, dense[i]);
+        }
+    }
+
+    return sample;
+}
+
+/*!
+ * \brief Traits indicating if a type is a sparse sample
+ */
+template <typename T>
+struct is_sparse_vector : std::false_type {};
+
+template <typename W>
+struct is_sparse_vector<sparse_vector<W>> : std::true_type {};
+
+/*!
+ * \brief A batch of sparse samples, in Compressed Sparse Row format
+ */
+template <typename W>
+struct csr_batch {
+    using value_type = W; ///< The type of the values
+
+    std::size_t rows    = 0; ///< The number of rows
+    std::size_t columns = 0; ///< The number of columns
+
+    std::vector<std::size_t> row_start; ///< The first value of each row, and the end of the values
+    std::vector<std::size_t> indices;   ///< The column of each value
+    std::vector<W> values;              ///< The non-zero values
+
+    /*!
+     * \brief Gather the samples of the given batch. The batch is completed
+     * with empty rows up to n rows.
+     */
+    template <typename Iterator>
+    void assign(const dll::batch<Iterator>& batch, std::size_t n) {
+        cpp_assert(batch.size() <= n, "Too many samples for the CSR batch");
+
+        rows    = n;
+        columns = (*batch.begin()).size();
+
+        row_start.clear();
+        indices.clear();
+        values.clear();
+
+        row_start.push_back(0);
+
+        for (auto& sample : batch) {
+            cpp_assert(sample.size() == columns, "The sparse samples must have the same dimension");
+
+            indices.insert(indices.end(), sample.indices.begin(), sample.indices.end());
+            values.insert(values.end(), sample.values.begin(), sample.values.end());
+
+            row_start.push_back(values.size());
+        }
+
+        row_start.resize(rows + 1, values.size());
+    }
+};
+
+/*!
+ * \brief Returns the number of samples of a (dense) batch
+ */
+template <typename E>
+std::size_t batch_rows(const E& batch) {
+    return etl::dim<0>(batch);
+}
+
+/*!
+ * \brief Returns the number of samples of a CSR batch
+ */
+template <typename W>
+std::size_t batch_rows(const csr_batch<W>& batch) {
+    return batch.rows;
+}
+
+/*!
+ * \brief Scatter a sparse input into a (contiguous) batch row
+ */
+template <typename Output, typename W>
+void copy_input(Output&& output, const sparse_vector<W>& input) {
+    output = W(0);
+
+    for (std::size_t k = 0; k < input.non_zeros(); ++k) {
+        output[input.indices[k]] = input.values[k];
+    }
+}
+
+namespace sparse_detail {
+
+/*!
+ * \brief Compute output = input * w, with the given function writing the
+ * row i of w to the given memory
+ */
+template <typename O, typename W, typename Row>
+void sparse_mul(O&& output, const csr_batch<W>& input, std::size_t m, Row&& row) {
+    cpp_assert(etl::dim<0>(output) == input.rows && etl::dim<1>(output) == m, "Invalid dimensions for the pre-activation");
+
+    output = W(0);
+
+    auto* out = output.memory_start();
+
+    for (std::size_t b = 0; b < input.rows; ++b) {
+        auto* o = out + b * m;
+
+        for (std::size_t k = input.row_start[b]; k < input.row_start[b + 1]; ++k) {
+            const W x  = input.values[k];
+            const W* r = row(input.indices[k]);
+
+            for (std::size_t j = 0; j < m; ++j) {
+                o[j] += x * r[j];
+            }
+        }
+    }
+}
+
+} //end of namespace sparse_detail
+
+/*!
+ * \brief Compute the hidden pre-activation of a sparse batch, output =
+ * input * w. Only the rows of w of the non-zero inputs are read.
+ */
+template <typename O, typename W, typename M>
+void hidden_pre_activation(O&& output, const csr_batch<W>& input, const M& w) {
+    const std::size_t m = etl::dim<1>(w);
+    const auto* data    = w.memory_start();
+
+    sparse_detail::sparse_mul(output, input, m, [data, m](std::size_t i) { return data + i * m; });
+}
+
+/*!
+ * \brief Compute the hidden pre-activation of a sparse batch, output =
+ * input * w, with low-precision weights.
+ *
+ * The rows of w are widened by tiles, once per batch, and the non-zero
+ * values of all the samples falling in a tile are accumulated against it.
+ * The indices of each sample being sorted, a cursor per sample is enough to
+ * find its values of each tile. The tiles without any non-zero value are
+ * not widened.
+ */
+template <typename O, typename W, storage_type S>
+void hidden_pre_activation(O&& output, const csr_batch<W>& input, const low_precision_weights<W, S>& w) {
+    const std::size_t n = w.rows();
+    const std::size_t m = w.columns();
+
+    cpp_assert(input.columns == n && etl::dim<0>(output) == input.rows && etl::dim<1>(output) == m, "Invalid dimensions for the pre-activation");
+
+    output = W(0);
+
+    auto* out = output.memory_start();
+
+    std::vector<std::size_t> cursor(input.row_start.begin(), input.row_start.begin() + input.rows);
+
+    for (std::size_t i = 0; i < n; i += low_precision_detail::tile_rows) {
+        const std::size_t kn = std::min(low_precision_detail::tile_rows, n - i);
+
+        const W* tile = nullptr;
+
+        for (std::size_t b = 0; b < input.rows; ++b) {
+            auto* o = out + b * m;
+
+            for (auto& k = cursor[b]; k < input.row_start[b + 1] && input.indices[k] < i + kn; ++k) {
+                if (!tile) {
+                    tile = w.widen_rows(i, kn);
+                }
+
+                const W x  = input.values[k];
+                const W* r = tile + (input.indices[k] - i) * m;
+
+                for (std::size_t j = 0; j < m; ++j) {
+                    o[j] += x * r[j];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate the outer products of a sparse batch and a dense batch,
+ * acc += input^T * h. Only the rows of acc of the non-zero inputs are
+ * written.
+ */
+template <typename A, typename W, typename H>
+void sparse_outer_accumulate(A&& acc, const csr_batch<W>& input, const H& h) {
+    const std::size_t m = etl::dim<1>(acc);
+
+    cpp_assert(etl::dim<0>(acc) == input.columns && etl::dim<1>(h) == m && etl::dim<0>(h) >= input.rows, "Invalid dimensions for the outer products");
+
+    auto* a        = acc.memory_start();
+    const auto* hs = h.memory_start();
+
+    for (std::size_t b = 0; b < input.rows; ++b) {
+        const auto* hb = hs + b * m;
+
+        for (std::size_t k = input.row_start[b]; k < input.row_start[b + 1]; ++k) {
+            const W x = input.values[k];
+            auto* row = a + input.indices[k] * m;
+
+            for (std::size_t j = 0; j < m; ++j) {
+                row[j] += x * hb[j];
+            }
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,439 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file winograd.hpp
+ * \brief Winograd minimal filtering for the small kernels.
+ *
+ * The valid convolutions with 3x3 and 5x5 kernels are computed by tiles of
+ * 2x2 outputs with the F(2x2, 3x3) and F(2x2, 5x5) algorithms: each tile of
+ * the input and each kernel are transformed to (R + 1) x (R + 1) matrices,
+ * multiplied element-wise and transformed back. winograd_conv is only
+ * enabled for these kernel sizes, the other sizes must use the generic
+ * convolutions.
+ *
+ * The layers keep the transformed kernels in a winograd_cache, so that they
+ * are only transformed again after the weights have been modified.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "timers.hpp"
+
+namespace dll {
+
+namespace winograd_detail {
+
+/*!
+ * \brief The transform matrices of F(2, R)
+ */
+template <typename T, std::size_t R>
+struct f2_matrices;
+
+/*!
+ * \brief The transform matrices of F(2, 3), with the points 0, 1, -1 and
+ * infinity
+ */
+template <typename T>
+struct f2_matrices<T, 3> {
+    static constexpr const T BT[4][4] = {
+        {1, 0, -1, 0},
+        {0, 1, 1, 0},
+        {0, -1, 1, 0},
+        {0, 1, 0, -1}};
+
+    static constexpr const T G[4][3] = {
+        {1, 0, 0},
+        {T(1) / 2, T(1) / 2, T(1) / 2},
+        {T(1) / 2, -T(1) / 2, T(1) / 2},
+        {0, 0, 1}};
+
+    static constexpr const T AT[2][4] = {
+        {1, 1, 1, 0},
+        {0, 1, -1, -1}};
+};
+
+template <typename T>
+constexpr const T f2_matrices<T, 3>::BT[4][4];
+
+template <typename T>
+constexpr const T f2_matrices<T, 3>::G[4][3];
+
+template <typename T>
+constexpr const T f2_matrices<T, 3>::AT[2][4];
+
+/*!
+ * \brief The transform matrices of F(2, 5), with the points 0, 1, -1, 2, -2
+ * and infinity
+ */
+template <typename T>
+struct f2_matrices<T, 5> {
+    static constexpr const T BT[6][6] = {
+        {4, 0, -5, 0, 1, 0},
+        {0, -4, -4, 1, 1, 0},
+        {0, 4, -4, -1, 1, 0},
+        {0, -2, -1, 2, 1, 0},
+        {0, 2, -1, -2, 1, 0},
+        {0, 4, 0, -5, 0, 1}};
+
+    static constexpr const T G[6][5] = {
+        {T(1) / 4, 0, 0, 0, 0},
+        {-T(1) / 6, -T(1) / 6, -T(1) / 6, -T(1) / 6, -T(1) / 6},
+        {-T(1) / 6, T(1) / 6, -T(1) / 6, T(1) / 6, -T(1) / 6},
+        {T(1) / 24, T(1) / 12, T(1) / 6, T(1) / 3, T(2) / 3},
+        {T(1) / 24, -T(1) / 12, T(1) / 6, -T(1) / 3, T(2) / 3},
+        {0, 0, 0, 0, 1}};
+
+    static constexpr const T AT[2][6] = {
+        {1, 1, 1, 1, 1, 0},
+        {0, 1, -1, 2, -2, 1}};
+};
+
+template <typename T>
+constexpr const T f2_matrices<T, 5>::BT[6][6];
+
+template <typename T>
+constexpr const T f2_matrices<T, 5>::G[6][5];
+
+template <typename T>
+constexpr const T f2_matrices<T, 5>::AT[2][6];
+
+/*!
+ * \brief Valid convolutions by tiles of 2x2 outputs with RxR kernels
+ */
+template <typename T, std::size_t R>
+struct f2x2_conv {
+    static constexpr const bool enabled = true;
+
+    using value_type = T; ///< The type of the values
+
+    static constexpr const std::size_t M = 2;         ///< The size of an output tile
+    static constexpr const std::size_t A = M + R - 1; ///< The size of an input tile
+
+    using matrices = f2_matrices<T, R>;
+
+    /*!
+     * \brief Returns the number of values of the transformed kernels
+     */
+    static constexpr std::size_t transformed_size(std::size_t NC, std::size_t K) {
+        return K * NC * A * A;
+    }
+
+    /*!
+     * \brief Transform all the kernels
+     *
+     * \param w The kernels (NC x K x R x R)
+     * \param u The transformed kernels (transformed_size(NC, K) values)
+     */
+    static void transform_kernels(const T* w, std::size_t NC, std::size_t K, T* u) {
+        for (std::size_t c = 0; c < NC; ++c) {
+            for (std::size_t k = 0; k < K; ++k) {
+                kernel_transform(w + (c * K + k) * R * R, u + (k * NC + c) * A * A);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the valid convolutions of a batch with all the kernels,
+     * summed over the channels. The kernels are applied without being
+     * flipped.
+     *
+     * The kernels are transformed for this call only, the layers use the
+     * transformed kernels of their winograd_cache instead.
+     *
+     * \param v The inputs (B x NC x NV1 x NV2)
+     * \param w The kernels (NC x K x R x R)
+     * \param output The functor returning the memory of each (NH1 x NH2)
+     * output
+     */
+    template <typename Output>
+    static void apply(const T* v, std::size_t B, std::size_t NC, std::size_t NV1, std::size_t NV2, const T* w, std::size_t K, Output&& output) {
+        std::vector<T> u(transformed_size(NC, K));
+
+        transform_kernels(w, NC, K, u.data());
+
+        apply_transformed(v, B, NC, NV1, NV2, u.data(), K, output);
+    }
+
+    /*!
+     * \brief Compute the valid convolutions of a batch with all the
+     * transformed kernels, summed over the channels.
+     *
+     * The transformed tiles of the inputs are kept in memory of the current
+     * thread, only allocated when the number of channels grows.
+     *
+     * \param v The inputs (B x NC x NV1 x NV2)
+     * \param u The transformed kernels (see transform_kernels)
+     * \param output The functor returning the memory of each (NH1 x NH2)
+     * output
+     */
+    template <typename Output>
+    static void apply_transformed(const T* v, std::size_t B, std::size_t NC, std::size_t NV1, std::size_t NV2, const T* u, std::size_t K, Output&& output) {
+        dll::auto_timer timer("conv:batch_valid:winograd");
+
+        cpp_assert(NV1 >= R && NV2 >= R, "The inputs must be at least as large as the kernels");
+
+        const std::size_t NH1 = NV1 - R + 1;
+        const std::size_t NH2 = NV2 - R + 1;
+
+        static thread_local std::vector<T> tiles;
+
+        if (tiles.size() < NC * A * A) {
+            tiles.resize(NC * A * A);
+        }
+
+        T* vt = tiles.data();
+
+        T d[A * A];
+        T m[A * A];
+        T y[M * M];
+
+        for (std::size_t b = 0; b < B; ++b) {
+            for (std::size_t i = 0; i < NH1; i += M) {
+                for (std::size_t j = 0; j < NH2; j += M) {
+                    //Transform the tile of each channel, the last tiles are padded
+
+                    for (std::size_t c = 0; c < NC; ++c) {
+                        const T* in = v + (b * NC + c) * NV1 * NV2;
+
+                        for (std::size_t p = 0; p < A; ++p) {
+                            for (std::size_t q = 0; q < A; ++q) {
+                                d[p * A + q] = i + p < NV1 && j + q < NV2 ? in[(i + p) * NV2 + j + q] : T(0);
+                            }
+                        }
+
+                        input_transform(d, vt + c * A * A);
+                    }
+
+                    for (std::size_t k = 0; k < K; ++k) {
+                        const T* uk = u + k * NC * A * A;
+
+                        for (std::size_t x = 0; x < A * A; ++x) {
+                            m[x] = uk[x] * vt[x];
+                        }
+
+                        for (std::size_t c = 1; c < NC; ++c) {
+                            for (std::size_t x = 0; x < A * A; ++x) {
+                                m[x] += uk[c * A * A + x] * vt[c * A * A + x];
+                            }
+                        }
+
+                        output_transform(m, y);
+
+                        T* out = output(b, k);
+
+                        for (std::size_t p = 0; p < M && i + p < NH1; ++p) {
+                            for (std::size_t q = 0; q < M && j + q < NH2; ++q) {
+                                out[(i + p) * NH2 + j + q] = y[p * M + q];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Compute G g G^T
+     */
+    static void kernel_transform(const T* g, T* out) {
+        T tmp[A * R];
+
+        for (std::size_t p = 0; p < A; ++p) {
+            for (std::size_t q = 0; q < R; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < R; ++x) {
+                    sum += matrices::G[p][x] * g[x * R + q];
+                }
+                tmp[p * R + q] = sum;
+            }
+        }
+
+        for (std::size_t p = 0; p < A; ++p) {
+            for (std::size_t q = 0; q < A; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < R; ++x) {
+                    sum += tmp[p * R + x] * matrices::G[q][x];
+                }
+                out[p * A + q] = sum;
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute B^T d B
+     */
+    static void input_transform(const T* d, T* out) {
+        T tmp[A * A];
+
+        for (std::size_t p = 0; p < A; ++p) {
+            for (std::size_t q = 0; q < A; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < A; ++x) {
+                    sum += matrices::BT[p][x] * d[x * A + q];
+                }
+                tmp[p * A + q] = sum;
+            }
+        }
+
+        for (std::size_t p = 0; p < A; ++p) {
+            for (std::size_t q = 0; q < A; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < A; ++x) {
+                    sum += tmp[p * A + x] * matrices::BT[q][x];
+                }
+                out[p * A + q] = sum;
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute A^T m A
+     */
+    static void output_transform(const T* m, T* out) {
+        T tmp[M * A];
+
+        for (std::size_t p = 0; p < M; ++p) {
+            for (std::size_t q = 0; q < A; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < A; ++x) {
+                    sum += matrices::AT[p][x] * m[x * A + q];
+                }
+                tmp[p * A + q] = sum;
+            }
+        }
+
+        for (std::size_t p = 0; p < M; ++p) {
+            for (std::size_t q = 0; q < M; ++q) {
+                T sum(0);
+                for (std::size_t x = 0; x < A; ++x) {
+                    sum += tmp[p * A + x] * matrices::AT[q][x];
+                }
+                out[p * M + q] = sum;
+            }
+        }
+    }
+};
+
+} //end of namespace winograd_detail
+
+/*!
+ * \brief Winograd convolutions for NW1 x NW2 kernels. Only the 3x3 and 5x5
+ * kernels are supported (enabled is false for the other sizes).
+ */
+template <typename T, std::size_t NW1, std::size_t NW2>
+struct winograd_conv {
+    static constexpr const bool enabled = false;
+};
+
+/*!
+ * \brief Winograd F(2x2, 3x3) convolutions
+ */
+template <typename T>
+struct winograd_conv<T, 3, 3> : winograd_detail::f2x2_conv<T, 3> {};
+
+/*!
+ * \brief Winograd F(2x2, 5x5) convolutions
+ */
+template <typename T>
+struct winograd_conv<T, 5, 5> : winograd_detail::f2x2_conv<T, 5> {};
+
+/*!
+ * \brief Cache of the Winograd transforms of the kernels of a layer, an
+ * empty placeholder when the Winograd convolutions are not enabled.
+ */
+template <typename Conv, bool Enabled = Conv::enabled>
+struct winograd_cache {
+    void invalidate() {}
+};
+
+/*!
+ * \brief Cache of the Winograd transforms of the kernels of a layer.
+ *
+ * As the flip_cache, the kernels are only transformed again when the weights
+ * have been modified (invalidate()) since the last transform. In debug mode,
+ * the cache asserts on each access that the weights have not been modified
+ * without invalidating the cache.
+ */
+template <typename Conv>
+struct winograd_cache<Conv, true> {
+    winograd_cache() = default;
+
+    //No copying
+    winograd_cache(const winograd_cache& cache) = delete;
+    winograd_cache& operator=(const winograd_cache& cache) = delete;
+
+    //No moving
+    winograd_cache(winograd_cache&& cache) = delete;
+    winograd_cache& operator=(winograd_cache&& cache) = delete;
+
+    /*!
+     * \brief Returns the transforms of the given kernels (NC x K x R x R)
+     * \param w The weights, must be the weights this cache is bound to
+     */
+    template <typename W>
+    const typename Conv::value_type* get(const W& w) const {
+        auto current = version.load(std::memory_order_acquire);
+
+        if (transformed_version.load(std::memory_order_acquire) != current) {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (transformed_version.load(std::memory_order_relaxed) != current) {
+                const std::size_t NC = etl::dim<0>(w);
+                const std::size_t K  = etl::dim<1>(w);
+
+                transformed.resize(Conv::transformed_size(NC, K));
+
+                Conv::transform_kernels(w.memory_start(), NC, K, transformed.data());
+
+#ifndef NDEBUG
+                source.assign(w.memory_start(), w.memory_start() + etl::size(w));
+#endif
+
+                transformed_version.store(current, std::memory_order_release);
+            }
+        }
+
+#ifndef NDEBUG
+        cpp_assert(std::equal(w.memory_start(), w.memory_start() + etl::size(w), source.begin()),
+                   "The weights have been modified without calling weights_changed()");
+#endif
+
+        return transformed.data();
+    }
+
+    /*!
+     * \brief Indicates that the weights have changed and that the kernels
+     * must be transformed again on next access.
+     */
+    void invalidate() {
+        version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    using T = typename Conv::value_type;
+
+    mutable std::vector<T> transformed;                      ///< The transformed kernels
+#ifndef NDEBUG
+    mutable std::vector<T> source;                           ///< The weights that have been transformed
+#endif
+    mutable std::mutex lock;                                 ///< The lock protecting the transform
+    mutable std::atomic<std::size_t> transformed_version{0}; ///< The version of the weights that have been transformed
+    std::atomic<std::size_t> version{1};                     ///< The current version of the weights
+};
+
+} //end of dll namespace
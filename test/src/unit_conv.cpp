@@ -235,3 +235,222 @@ TEST_CASE("unit/conv/sgd/10", "[conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("unit/conv/flip/1", "[conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_desc<1, 28, 28, 6, 24, 24, dll::activation<dll::function::SIGMOID>>::layer_t,
+            dll::dense_desc<6 * 24 * 24, 10, dll::activation<dll::function::SIGMOID>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto& layer = dbn->layer_get<0>();
+
+    auto check_flipped = [&layer]() {
+        auto expected = etl::force_temporary(layer.w);
+        dll::deep_fflip(expected);
+
+        auto& flipped = layer.flipped_w();
+
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(flipped[i] == Approx(expected[i]));
+        }
+    };
+
+    check_flipped();
+
+    dbn->backup_weights();
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    //The weights have been modified by SGD
+    check_flipped();
+
+    dbn->restore_weights();
+
+    //The weights have been restored
+    check_flipped();
+}
+
+TEST_CASE("unit/conv/frozen/1", "[conv][dbn][mnist][frozen]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_desc<1, 28, 28, 6, 24, 24, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_layer_3d_desc<6, 24, 24, 1, 2, 2, dll::weight_type<float>>::layer_t,
+            dll::dense_desc<6 * 12 * 12, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    auto frozen = dbn->freeze();
+    auto ws     = frozen.make_workspace();
+
+    for (auto& image : dataset.training_images) {
+        REQUIRE(frozen.predict(ws, image) == dbn->predict(image));
+
+        auto expected = dbn->activation_probabilities(image);
+        auto output   = frozen.activation_probabilities(ws, image);
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(output[j] == Approx(expected[j]));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/im2col/1", "[conv][unit][im2col]") {
+    //4x4 kernels do not use the Winograd convolutions
+    using layer_t = dll::conv_desc<2, 12, 12, 5, 9, 9, dll::activation<dll::function::SIGMOID>>::layer_t;
+
+    auto layer = std::make_unique<layer_t>();
+
+    using weight = typename layer_t::weight;
+
+    etl::fast_dyn_matrix<weight, 7, 2, 12, 12> input;
+    etl::fast_dyn_matrix<weight, 7, 5, 9, 9> output;
+
+    input = etl::normal_generator<weight>();
+
+    //The whole batch is convolved at once
+    layer->batch_activate_hidden(output, input);
+
+    typename layer_t::output_one_t expected;
+
+    for (std::size_t b = 0; b < 7; ++b) {
+        layer->activate_hidden(expected, input(b));
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(output(b)[j] == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/im2col/2", "[conv][unit][im2col]") {
+    etl::fast_dyn_matrix<float, 7, 2, 12, 12> input;
+    etl::fast_dyn_matrix<float, 2, 5, 4, 4> w;
+    etl::fast_dyn_matrix<float, 7, 5, 9, 9> output;
+    etl::fast_dyn_matrix<float, 7, 5, 9, 9> expected;
+
+    input = etl::normal_generator<float>();
+    w     = etl::normal_generator<float>();
+
+    dll::batch_conv_valid_im2col(input, w, [&](std::size_t b, std::size_t k) {
+        return expected(b)(k).memory_start();
+    });
+
+    cpp::thread_pool<true> pool(3);
+    dll::im2col_scratch<float> scratch;
+
+    //The chunks are computed in parallel, twice with the same scratch
+    for (std::size_t i = 0; i < 2; ++i) {
+        output = 0;
+
+        dll::batch_conv_valid_im2col(pool, 3, scratch, input, w, [&](std::size_t b, std::size_t k) {
+            return output(b)(k).memory_start();
+        });
+
+        for (std::size_t j = 0; j < output.size(); ++j) {
+            REQUIRE(output[j] == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+}
+
+namespace {
+
+template <std::size_t R>
+void test_winograd() {
+    etl::fast_dyn_matrix<float, 3, 2, 13, 14> input;
+    etl::fast_dyn_matrix<float, 2, 4, R, R> w;
+    etl::fast_dyn_matrix<float, 3, 4, 14 - R, 15 - R> output;
+
+    input = etl::normal_generator<float>();
+    w     = etl::normal_generator<float>();
+
+    dll::winograd_conv<float, R, R>::apply(input.memory_start(), 3, 2, 13, 14, w.memory_start(), 4, [&](std::size_t b, std::size_t k) {
+        return output(b)(k).memory_start();
+    });
+
+    auto w_flipped = etl::force_temporary(w);
+    dll::deep_fflip(w_flipped);
+
+    etl::fast_dyn_matrix<float, 2, 4, 14 - R, 15 - R> tmp;
+    etl::fast_dyn_matrix<float, 4, 14 - R, 15 - R> expected;
+
+    for (std::size_t b = 0; b < 3; ++b) {
+        expected = 0;
+
+        for (std::size_t c = 0; c < 2; ++c) {
+            etl::conv_2d_valid_multi(input(b)(c), w_flipped(c), tmp(c));
+            expected += tmp(c);
+        }
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(output(b)[j] == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+}
+
+} //end of anonymous namespace
+
+TEST_CASE("unit/conv/winograd/1", "[conv][unit][winograd]") {
+    test_winograd<3>();
+}
+
+TEST_CASE("unit/conv/winograd/2", "[conv][unit][winograd]") {
+    test_winograd<5>();
+}
+
+TEST_CASE("unit/conv/winograd/3", "[conv][unit][winograd]") {
+    using layer_t = dll::conv_desc<1, 28, 28, 6, 26, 26, dll::activation<dll::function::TANH>>::layer_t;
+
+    auto layer = std::make_unique<layer_t>();
+
+    etl::fast_dyn_matrix<float, 5, 1, 28, 28> input;
+    etl::fast_dyn_matrix<float, 5, 6, 26, 26> output;
+
+    input = etl::normal_generator<float>();
+
+    layer->batch_activate_hidden(output, input);
+
+    //The reference convolutions with the flipped kernels
+    auto& w_flipped = layer->flipped_w();
+
+    etl::fast_dyn_matrix<float, 6, 26, 26> expected;
+
+    for (std::size_t b = 0; b < 5; ++b) {
+        etl::conv_2d_valid_multi(input(b)(0), w_flipped(0), expected);
+
+        expected = etl::tanh(etl::rep<26, 26>(layer->b) + expected);
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(output(b)[j] == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+
+    //The transformed kernels are cached until the weights change
+
+    layer->w = etl::normal_generator<float>();
+    layer->weights_changed();
+
+    typename layer_t::output_one_t one;
+
+    for (std::size_t b = 0; b < 5; ++b) {
+        layer->activate_hidden(one, input(b));
+
+        etl::conv_2d_valid_multi(input(b)(0), layer->flipped_w()(0), expected);
+
+        expected = etl::tanh(etl::rep<26, 26>(layer->b) + expected);
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(one[j] == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+}
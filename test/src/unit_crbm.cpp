@@ -183,3 +183,108 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+TEST_CASE("unit/crbm/mnist/8", "[crbm][unit][fft]") {
+    dll::conv_rbm_desc_square<
+        1, 28, 20, 12,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::fft_conv>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 25);
+    REQUIRE(error < 5e-2);
+
+    //The FFT convolutions must match the direct convolutions
+
+    dll::conv_rbm_desc_square<1, 28, 20, 12, dll::batch_size<10>, dll::momentum>::layer_t direct;
+
+    direct.w = rbm.w;
+    direct.b = rbm.b;
+    direct.c = rbm.c;
+    direct.weights_changed();
+
+    rbm.v1    = dataset.training_images[1];
+    direct.v1 = dataset.training_images[1];
+
+    rbm.template activate_hidden<true, false>(rbm.h1_a, rbm.h1_a, rbm.v1, rbm.v1);
+    direct.template activate_hidden<true, false>(direct.h1_a, direct.h1_a, direct.v1, direct.v1);
+
+    for (std::size_t i = 0; i < rbm.h1_a.size(); ++i) {
+        REQUIRE(rbm.h1_a[i] == Approx(direct.h1_a[i]));
+    }
+
+    rbm.template activate_visible<true, false>(rbm.h1_a, rbm.h1_a, rbm.v2_a, rbm.v2_a);
+    direct.template activate_visible<true, false>(direct.h1_a, direct.h1_a, direct.v2_a, direct.v2_a);
+
+    for (std::size_t i = 0; i < rbm.v2_a.size(); ++i) {
+        REQUIRE(rbm.v2_a[i] == Approx(direct.v2_a[i]));
+    }
+
+    //The batch FFT convolutions must match the batch direct convolutions
+
+    using weight = typename decltype(rbm)::weight;
+
+    etl::fast_dyn_matrix<weight, 10, 1, 28, 28> v;
+    etl::fast_dyn_matrix<weight, 10, 20, 12, 12> h_a;
+    etl::fast_dyn_matrix<weight, 10, 20, 12, 12> h_direct;
+    etl::fast_dyn_matrix<weight, 10, 1, 28, 28> v_a;
+    etl::fast_dyn_matrix<weight, 10, 1, 28, 28> v_direct;
+
+    etl::fast_dyn_matrix<weight, 10, 2, 20, 12, 12> v_cv;
+    etl::fast_dyn_matrix<weight, 10, 2, 28, 28> h_cv;
+
+    for (std::size_t b = 0; b < 10; ++b) {
+        std::copy(dataset.training_images[b].begin(), dataset.training_images[b].end(), v(b).begin());
+    }
+
+    rbm.template batch_activate_hidden<true, false>(h_a, h_a, v, v, v_cv);
+    direct.template batch_activate_hidden<true, false>(h_direct, h_direct, v, v, v_cv);
+
+    for (std::size_t i = 0; i < h_a.size(); ++i) {
+        REQUIRE(h_a[i] == Approx(h_direct[i]));
+    }
+
+    rbm.template batch_activate_visible<true, false>(h_a, h_a, v_a, v_a, h_cv);
+    direct.template batch_activate_visible<true, false>(h_a, h_a, v_direct, v_direct, h_cv);
+
+    for (std::size_t i = 0; i < v_a.size(); ++i) {
+        REQUIRE(v_a[i] == Approx(v_direct[i]));
+    }
+}
+
+TEST_CASE("unit/crbm/mnist/9", "[crbm][unit]") {
+    dll::conv_rbm_desc_square<
+        1, 28, 20, 12,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 5);
+
+    //The free energy of a batch is the sum of the free energies of its first samples
+
+    using weight = typename decltype(rbm)::weight;
+
+    etl::fast_dyn_matrix<weight, 10, 1, 28, 28> v;
+
+    for (std::size_t b = 0; b < 10; ++b) {
+        std::copy(dataset.training_images[b].begin(), dataset.training_images[b].end(), v(b).begin());
+    }
+
+    weight expected = 0.0;
+
+    for (std::size_t b = 0; b < 7; ++b) {
+        expected += rbm.free_energy(v(b));
+    }
+
+    REQUIRE(rbm.batch_free_energy(v, 7) == Approx(expected));
+}
@@ -180,3 +180,35 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 9e-2);
 }
+
+TEST_CASE("unit/crbm_mp/mnist/8", "[crbm_mp][unit]") {
+    dll::conv_rbm_mp_desc_square<
+        1, 28, 20, 12, 2,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 5);
+
+    //The free energy of a batch is the sum of the free energies of its first samples
+
+    using weight = typename decltype(rbm)::weight;
+
+    etl::fast_dyn_matrix<weight, 10, 1, 28, 28> v;
+
+    for (std::size_t b = 0; b < 10; ++b) {
+        std::copy(dataset.training_images[b].begin(), dataset.training_images[b].end(), v(b).begin());
+    }
+
+    weight expected = 0.0;
+
+    for (std::size_t b = 0; b < 7; ++b) {
+        expected += rbm.free_energy(v(b));
+    }
+
+    REQUIRE(rbm.batch_free_energy(v, 7) == Approx(expected));
+}
@@ -6,6 +6,9 @@
 //=======================================================================
 
 #include <deque>
+#include <sstream>
+
+#include <dirent.h>
 
 #include "catch.hpp"
 
@@ -14,6 +17,7 @@
 #include "dll/dyn_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/binarize_layer.hpp"
+#include "dll/batching_predictor.hpp"
 #include "dll/trainer/stochastic_gradient_descent.hpp"
 
 #include "mnist/mnist_reader.hpp"
@@ -370,3 +374,636 @@ TEST_CASE("unit/dbn/mnist/11", "[dbn][unit]") {
     auto out = dbn->prepare_one_output<etl::dyn_matrix<float, 1>>();
     REQUIRE(out.size() > 0);
 }
+
+TEST_CASE("unit/dbn/mnist/12", "[dbn][batch][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::binarize_layer_desc<30>::layer_t,
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(210);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 10);
+
+    //The number of samples is voluntarily not a multiple of the batch size
+    auto labels = dbn->predict_batch(dataset.training_images);
+    auto outputs = dbn->activation_probabilities_batch<16>(dataset.training_images);
+
+    REQUIRE(labels.size() == dataset.training_images.size());
+    REQUIRE(outputs.size() == dataset.training_images.size());
+
+    for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+        auto& image = dataset.training_images[i];
+
+        REQUIRE(labels[i] == dbn->predict(image));
+
+        auto expected = dbn->activation_probabilities(image);
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(outputs[i][j] == Approx(expected[j]));
+        }
+    }
+
+    auto error          = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::predictor());
+    auto parallel_error = dll::test_set_parallel(dbn, dataset.training_images, dataset.training_labels, dll::batch_predictor());
+
+    REQUIRE(parallel_error == Approx(error));
+
+    auto context = dbn->make_inference_context<etl::dyn_matrix<float, 1>>();
+
+    for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+        REQUIRE(dbn->predict(context, dataset.training_images[i]) == labels[i]);
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/13", "[dbn][frozen][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::RELU>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 10);
+
+    auto frozen = dbn->freeze();
+    auto ws     = frozen.make_workspace();
+
+    std::vector<std::size_t> labels(dataset.training_images.size());
+    frozen.predict_batch(dataset.training_images.begin(), dataset.training_images.end(), labels.begin(), 16);
+
+    etl::dyn_vector<float> output(frozen.output_size());
+
+    for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+        auto& image = dataset.training_images[i];
+
+        REQUIRE(frozen.predict(ws, image) == dbn->predict(image));
+        REQUIRE(labels[i] == dbn->predict(image));
+
+        auto expected = dbn->activation_probabilities(image);
+        frozen.activation_probabilities(ws, image, output);
+
+        for (std::size_t j = 0; j < expected.size(); ++j) {
+            REQUIRE(output[j] == Approx(expected[j]));
+        }
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/14", "[dbn][quantized][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 20);
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+
+    auto quantized = dbn->quantize(dataset.training_images.begin(), dataset.training_images.begin() + 100);
+
+    auto report = dll::evaluate_quantization(*dbn, quantized, dataset.training_images, dataset.training_labels);
+
+    REQUIRE(report.samples == dataset.training_images.size());
+    REQUIRE(report.agreement >= 0.95);
+    REQUIRE(report.quantized_error <= report.float_error + 0.02);
+    REQUIRE(report.max_output_error < 0.2);
+
+    std::vector<std::size_t> labels(dataset.training_images.size());
+    quantized.predict_batch(dataset.training_images.begin(), dataset.training_images.end(), labels.begin(), 16);
+
+    auto ws = quantized.make_workspace();
+
+    for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+        REQUIRE(labels[i] == quantized.predict(ws, dataset.training_images[i]));
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/15", "[dbn][batch][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<8>>::dbn_t dbn_t;
+
+    using sample_t = etl::dyn_matrix<float, 1>;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, sample_t>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 5);
+
+    const std::size_t clients = 4;
+
+    std::vector<std::future<std::size_t>> futures(dataset.training_images.size());
+
+    {
+        dll::batching_predictor<dbn_t, sample_t> predictor(*dbn, 8, std::chrono::microseconds(500), 2);
+
+        std::vector<std::thread> threads;
+
+        for (std::size_t c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c] {
+                for (std::size_t i = c; i < dataset.training_images.size(); i += clients) {
+                    futures[i] = predictor.predict(dataset.training_images[i]);
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+            REQUIRE(futures[i].get() == dbn->predict(dataset.training_images[i]));
+        }
+
+        auto stats = predictor.statistics();
+
+        REQUIRE(stats.requests == dataset.training_images.size());
+        REQUIRE(stats.batches > 0);
+        REQUIRE(stats.average_batch <= 8.0);
+        REQUIRE(stats.p50 <= stats.p99);
+        REQUIRE(stats.throughput > 0.0);
+    }
+}
+
+TEST_CASE("unit/dbn/mnist/16", "[dbn][features][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 30, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(260);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 5);
+
+    REQUIRE(dbn->export_features(dataset.training_images, "unit_dbn_16.features"));
+
+    {
+        dll::feature_store<float> features("unit_dbn_16.features");
+
+        REQUIRE(features.is_open());
+        REQUIRE(features.size() == dataset.training_images.size());
+        REQUIRE(features.dims() == 30);
+
+        std::size_t i = 0;
+        for (auto row : features) {
+            REQUIRE(reinterpret_cast<std::uintptr_t>(row.memory_start()) % dll::feature_alignment == 0);
+
+            auto expected = dbn->activation_probabilities(dataset.training_images[i]);
+
+            for (std::size_t j = 0; j < row.size(); ++j) {
+                REQUIRE(row[j] == Approx(expected[j]));
+            }
+
+            ++i;
+        }
+    }
+
+    //The headers whose rows could be read past the end of the file are rejected
+
+    auto corrupt = [](auto&& functor) {
+        std::fstream file("unit_dbn_16.features", std::fstream::in | std::fstream::out | std::fstream::binary);
+
+        dll::feature_header header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+        auto valid = header;
+        functor(header);
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.flush();
+
+        bool open = dll::feature_store<float>("unit_dbn_16.features").is_open();
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&valid), sizeof(valid));
+
+        return open;
+    };
+
+    REQUIRE(!corrupt([](auto& header) { header.row_stride = 64; }));
+    REQUIRE(!corrupt([](auto& header) { header.alignment = 32; }));
+    REQUIRE(!corrupt([](auto& header) { header.count = std::uint64_t(1) << 60; }));
+    REQUIRE(corrupt([](auto& /*header*/) {}));
+
+    std::remove("unit_dbn_16.features");
+}
+
+TEST_CASE("unit/dbn/mnist/17", "[dbn][pipeline][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>, dll::pipeline<3>, dll::pipeline_producers<2>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t direct_dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>, dll::pipeline<3>, dll::pipeline_producers<1>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t single_dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn    = std::make_unique<dbn_t>();
+    auto direct = std::make_unique<direct_dbn_t>();
+    auto single = std::make_unique<single_dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    //The pipelined pretraining gives the same layers as the direct
+    //pretraining, whatever the number of producers
+
+    std::stringstream weights;
+    dbn->store(weights);
+    direct->load(weights);
+
+    weights.clear();
+    weights.seekg(0);
+    single->load(weights);
+
+    dll::seed(42);
+    dbn->pretrain(dataset.training_images, 20);
+
+    dll::seed(42);
+    direct->pretrain(dataset.training_images, 20);
+
+    dll::seed(42);
+    single->pretrain(dataset.training_images, 20);
+
+    auto same = [](const auto& a, const auto& b) {
+        for (std::size_t i = 0; i < etl::size(a); ++i) {
+            REQUIRE(a[i] == Approx(b[i]));
+        }
+    };
+
+    same(dbn->template layer_get<0>().w, direct->template layer_get<0>().w);
+    same(dbn->template layer_get<1>().w, direct->template layer_get<1>().w);
+    same(dbn->template layer_get<2>().w, direct->template layer_get<2>().w);
+
+    same(dbn->template layer_get<0>().w, single->template layer_get<0>().w);
+    same(dbn->template layer_get<1>().w, single->template layer_get<1>().w);
+    same(dbn->template layer_get<2>().w, single->template layer_get<2>().w);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/18", "[dbn][cache][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>, dll::activation_cache,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t direct_dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn    = std::make_unique<dbn_t>();
+    auto direct = std::make_unique<direct_dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    //The layers pretrained from the cache are the same as the layers
+    //pretrained from the propagated inputs
+
+    std::stringstream weights;
+    dbn->store(weights);
+    direct->load(weights);
+
+    dll::seed(42);
+    REQUIRE(dbn->pretrain(dataset.training_images, 20));
+
+    dll::seed(42);
+    direct->pretrain(dataset.training_images, 20);
+
+    auto same = [](const auto& a, const auto& b) {
+        for (std::size_t i = 0; i < etl::size(a); ++i) {
+            REQUIRE(a[i] == Approx(b[i]));
+        }
+    };
+
+    same(dbn->template layer_get<0>().w, direct->template layer_get<0>().w);
+    same(dbn->template layer_get<1>().w, direct->template layer_get<1>().w);
+    same(dbn->template layer_get<2>().w, direct->template layer_get<2>().w);
+    same(dbn->template layer_get<2>().b, direct->template layer_get<2>().b);
+
+    //No scratch file is left behind
+
+    auto* dir = opendir(dbn->activation_cache_directory.c_str());
+    REQUIRE(dir);
+
+    while (auto* entry = readdir(dir)) {
+        REQUIRE(std::string(entry->d_name).find("dll_activation_cache_") != 0);
+    }
+
+    closedir(dir);
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/19", "[dbn][budget][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::big_batch_size<2>, dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    //The inputs of the second layer fit in the budget, the inputs of the third do not
+    REQUIRE(dll::dbn_detail::select_pretraining_mode(250 * 150 * sizeof(float), 160000, 20, false) == dll::dbn_detail::pretraining_mode::MEMORY);
+    REQUIRE(dll::dbn_detail::select_pretraining_mode(250 * 200 * sizeof(float), 160000, 20, false) == dll::dbn_detail::pretraining_mode::CACHED);
+    REQUIRE(dll::dbn_detail::select_pretraining_mode(250 * 200 * sizeof(float), 160000, 1, false) == dll::dbn_detail::pretraining_mode::STREAMED);
+
+    REQUIRE(dbn->pretrain(dataset.training_images, 20, 160000));
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/20", "[dbn][compact][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<10>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 250, dll::momentum, dll::batch_size<10>>::layer_t,
+            dll::rbm_desc<250, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::activation_storage<dll::storage_type::UINT8>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::dyn_vector<float> values({0.0f, 0.25f, 0.5f, 1.0f});
+
+    dll::compact_vector<float, dll::storage_type::UINT8> bytes(values);
+    dll::compact_vector<float, dll::storage_type::FLOAT16> halves(values);
+
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(bytes[i] == Approx(values[i]).epsilon(1.0 / 255));
+        REQUIRE(halves[i] == values[i]);
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 25);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.2);
+}
+
+//Batch mode and shuffle in layers
+TEST_CASE("unit/dbn/mnist/21", "[dbn][shuffle][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights, dll::shuffle>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>, dll::shuffle>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>, dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto first_image = dataset.training_images[0];
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    //Only the order of the samples is shuffled, not the samples themselves
+    REQUIRE(std::equal(first_image.begin(), first_image.end(), dataset.training_images[0].begin()));
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/22", "[dbn][features][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 30, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>, dll::svm_concatenate>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+    dbn->pretrain(dataset.training_images, 5);
+
+    REQUIRE(dbn->export_features(dataset.training_images, "unit_dbn_22.features"));
+
+    {
+        dll::feature_store<float> features("unit_dbn_22.features");
+
+        REQUIRE(features.is_open());
+        REQUIRE(features.size() == dataset.training_images.size());
+        REQUIRE(features.dims() == 130);
+
+        std::size_t i = 0;
+        for (auto row : features) {
+            auto expected = dbn->full_activation_probabilities(dataset.training_images[i]);
+
+            for (std::size_t j = 0; j < row.size(); ++j) {
+                REQUIRE(row[j] == Approx(expected[j]));
+            }
+
+            ++i;
+        }
+    }
+
+    std::remove("unit_dbn_22.features");
+}
+
+TEST_CASE("unit/dbn/mnist/23", "[dbn][cache][compact][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::big_batch_size<2>, dll::activation_cache, dll::activation_storage<dll::storage_type::UINT8>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    //The cache cannot be created in a missing directory
+    dbn->activation_cache_directory = "unit_dbn_23_missing_directory";
+
+    REQUIRE(!dbn->pretrain(dataset.training_images, 1));
+
+    dbn->activation_cache_directory = ".";
+
+    dbn->learning_rate = 0.05;
+
+    REQUIRE(dbn->pretrain(dataset.training_images, 20));
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/24", "[dbn][budget][shuffle][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 150, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::big_batch_size<2>, dll::shuffle, dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto first_image = dataset.training_images[0];
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    //The inputs of the second layer must be cached, in a missing directory
+    dbn->activation_cache_directory = "unit_dbn_24_missing_directory";
+
+    REQUIRE(!dbn->pretrain(dataset.training_images, 2, 1000));
+
+    dbn->activation_cache_directory = ".";
+
+    dbn->learning_rate = 0.05;
+
+    //The second layer is kept in memory, the next ones are propagated from its inputs
+    REQUIRE(dbn->pretrain(dataset.training_images, 20, 160000));
+
+    //Only the order of the samples is shuffled, not the samples themselves
+    REQUIRE(std::equal(first_image.begin(), first_image.end(), dataset.training_images[0].begin()));
+
+    auto error = dbn->fine_tune(
+        dataset.training_images.begin(), dataset.training_images.end(),
+        dataset.training_labels.begin(), dataset.training_labels.end(),
+        50);
+
+    REQUIRE(error < 5e-2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    REQUIRE(test_error < 0.25);
+}
@@ -34,6 +34,12 @@ TEST_CASE("unit/dense/sgd/1", "[unit][dense][dbn][mnist][sgd]") {
 
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.3);
+
+    auto context = dbn->make_inference_context<etl::fast_dyn_matrix<float, 28 * 28>>();
+
+    for (std::size_t i = 0; i < dataset.training_images.size(); ++i) {
+        REQUIRE(dbn->predict(context, dataset.training_images[i]) == dbn->predict(dataset.training_images[i]));
+    }
 }
 
 // Test tanh -> tanh network
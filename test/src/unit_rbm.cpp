@@ -5,7 +5,9 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cmath>
 #include <numeric>
+#include <random>
 
 #include "catch.hpp"
 
@@ -229,3 +231,393 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+TEST_CASE("unit/rbm/accumulators/1", "[rbm][parallel][unit]") {
+    etl::dyn_matrix<float, 3> acc(5, 3, 2);
+
+    for (std::size_t c = 0; c < 5; ++c) {
+        acc(c) = float(c + 1);
+    }
+
+    cpp::thread_pool<true> pool(3);
+
+    dll::reduce_accumulators(pool, acc, 5);
+
+    for (std::size_t i = 0; i < 3; ++i) {
+        for (std::size_t j = 0; j < 2; ++j) {
+            REQUIRE(acc(0, i, j) == Approx(15.0f));
+        }
+    }
+}
+
+TEST_CASE("unit/rbm/gradients/1", "[rbm][unit]") {
+    using rbm_t = dll::rbm_desc<20, 15, dll::batch_size<8>>::layer_t;
+
+    rbm_t rbm;
+
+    dll::cd1_trainer_t<rbm_t, false> a(rbm);
+    dll::cd1_trainer_t<rbm_t, false> b(rbm);
+
+    std::default_random_engine engine(7);
+    std::uniform_real_distribution<float> dist(0.0, 1.0);
+
+    for (auto* m : {&a.vf, &a.v2_a}) {
+        for (auto& v : *m) {
+            v = dist(engine);
+        }
+    }
+
+    for (auto* m : {&a.h1_a, &a.h2_a}) {
+        for (auto& v : *m) {
+            v = dist(engine);
+        }
+    }
+
+    b.vf   = a.vf;
+    b.v2_a = a.v2_a;
+    b.h1_a = a.h1_a;
+    b.h2_a = a.h2_a;
+
+    a.w_grad = 0.0;
+    a.b_grad = 0.0;
+    a.c_grad = 0.0;
+
+    b.w_grad = 0.0;
+    b.b_grad = 0.0;
+    b.c_grad = 0.0;
+
+    dll::batch_compute_gradients_std(a);
+    dll::batch_compute_gradients_gemm(b);
+
+    for (std::size_t i = 0; i < etl::size(a.w_grad); ++i) {
+        REQUIRE(a.w_grad[i] == Approx(b.w_grad[i]).epsilon(1e-4));
+    }
+
+    for (std::size_t i = 0; i < etl::size(a.b_grad); ++i) {
+        REQUIRE(a.b_grad[i] == Approx(b.b_grad[i]).epsilon(1e-4));
+    }
+
+    for (std::size_t i = 0; i < etl::size(a.c_grad); ++i) {
+        REQUIRE(a.c_grad[i] == Approx(b.c_grad[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/rbm/fused/1", "[rbm][unit]") {
+    using rbm_t = dll::rbm_desc<20, 15, dll::batch_size<8>, dll::hidden<dll::unit_type::RELU>>::layer_t;
+
+    rbm_t rbm;
+
+    etl::fast_matrix<float, 8, 20> v;
+    etl::fast_matrix<float, 8, 15> h_a;
+    etl::fast_matrix<float, 8, 15> h_s;
+    etl::fast_matrix<float, 8, 20> v_a;
+    etl::fast_matrix<float, 8, 20> v_s;
+
+    std::default_random_engine engine(11);
+    std::uniform_real_distribution<float> dist(0.0, 1.0);
+
+    for (auto& value : v) {
+        value = dist(engine);
+    }
+
+    rbm.batch_activate_hidden<true, true>(h_a, h_s, v, v);
+    rbm.batch_activate_visible<true, false>(h_a, h_a, v_a, v_s);
+
+    for (std::size_t b = 0; b < 8; ++b) {
+        etl::fast_dyn_vector<float, 20> v_b(v(b));
+        etl::fast_dyn_vector<float, 15> h_b;
+        etl::fast_dyn_vector<float, 15> hs_b;
+        etl::fast_dyn_vector<float, 20> va_b;
+        etl::fast_dyn_vector<float, 20> vs_b;
+
+        rbm.activate_hidden<true, false>(h_b, hs_b, v_b, v_b);
+        rbm.activate_visible<true, false>(h_b, h_b, va_b, vs_b);
+
+        for (std::size_t j = 0; j < 15; ++j) {
+            REQUIRE(h_a(b, j) == Approx(h_b[j]).epsilon(1e-4));
+            REQUIRE(h_s(b, j) >= 0.0f);
+        }
+
+        for (std::size_t i = 0; i < 20; ++i) {
+            REQUIRE(v_a(b, i) == Approx(va_b[i]).epsilon(1e-4));
+        }
+    }
+}
+
+TEST_CASE("unit/rbm/random/1", "[rbm][unit]") {
+    //Known answers of Philox4x32-10
+    std::uint32_t a[4] = {0, 0, 0, 0};
+    dll::philox::block(a, 0, 0);
+
+    REQUIRE(a[0] == 0x6627e8d5);
+    REQUIRE(a[1] == 0xe169c58d);
+    REQUIRE(a[2] == 0xbc57ac4c);
+    REQUIRE(a[3] == 0x9b00dbd8);
+
+    std::uint32_t b[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    dll::philox::block(b, 0xa4093822, 0x299f31d0);
+
+    REQUIRE(b[0] == 0xd16cfe09);
+    REQUIRE(b[1] == 0x94fdcceb);
+    REQUIRE(b[2] == 0x5001e420);
+    REQUIRE(b[3] == 0x24126ea1);
+
+    //The streams are made of the same blocks, whatever the implementation,
+    //returned word by word for each group of blocks
+    dll::random_stream stream(0xa4093822299f31d0, 3);
+
+    std::uint32_t blocks[dll::philox::lanes][4];
+
+    for (std::size_t n = 0; n < dll::philox::lanes; ++n) {
+        blocks[n][0] = n;
+        blocks[n][1] = 0;
+        blocks[n][2] = 3;
+        blocks[n][3] = 0;
+
+        dll::philox::block(blocks[n], 0x299f31d0, 0xa4093822);
+    }
+
+    for (std::size_t w = 0; w < 4; ++w) {
+        for (std::size_t n = 0; n < dll::philox::lanes; ++n) {
+            REQUIRE(stream() == blocks[n][w]);
+        }
+    }
+}
+
+TEST_CASE("unit/rbm/random/2", "[rbm][parallel][unit]") {
+    using rbm_t = dll::rbm_desc<28 * 28, 50, dll::batch_size<10>, dll::parallel_mode>::layer_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm_t a;
+    rbm_t b;
+
+    b.w = a.w;
+    b.b = a.b;
+    b.c = a.c;
+
+    dll::seed(42);
+    a.train(dataset.training_images, 2);
+
+    dll::seed(42);
+    b.train(dataset.training_images, 2);
+
+    REQUIRE(std::equal(a.w.begin(), a.w.end(), b.w.begin()));
+}
+
+TEST_CASE("unit/rbm/mnist/11", "[rbm][pcd][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<5>,
+        dll::fantasy_particles<40>,
+        dll::momentum,
+        dll::trainer_rbm<dll::pcd1_trainer_t>>::layer_t;
+
+    static_assert(dll::pcd1_trainer_t<rbm_t, false>::chains == 40, "Invalid number of chains");
+
+    rbm_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/12", "[rbm][momentum][hogwild][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::hogwild>::layer_t rbm;
+
+    rbm.hogwild_threads = 4;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/13", "[rbm][momentum][mixed][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::weight_storage<dll::storage_type::BFLOAT16>>::layer_t;
+
+    static_assert(dll::layer_traits<rbm_t>::is_mixed_precision(), "Invalid weight storage");
+
+    rbm_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+
+    //The batch activations with the low-precision weights are close to the exact ones
+    etl::fast_matrix<float, 10, 28 * 28> v;
+    etl::fast_matrix<float, 10, 100> h_a;
+    etl::fast_matrix<float, 10, 100> h_s;
+    etl::fast_matrix<float, 10, 100> h_low;
+
+    for (std::size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    dll::low_precision_weights<float, dll::storage_type::BFLOAT16> w_low(rbm.w);
+
+    rbm.batch_activate_hidden<true, false>(h_a, h_s, v, v);
+    rbm.batch_activate_hidden<true, false>(h_low, h_s, v, v, w_low);
+
+    for (std::size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(std::abs(h_low[i] - h_a[i]) < 1e-2);
+    }
+
+    etl::fast_matrix<float, 10, 28 * 28> v_a;
+    etl::fast_matrix<float, 10, 28 * 28> v_s;
+    etl::fast_matrix<float, 10, 28 * 28> v_low;
+
+    rbm.batch_activate_visible<true, false>(h_a, h_a, v_a, v_s);
+    rbm.batch_activate_visible<true, false>(h_a, h_a, v_low, v_s, w_low);
+
+    for (std::size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(std::abs(v_low[i] - v_a[i]) < 1e-2);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/14", "[rbm][mixed][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::weight_storage<dll::storage_type::FLOAT16>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/compact/1", "[rbm][mixed][unit]") {
+    using codec = dll::compact_codec<float, dll::storage_type::FLOAT16>;
+
+    //Out of range values round to infinity
+    REQUIRE(codec::encode(70000.0f) == 0x7C00);
+    REQUIRE(codec::encode(1e10f) == 0x7C00);
+    REQUIRE(codec::encode(-1e6f) == 0xFC00);
+
+    //Rounding boundary of the largest half
+    REQUIRE(codec::encode(65504.0f) == 0x7BFF);
+    REQUIRE(codec::encode(65519.0f) == 0x7BFF);
+    REQUIRE(codec::encode(65520.0f) == 0x7C00);
+    REQUIRE(codec::encode(-65504.0f) == 0xFBFF);
+
+    REQUIRE(codec::decode(codec::encode(65504.0f)) == 65504.0f);
+    REQUIRE(std::isinf(codec::decode(codec::encode(70000.0f))));
+}
+
+TEST_CASE("unit/rbm/sparse/1", "[rbm][sparse][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    std::vector<dll::sparse_vector<float>> samples;
+
+    for (auto& image : dataset.training_images) {
+        samples.push_back(dll::make_sparse(image));
+    }
+
+    //The sparse positive phase gives the same activations as the dense one
+    etl::fast_matrix<float, 10, 28 * 28> v;
+    etl::fast_matrix<float, 10, 100> h_a;
+    etl::fast_matrix<float, 10, 100> h_s;
+    etl::fast_matrix<float, 10, 100> h_sparse;
+
+    for (std::size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    dll::csr_batch<float> csr;
+    csr.assign(dll::make_batch(samples.begin(), samples.begin() + 10), 10);
+
+    rbm.batch_activate_hidden<true, false>(h_a, h_s, v, v);
+    rbm.batch_activate_hidden<true, false>(h_sparse, h_s, csr, csr);
+
+    for (std::size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_sparse[i] == Approx(h_a[i]));
+    }
+
+    //The same holds with low-precision weights
+    dll::low_precision_weights<float, dll::storage_type::FLOAT16> w_low(rbm.w);
+
+    dll::hidden_pre_activation(h_a, v, w_low);
+    dll::hidden_pre_activation(h_sparse, csr, w_low);
+
+    for (std::size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_sparse[i] == Approx(h_a[i]));
+    }
+
+    auto error = rbm.train(samples, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/15", "[rbm][momentum][metrics][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::free_energy,
+        dll::metrics<dll::metrics_policy::PERIODIC>,
+        dll::metrics_period<5>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+
+    //The batched free energy is the sum of the free energies of the samples
+    etl::fast_matrix<float, 10, 28 * 28> v;
+
+    double expected = 0.0;
+
+    for (std::size_t i = 0; i < 10; ++i) {
+        v(i) = dataset.training_images[i];
+
+        if (i < 7) {
+            expected += rbm.free_energy(dataset.training_images[i]);
+        }
+    }
+
+    REQUIRE(rbm.batch_free_energy(v, 7) == Approx(expected).epsilon(1e-4));
+}
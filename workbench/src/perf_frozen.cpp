@@ -0,0 +1,114 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+
+#include "dll/rbm.hpp"
+#include "dll/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+constexpr const std::size_t REPEAT = 10;
+constexpr const std::size_t BATCH  = 64;
+
+using clock      = std::chrono::steady_clock;
+using time_point = std::chrono::time_point<clock>;
+using resolution = std::chrono::milliseconds;
+
+template <typename Functor>
+void measure(const std::string& name, Functor&& functor) {
+    std::size_t d_min = std::numeric_limits<std::size_t>::max();
+    std::size_t d_max = 0;
+
+    for (std::size_t i = 0; i < REPEAT; ++i) {
+        time_point start = clock::now();
+        functor();
+        time_point end = clock::now();
+        std::size_t d  = std::chrono::duration_cast<resolution>(end - start).count();
+        d_min          = std::min(d_min, d);
+        d_max          = std::max(d_max, d);
+    }
+
+    std::cout << name << ": min:" << d_min << "ms max:" << d_max << "ms" << std::endl;
+}
+
+template <typename DBN, typename Data>
+void compare(const std::string& name, DBN& dbn, const Data& data) {
+    auto frozen = dbn.freeze();
+
+    std::vector<std::size_t> labels(data.size());
+
+    measure(name + ":dbn", [&]() {
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            auto output = dbn.activation_probabilities(data[i]);
+            labels[i]   = std::distance(output.begin(), std::max_element(output.begin(), output.end()));
+        }
+    });
+
+    auto ws = frozen.make_workspace(BATCH);
+
+    measure(name + ":frozen", [&]() {
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            labels[i] = frozen.predict(ws, data[i]);
+        }
+    });
+
+    measure(name + ":frozen_batch", [&]() {
+        frozen.predict_batch(ws, data.begin(), data.end(), labels.begin());
+    });
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv []) {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(5000);
+
+    std::string sub;
+    if(argc > 1){
+        sub = argv[1];
+    }
+
+    mnist::binarize_dataset(dataset);
+
+    std::cout << dataset.training_images.size() << " images used for inference" << std::endl;
+
+    if(sub.empty() || sub == "rbm"){
+        using dbn_t = dll::dbn_desc<
+            dll::dbn_layers<
+                dll::rbm_desc<28 * 28, 500, dll::init_weights>::layer_t,
+                dll::rbm_desc<500, 500>::layer_t,
+                dll::rbm_desc<500, 10, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>>::dbn_t;
+
+        auto dbn = std::make_unique<dbn_t>();
+        compare("rbm", *dbn, dataset.training_images);
+    }
+
+    if(sub.empty() || sub == "dense"){
+        using dbn_t = dll::dbn_desc<
+            dll::dbn_layers<
+                dll::dense_desc<28 * 28, 500>::layer_t,
+                dll::dense_desc<500, 500>::layer_t,
+                dll::dense_desc<500, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+            dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+        auto dbn = std::make_unique<dbn_t>();
+        compare("dense", *dbn, dataset.training_images);
+    }
+
+    if(!sub.empty()){
+        dll::dump_timers();
+    }
+
+    return 0;
+}
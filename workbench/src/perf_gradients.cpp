@@ -0,0 +1,117 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <memory>
+
+#include "dll/rbm.hpp"
+
+namespace {
+
+constexpr const std::size_t ITERATIONS = 50;
+
+using clock      = std::chrono::steady_clock;
+using time_point = std::chrono::time_point<clock>;
+using resolution = std::chrono::microseconds;
+
+#define MEASURE(trainer, name, kernel)                                                     \
+    {                                                                                      \
+        std::size_t d_min = std::numeric_limits<std::size_t>::max();                       \
+        std::size_t d_max = 0;                                                             \
+        for (std::size_t i = 0; i < ITERATIONS; ++i) {                                     \
+            trainer.w_grad = 0.0;                                                          \
+            trainer.b_grad = 0.0;                                                          \
+            trainer.c_grad = 0.0;                                                          \
+            time_point start = clock::now();                                               \
+            kernel(trainer);                                                               \
+            time_point end = clock::now();                                                 \
+            std::size_t d  = std::chrono::duration_cast<resolution>(end - start).count();  \
+            d_min          = std::min(d_min, d);                                           \
+            d_max          = std::max(d_max, d);                                           \
+        }                                                                                  \
+        std::cout << name << ": min:" << d_min << "us max:" << d_max << "us" << std::endl; \
+    }
+
+template <typename Trainer>
+double max_difference(const Trainer& lhs, const Trainer& rhs) {
+    double diff = 0.0;
+
+    for (std::size_t i = 0; i < etl::size(lhs.w_grad); ++i) {
+        diff = std::max(diff, double(std::abs(lhs.w_grad[i] - rhs.w_grad[i])));
+    }
+
+    return diff;
+}
+
+template <typename Trainer>
+void fill(Trainer& trainer) {
+    std::default_random_engine engine(42);
+    std::uniform_real_distribution<float> dist(0.0, 1.0);
+
+    for (auto& v : trainer.vf) {
+        v = dist(engine);
+    }
+
+    for (auto& v : trainer.v2_a) {
+        v = dist(engine);
+    }
+
+    for (auto& v : trainer.h1_a) {
+        v = dist(engine);
+    }
+
+    for (auto& v : trainer.h2_a) {
+        v = dist(engine);
+    }
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv []) {
+    std::string sub;
+    if(argc > 1){
+        sub = argv[1];
+    }
+
+    using rbm_t = dll::rbm_desc<784, 500, dll::batch_size<64>, dll::weight_type<float>>::layer_t;
+
+    auto rbm = std::make_unique<rbm_t>();
+
+    auto std_trainer  = std::make_unique<dll::cd1_trainer_t<rbm_t, false>>(*rbm);
+    auto gemm_trainer = std::make_unique<dll::cd1_trainer_t<rbm_t, false>>(*rbm);
+
+    fill(*std_trainer);
+    fill(*gemm_trainer);
+
+    if(sub.empty() || sub == "std"){
+        MEASURE((*std_trainer), "std", dll::batch_compute_gradients_std);
+    }
+
+    if(sub.empty() || sub == "gemm"){
+        MEASURE((*gemm_trainer), "gemm", dll::batch_compute_gradients_gemm);
+    }
+
+    if(sub.empty()){
+        std::cout << "max difference: " << max_difference(*std_trainer, *gemm_trainer) << std::endl;
+    }
+
+#ifdef ETL_BLAS_MODE
+    if(sub.empty() || sub == "blas"){
+        auto blas_trainer = std::make_unique<dll::cd1_trainer_t<rbm_t, false>>(*rbm);
+        fill(*blas_trainer);
+        MEASURE((*blas_trainer), "blas", dll::batch_compute_gradients_blas);
+    }
+#endif
+
+    if(!sub.empty()){
+        dll::dump_timers();
+    }
+
+    return 0;
+}
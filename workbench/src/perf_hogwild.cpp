@@ -0,0 +1,82 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+
+#include "dll/rbm.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+constexpr const std::size_t EPOCHS = 5;
+
+using clock      = std::chrono::steady_clock;
+using time_point = std::chrono::time_point<clock>;
+using resolution = std::chrono::milliseconds;
+
+template <typename RBM, typename Data>
+void measure(RBM& rbm, const std::string& name, const Data& data) {
+    std::size_t d_min = std::numeric_limits<std::size_t>::max();
+    std::size_t d_max = 0;
+
+    double error = 0.0;
+
+    for (std::size_t i = 0; i < EPOCHS; ++i) {
+        time_point start = clock::now();
+        error            = rbm.template train<false>(data, 1);
+        time_point end   = clock::now();
+        std::size_t d    = std::chrono::duration_cast<resolution>(end - start).count();
+        d_min            = std::min(d_min, d);
+        d_max            = std::max(d_max, d);
+    }
+
+    std::cout << name << ": min:" << d_min << "ms max:" << d_max << "ms error:" << error << std::endl;
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv []) {
+    auto dataset = mnist::read_dataset<std::vector, std::vector, float>(10000);
+
+    std::string sub;
+    if(argc > 1){
+        sub = argv[1];
+    }
+
+    mnist::binarize_dataset(dataset);
+
+    std::cout << dataset.training_images.size() << " images used for training" << std::endl;
+    std::cout << etl::threads << " maximum threads" << std::endl;
+
+    if(sub.empty() || sub == "batch"){
+        auto rbm = std::make_unique<dll::rbm_desc<784, 500, dll::batch_size<16>, dll::momentum, dll::weight_type<float>>::layer_t>();
+        measure(*rbm, "batch", dataset.training_images);
+    }
+
+    if(sub.empty() || sub == "parallel"){
+        auto rbm = std::make_unique<dll::rbm_desc<784, 500, dll::batch_size<16>, dll::momentum, dll::parallel_mode, dll::weight_type<float>>::layer_t>();
+        measure(*rbm, "parallel", dataset.training_images);
+    }
+
+    if(sub.empty() || sub == "hogwild"){
+        for (std::size_t t = 1; t <= etl::threads; ++t) {
+            auto rbm = std::make_unique<dll::rbm_desc<784, 500, dll::batch_size<16>, dll::momentum, dll::hogwild, dll::weight_type<float>>::layer_t>();
+            rbm->hogwild_threads = t;
+            measure(*rbm, "hogwild(" + std::to_string(t) + ")", dataset.training_images);
+        }
+    }
+
+    if(!sub.empty()){
+        dll::dump_timers();
+    }
+
+    return 0;
+}
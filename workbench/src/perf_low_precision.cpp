@@ -0,0 +1,120 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+
+#include "dll/rbm.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+constexpr const std::size_t EPOCHS = 5;
+constexpr const std::size_t REPEAT = 100;
+constexpr const std::size_t BATCH  = 64;
+
+using clock      = std::chrono::steady_clock;
+using time_point = std::chrono::time_point<clock>;
+using resolution = std::chrono::microseconds;
+
+template <typename Functor>
+void measure(const std::string& name, std::size_t repeat, Functor&& functor) {
+    std::size_t d_min = std::numeric_limits<std::size_t>::max();
+    std::size_t d_max = 0;
+
+    for (std::size_t i = 0; i < repeat; ++i) {
+        time_point start = clock::now();
+        functor();
+        time_point end = clock::now();
+        std::size_t d  = std::chrono::duration_cast<resolution>(end - start).count();
+        d_min          = std::min(d_min, d);
+        d_max          = std::max(d_max, d);
+    }
+
+    std::cout << name << ": min:" << d_min << "us max:" << d_max << "us" << std::endl;
+}
+
+template <dll::storage_type S, typename Data>
+void train(const std::string& name, const Data& data) {
+    auto rbm = std::make_unique<dll::rbm_desc<784, 500, dll::batch_size<BATCH>, dll::momentum, dll::weight_type<float>, dll::weight_storage<S>>::layer_t>();
+
+    double error = 0.0;
+
+    measure(name, EPOCHS, [&]() {
+        error = rbm->template train<false>(data, 1);
+    });
+
+    std::cout << name << ": error:" << error << std::endl;
+}
+
+/*!
+ * \brief Measure the Gibbs step products, with the native weights and with
+ * the given weights
+ */
+template <typename W, typename Data>
+void gibbs(const std::string& name, const Data& data) {
+    etl::fast_matrix<float, 784, 500> w;
+    w = etl::normal_generator<float>(0.0, 0.01);
+
+    etl::fast_matrix<float, BATCH, 784> v;
+    etl::fast_matrix<float, BATCH, 784> v_pre;
+    etl::fast_matrix<float, BATCH, 500> h_pre;
+
+    for (std::size_t i = 0; i < BATCH; ++i) {
+        v(i) = data[i];
+    }
+
+    W w_low(w);
+
+    measure(name + ":hidden", REPEAT, [&]() {
+        dll::hidden_pre_activation(h_pre, v, w_low);
+    });
+
+    measure(name + ":visible", REPEAT, [&]() {
+        dll::visible_pre_activation(v_pre, h_pre, w_low);
+    });
+
+    measure(name + ":encode", REPEAT, [&]() {
+        w_low = w;
+    });
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv []) {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(10000);
+
+    std::string sub;
+    if(argc > 1){
+        sub = argv[1];
+    }
+
+    mnist::binarize_dataset(dataset);
+
+    std::cout << dataset.training_images.size() << " images used for training" << std::endl;
+
+    if(sub.empty() || sub == "gibbs"){
+        gibbs<etl::fast_matrix<float, 784, 500>>("native", dataset.training_images);
+        gibbs<dll::low_precision_weights<float, dll::storage_type::FLOAT16>>("float16", dataset.training_images);
+        gibbs<dll::low_precision_weights<float, dll::storage_type::BFLOAT16>>("bfloat16", dataset.training_images);
+    }
+
+    if(sub.empty() || sub == "train"){
+        train<dll::storage_type::NATIVE>("train:native", dataset.training_images);
+        train<dll::storage_type::FLOAT16>("train:float16", dataset.training_images);
+        train<dll::storage_type::BFLOAT16>("train:bfloat16", dataset.training_images);
+    }
+
+    if(!sub.empty()){
+        dll::dump_timers();
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+//=======================================================================
+// Copyright (c) 2014-2016 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+#include <memory>
+
+#include "dll/conv_layer.hpp"
+
+namespace {
+
+constexpr const std::size_t REPEAT = 20;
+constexpr const std::size_t BATCH  = 64;
+
+using clock      = std::chrono::steady_clock;
+using time_point = std::chrono::time_point<clock>;
+using resolution = std::chrono::microseconds;
+
+template <typename Functor>
+void measure(const std::string& name, Functor&& functor) {
+    std::size_t d_min = std::numeric_limits<std::size_t>::max();
+    std::size_t d_max = 0;
+
+    for (std::size_t i = 0; i < REPEAT; ++i) {
+        time_point start = clock::now();
+        functor();
+        time_point end = clock::now();
+        std::size_t d  = std::chrono::duration_cast<resolution>(end - start).count();
+        d_min          = std::min(d_min, d);
+        d_max          = std::max(d_max, d);
+    }
+
+    std::cout << name << ": min:" << d_min << "us max:" << d_max << "us" << std::endl;
+}
+
+template <std::size_t NC, std::size_t NV, std::size_t K, std::size_t NW>
+void compare(const std::string& name) {
+    static constexpr const std::size_t NH = NV - NW + 1;
+
+    using layer_t = typename dll::conv_desc<NC, NV, NV, K, NH, NH, dll::activation<dll::function::RELU>>::layer_t;
+
+    auto layer = std::make_unique<layer_t>();
+
+    auto input  = std::make_unique<etl::fast_dyn_matrix<float, BATCH, NC, NV, NV>>();
+    auto output = std::make_unique<etl::fast_dyn_matrix<float, BATCH, K, NH, NH>>();
+
+    *input = etl::normal_generator<float>();
+
+    measure(name + ":winograd", [&]() {
+        dll::winograd_conv<float, NW, NW>::apply(input->memory_start(), BATCH, NC, NV, NV, layer->w.memory_start(), K, [&](std::size_t b, std::size_t k) {
+            return (*output)(b)(k).memory_start();
+        });
+    });
+
+    measure(name + ":im2col", [&]() {
+        dll::batch_conv_valid_im2col(*input, layer->w, [&](std::size_t b, std::size_t k) {
+            return (*output)(b)(k).memory_start();
+        });
+    });
+
+    measure(name + ":direct", [&]() {
+        auto& w_flipped = layer->flipped_w();
+
+        etl::fast_dyn_matrix<float, K, NH, NH> tmp;
+
+        for (std::size_t b = 0; b < BATCH; ++b) {
+            (*output)(b) = 0;
+
+            for (std::size_t c = 0; c < NC; ++c) {
+                etl::conv_2d_valid_multi((*input)(b)(c), w_flipped(c), tmp);
+                (*output)(b) += tmp;
+            }
+        }
+    });
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv []) {
+    std::string sub;
+    if(argc > 1){
+        sub = argv[1];
+    }
+
+    if(sub.empty() || sub == "3x3"){
+        compare<1, 28, 8, 3>("1x28x28:8x3x3");
+        compare<8, 13, 16, 3>("8x13x13:16x3x3");
+    }
+
+    if(sub.empty() || sub == "5x5"){
+        compare<1, 28, 6, 5>("1x28x28:6x5x5");
+        compare<6, 12, 16, 5>("6x12x12:16x5x5");
+    }
+
+    if(!sub.empty()){
+        dll::dump_timers();
+    }
+
+    return 0;
+}